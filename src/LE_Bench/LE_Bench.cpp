@@ -0,0 +1,701 @@
+#ifdef LE_BENCH
+
+#include "LE_Bench/LE_Bench.h"
+#include <unistd.h>
+#include <time.h>
+
+#define LE_BENCH_BUDGET_MSG "bench budget reached" // Error stopping a data/ script run
+
+static std::atomic<bool> LE_Responding; // The responder answers the Buff_*_Wait notifications
+static TaskHandle_t LE_BenchTask; // Task running the measured VM
+static bool LE_BudgetHit; // The last data/ script run was stopped by the instruction budget
+
+/**
+ * @brief Monotonic time in nanoseconds
+ *
+ * @return uint64_t Current time
+ */
+static uint64_t LE_NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Construct the benchmark and register its cases
+ *
+ */
+LE_Bench::LE_Bench() {
+  _ncases = 0;
+  _nresults = 0;
+  _report = stdout;
+  _responder = NULL;
+  _max_ns = 0;
+  _dispatched = 0;
+  target_ms = LE_BENCH_TARGET_MS;
+  repeat = LE_BENCH_REPEAT;
+
+  // Interpreter
+  LE_AddNative("vm_reset", LE_RunReset, "");
+  LE_AddCase("loop_empty", NULL, "local n = ... for i = 1, n do end");
+  LE_AddCase("call_lua", NULL, "local function f(x) return x end local n = ... for i = 1, n do f(i) end");
+  LE_AddCase("call_global", "function g(x) return x end", "local n = ... for i = 1, n do g(i) end");
+  LE_AddCase("call_library", NULL, "local n = ... for i = 1, n do math.abs(i) end");
+  LE_AddCase("call_recursive", "function fact(n) if n <= 1 then return 1 end return n * fact(n - 1) end",
+             "local n = ... for i = 1, n do local t = {fact(24)} end");
+  LE_AddCase("arith_avg", "samples = {} for i = 1, 64 do samples[i] = i * 0.37 end",
+             "local s, n = samples, ... local sum, mn, cnt = 0.0, 1e9, 0 for i = 1, n do local v = s[(i & 63) + 1] "
+             "sum = sum + v cnt = cnt + 1 if v < mn then mn = v end end return sum / cnt");
+  LE_AddCase("global_read", "ga, gb, gc = 1, 2, 3", "local n = ... local s = 0 for i = 1, n do s = ga + gb + gc end");
+  LE_AddCase("config_global", "CFG_DEBUG, CFG_SLOT, CFG_SCALE = false, 2, 0.5",
+             "local n = ... local s = 0 for i = 1, n do if CFG_DEBUG then print(i) end s = s + CFG_SLOT * CFG_SCALE end");
+  LE_AddCase("config_const", NULL,
+             "local n = ... local s = 0 for i = 1, n do if LE_BENCH_DEBUG then print(i) end s = s + LE_BENCH_SLOT * LE_BENCH_SCALE end");
+
+  // Host bindings
+  LE_AddCase("bind_millis", NULL, "local n = ... for i = 1, n do millis() end");
+  LE_AddCase("bind_print", NULL, "local n = ... for i = 1, n do print('bench', i) end");
+  LE_AddCase("bind_nvs_getval", NULL, "local n = ... for i = 1, n do NVS_GetVal('bench') end");
+  LE_AddCase("bind_nvs_writeint", NULL, "local n = ... for i = 1, n do NVS_WriteInt('bench', i) end");
+  LE_AddCase("bind_buff_read", NULL, "local n = ... for i = 1, n do Buff_Read(1) end");
+  LE_AddCase("bind_buff_write_nowait", NULL, "local n = ... for i = 1, n do Buff_Write_NoWait(1, i) end");
+  LE_AddCase("bind_buff_write_wait", NULL, "local n = ... for i = 1, n do Buff_Write_Wait(1, i) end", true);
+  LE_AddCase("bind_buff_read_wait", NULL, "local n = ... for i = 1, n do Buff_Read_Wait(1) end", true);
+
+  // Tables
+  LE_AddCase("table_array_fill", NULL,
+             "local n = ... for i = 1, n do local t = {} for j = 1, 16 do t[j] = j end end");
+  LE_AddCase("table_hash_fill", "keys = {} for i = 1, 16 do keys[i] = 'k' .. i end",
+             "local keys = keys local n = ... for i = 1, n do local t = {} for j = 1, #keys do t[keys[j]] = j end end");
+  LE_AddCase("table_append", NULL,
+             "local n = ... for i = 1, n do local t = {} for j = 1, 40 do t[#t + 1] = j * 0.5 end end");
+  LE_AddCase("table_read", "arr = {} for i = 1, 1024 do arr[i] = i end rec = {x = 1, y = 2, z = 3}",
+             "local arr, rec = arr, rec local s = 0 local n = ... for i = 1, n do s = s + arr[(i & 1023) + 1] + rec.x end");
+  LE_AddCase("table_field_chain", "cfg = {dev = {temp = 21, mode = 1}}",
+             "local s = 0 local n = ... for i = 1, n do s = s + cfg.dev.temp + cfg.dev.mode end");
+  LE_AddCase("table_record", "dev = {temp = 20, mode = 1, setpoint = 22, hyst = 1, out = 0}",
+             "local d, n = dev, ... for i = 1, n do local err = d.setpoint - d.temp "
+             "if err > d.hyst then d.out = 1 elseif err < -d.hyst then d.out = 0 end d.temp = d.temp + d.out - 0.5 end");
+  LE_AddCase("table_small", NULL,
+             "local n, s = ..., 0 for i = 1, n do local e = {id = i, value = i * 0.5, unit = 'C'} s = s + e.value end");
+  LE_AddNative("table_grow", LE_RunTableGrow, "");
+  LE_AddCase("table_insert_remove", NULL,
+             "local t = {} local n = ... for i = 1, n do table.insert(t, i) end for i = 1, n do table.remove(t) end");
+  LE_AddCase("table_pairs", "cfg = {} for i = 1, 64 do cfg['opt' .. i] = i end",
+             "local cfg, s = cfg, 0 local n = ... for i = 1, n do for k, v in pairs(cfg) do s = s + v end end");
+  LE_AddCase("table_concat", "parts = {} for i = 1, 16 do parts[i] = 'p' .. i end",
+             "local parts = parts local n = ... for i = 1, n do table.concat(parts, ',') end");
+
+  // Typed arrays and rolling windows, against the same work on tables
+  LE_AddCase("array_sum_table", "samples = {} for i = 1, 256 do samples[i] = i * 0.37 end",
+             "local t, s = samples local n = ... for i = 1, n do s = 0 for j = 1, #t do s = s + t[j] end end");
+  LE_AddCase("array_sum", "samples = {} for i = 1, 256 do samples[i] = i * 0.37 end arr = array.new('float32', samples)",
+             "local a, s = arr local n = ... for i = 1, n do s = a:sum() end");
+  LE_AddCase("array_index", "arr = array.new('float32', 256, 0.5)",
+             "local a, s = arr, 0 local n = ... for i = 1, n do a[(i & 255) + 1] = i s = s + a[(i & 255) + 1] end");
+  LE_AddCase("array_movavg", "arr = array.new('int16', 256, 7) avg = array.new('float32', 256)",
+             "local a, out = arr, avg local n = ... for i = 1, n do a:movavg(8, out) end");
+  LE_AddCase("window_table", NULL,
+             "local t, s, mx = {} local n = ... for i = 1, n do t[#t + 1] = i % 97 if #t > 64 then table.remove(t, 1) end "
+             "s, mx = 0, -1e9 for j = 1, #t do local v = t[j] s = s + v if v > mx then mx = v end end end");
+  LE_AddCase("window_push", NULL,
+             "local w, s, mx = array.window(64) local n = ... for i = 1, n do w:push(i % 97) s, mx = w:mean(), w:max() end");
+
+  // Signal processing on 256 samples
+  LE_AddCase("dsp_goertzel_lua", "sig = {} for i = 1, 256 do sig[i] = math.sin(i * 0.3) end",
+             "local x, c = sig, 2 * math.cos(2 * math.pi * 10 / 256) local n = ... for i = 1, n do local s1, s2 = 0, 0 "
+             "for j = 1, #x do s1, s2 = x[j] + c * s1 - s2, s1 end local p = s1 * s1 + s2 * s2 - c * s1 * s2 end");
+  LE_AddCase("dsp_goertzel", "sig = array.new('float32', 256) for i = 1, 256 do sig[i] = math.sin(i * 0.3) end",
+             "local x = sig local n = ... for i = 1, n do dsp.goertzel(x, 10, 256) end");
+  LE_AddCase("dsp_fft", "buf = array.new('float32', 256)",
+             "local b = buf local n = ... for i = 1, n do b:fill(0.25) b[5] = 1 dsp.fft(b) end");
+  LE_AddCase("dsp_spectrum", "buf = array.new('float32', 256) mag = array.new('float32', 129)",
+             "local b, m = buf, mag local n = ... for i = 1, n do b:fill(0.25) b[5] = 1 dsp.window(b) dsp.fft(b) "
+             "dsp.magnitude(b, m) end");
+
+  // Strings
+  LE_AddCase("string_concat", NULL, "local s local n = ... for i = 1, n do s = 'v' .. i .. ':' .. (i * 2) end");
+  LE_AddCase("string_format", NULL, "local n = ... for i = 1, n do string.format('%d:%.2f:%s', i, i / 3, 'x') end");
+  LE_AddCase("string_find", "text = string.rep('lorem ipsum dolor sit amet ', 8)",
+             "local text = text local n = ... for i = 1, n do string.find(text, 'amet', 1, true) end");
+  LE_AddCase("string_gsub", "text = string.rep('lorem ipsum dolor sit amet ', 8)",
+             "local text = text local n = ... for i = 1, n do text:gsub('o', '0') end");
+
+  // Garbage collection
+  LE_AddCase("gc_full_10k", "live = {} for i = 1, 10000 do live[i] = {i, tostring(i)} end",
+             "local n = ... for i = 1, n do Grb_collect() end");
+  LE_AddCase("gc_churn", NULL, "local n = ... for i = 1, n do local t = {i, i} end");
+
+  LE_AddScripts();
+}
+
+/**
+ * @brief Add a case running a Lua chunk
+ *
+ * @param name Case name
+ * @param setup Lua chunk run once before the measurements, or NULL
+ * @param loop Lua chunk running the iteration count given as argument
+ * @param respond Answer the Buff_*_Wait notifications during the case
+ */
+void LE_Bench::LE_AddCase(const char *name, const char *setup, const char *loop, bool respond) {
+  if (_ncases == LE_BENCH_MAX_CASES)
+    return;
+  LE_BenchCase *c = &_cases[_ncases++];
+  snprintf(c->name, sizeof(c->name), "%s", name);
+  c->setup = setup;
+  c->loop = loop;
+  c->run = NULL;
+  c->respond = respond;
+  c->path[0] = '\0';
+}
+
+/**
+ * @brief Add a case running a native function
+ *
+ * @param name Case name
+ * @param run Function running the iterations
+ * @param path Script file used by the case, empty when none
+ */
+void LE_Bench::LE_AddNative(const char *name, bool (*run)(LE_Bench *, LE_BenchCase *, uint32_t), const char *path) {
+  if (_ncases == LE_BENCH_MAX_CASES)
+    return;
+  LE_BenchCase *c = &_cases[_ncases++];
+  snprintf(c->name, sizeof(c->name), "%s", name);
+  c->setup = NULL;
+  c->loop = NULL;
+  c->run = run;
+  c->respond = false;
+  snprintf(c->path, sizeof(c->path), "%s", path);
+}
+
+/**
+ * @brief Add a load case and a run case for every Lua script of the filesystem root
+ *
+ */
+void LE_Bench::LE_AddScripts() {
+  File root = SPIFFS.open("/");
+  if (!root)
+    return;
+
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    const char *name = f.name();
+    const char *ext = strrchr(name, '.');
+    if (f.isDirectory() || ext == NULL || strcmp(ext, ".lua") != 0)
+      continue;
+
+    char path[48];
+    char case_name[48];
+    snprintf(path, sizeof(path), "/%s", name);
+    int len = (int) (ext - name);
+    snprintf(case_name, sizeof(case_name), "load_%.*s", len, name);
+    LE_AddNative(case_name, LE_RunLoad, path);
+    snprintf(case_name, sizeof(case_name), "run_%.*s", len, name);
+    LE_AddNative(case_name, LE_RunScript, path);
+    snprintf(case_name, sizeof(case_name), "sim_%.*s", len, name);
+    LE_AddNative(case_name, LE_RunSimulated, path);
+  }
+}
+
+/**
+ * @brief Answer the Buff_*_Wait notifications of the measured VM, as a peer task would
+ *
+ * @param pvParameters Unused
+ */
+void LE_Bench::LE_Responder(void *pvParameters) {
+  (void) pvParameters;
+  while (1) {
+    if (!LE_Responding) {
+      vTaskDelay(1);
+      continue;
+    }
+    if (LuaEngine::LuaNotifyWriteWait || LuaEngine::LuaNotifyReadWait) {
+      // Answer only when the previous answer was received, as the wait flag may not be reset yet
+      pthread_mutex_lock(&LE_BenchTask->lock);
+      bool pending = LE_BenchTask->notify_pending;
+      pthread_mutex_unlock(&LE_BenchTask->lock);
+      if (!pending)
+        xTaskNotify(LE_BenchTask, 0, eSetValueWithOverwrite);
+    }
+    taskYIELD(); // Let the measured VM run between two polls of its wait flags
+  }
+}
+
+/**
+ * @brief Stop a data/ script run once its instruction budget is used
+ *
+ * @param L Lua state
+ * @param ar Hook event
+ */
+void LE_Bench::LE_CountHook(lua_State *L, lua_Debug *ar) {
+  (void) ar;
+  LE_BudgetHit = true;
+  luaL_error(L, LE_BENCH_BUDGET_MSG);
+}
+
+/**
+ * @brief delay() replacement, so that scripts run without blocking
+ *
+ * @param L Lua state
+ * @return int Number of results for Lua interpreter
+ */
+int LE_Bench::LE_NoDelay(lua_State *L) {
+  luaL_checkinteger(L, 1);
+  return 0;
+}
+
+/**
+ * @brief Create a VM and register the host bindings, n times
+ *
+ * @return true Iterations completed
+ */
+bool LE_Bench::LE_RunReset(LE_Bench *b, LE_BenchCase *c, uint32_t n) {
+  (void) c;
+  for (uint32_t i = 0; i < n; i++) {
+    b->LW.LW_CloseLVM();
+    b->LW.LW_ResetLVM();
+    b->LE.Lua_TaskMapFunc(b->LW);
+  }
+  return true;
+}
+
+/**
+ * @brief Add n new keys to a table, replaced by a new one every LE_BENCH_GROW_KEYS keys, timing each
+ * addition to find the longest, which includes the rehash of the table when it grows
+ *
+ * @return true Iterations completed
+ */
+bool LE_Bench::LE_RunTableGrow(LE_Bench *b, LE_BenchCase *c, uint32_t n) {
+  (void) c;
+  lua_State *L = b->LW.LW_GetState();
+  lua_newtable(L);
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t k = i % LE_BENCH_GROW_KEYS;
+    if (k == 0 && i > 0) {
+      lua_pop(L, 1);
+      lua_newtable(L);
+    }
+    lua_pushnumber(L, k + 0.5); // Not an integer, so that the key goes to the hash part
+    lua_pushinteger(L, i);
+    uint64_t start = LE_NowNs();
+    lua_rawset(L, -3);
+    uint64_t ns = LE_NowNs() - start;
+    if (ns > b->_max_ns)
+      b->_max_ns = ns;
+  }
+  lua_pop(L, 1);
+  return true;
+}
+
+/**
+ * @brief Load the script of the case, n times
+ *
+ * @return true Iterations completed
+ * @return false The script failed to load
+ */
+bool LE_Bench::LE_RunLoad(LE_Bench *b, LE_BenchCase *c, uint32_t n) {
+  lua_State *L = b->LW.LW_GetState();
+  for (uint32_t i = 0; i < n; i++) {
+    if (b->LW.LW_LoadFile(c->path) != LUA_OK) {
+      fprintf(b->_report, "%s: %s\n", c->name, lua_tostring(L, -1));
+      lua_pop(L, 1);
+      return false;
+    }
+    lua_pop(L, 1);
+  }
+  return true;
+}
+
+/**
+ * @brief Run the loaded script of the case n times, each run stopped after LE_BENCH_SCRIPT_BUDGET instructions
+ *
+ * @return true Iterations completed
+ * @return false The script raised an error
+ */
+bool LE_Bench::LE_RunScript(LE_Bench *b, LE_BenchCase *c, uint32_t n) {
+  lua_State *L = b->LW.LW_GetState();
+  for (uint32_t i = 0; i < n; i++) {
+    LE_BudgetHit = false;
+    lua_sethook(L, LE_CountHook, LUA_MASKCOUNT, LE_BENCH_SCRIPT_BUDGET);
+    lua_pushvalue(L, 1);
+    int status = lua_pcall(L, 0, 0, 0);
+    lua_sethook(L, NULL, 0, 0);
+    if (status != LUA_OK) {
+      if (!LE_BudgetHit) {
+        fprintf(b->_report, "%s: %s\n", c->name, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+      }
+      lua_pop(L, 1);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Run the loaded script of the case n times on the simulated clock, each run lasting
+ * LE_BENCH_SIM_MS of simulated time, stopped after LE_BENCH_SIM_BUDGET instructions
+ *
+ * @return true Iterations completed
+ * @return false The script raised an error
+ */
+bool LE_Bench::LE_RunSimulated(LE_Bench *b, LE_BenchCase *c, uint32_t n) {
+  lua_State *L = b->LW.LW_GetState();
+  bool ok = true;
+  for (uint32_t i = 0; ok && i < n; i++) {
+    LuaEngine::Lua_SimClock(true, 0, LE_BENCH_SIM_MS);
+    LE_BudgetHit = false;
+    lua_sethook(L, LE_CountHook, LUA_MASKCOUNT, LE_BENCH_SIM_BUDGET);
+    lua_pushvalue(L, 1);
+    int status = lua_pcall(L, 0, 0, 0);
+    lua_sethook(L, NULL, 0, 0);
+    if (status != LUA_OK) {
+      const char *msg = lua_tostring(L, -1);
+      bool sim_end = LuaEngine::Lua_SimEnded() && msg != NULL && strstr(msg, LUA_SIM_END_MSG) != NULL;
+      if (!LE_BudgetHit && !sim_end) {
+        fprintf(b->_report, "%s: %s\n", c->name, msg);
+        ok = false;
+      }
+      lua_pop(L, 1);
+    }
+  }
+  LuaEngine::Lua_SimClock(false);
+  return ok;
+}
+
+/**
+ * @brief Start a fresh VM for a case, run its setup and leave its chunk at stack index 1
+ *
+ * @param c Case to prepare
+ * @return true VM ready
+ * @return false Setup failed
+ */
+bool LE_Bench::LE_Prepare(LE_BenchCase *c) {
+  LW.LW_CloseLVM();
+  LW.LW_ResetLVM();
+  LE.Lua_TaskMapFunc(LW);
+  if (c->run != LE_RunSimulated)
+    LW.LW_RegisterFunc(Lua_Delay_FuncName, (lua_CFunction) &LE_NoDelay);
+  // Host constants of the config_const case
+  LW.LW_DefineConst("LE_BENCH_DEBUG", false);
+  LW.LW_DefineConst("LE_BENCH_SLOT", 2);
+  LW.LW_DefineConst("LE_BENCH_SCALE", 0.5);
+
+  lua_State *L = LW.LW_GetState();
+  int status = LUA_OK;
+  if (c->setup != NULL) {
+    // The setup chunk defines the functions of the case, as the function script does
+    #if LUA_LINK_FUNC_SCRIPT
+    status = luaL_loadstring(L, c->setup);
+    if (status == LUA_OK)
+      status = LW.LW_LinkChunk();
+    #else
+    status = luaL_dostring(L, c->setup);
+    #endif
+  }
+  if (status == LUA_OK && c->loop != NULL) {
+    status = luaL_loadstring(L, c->loop);
+    #if LUA_LINK_FUNC_SCRIPT
+    if (status == LUA_OK) {
+      // Bind the loop to the functions of the setup chunk, as LW_LoadFile binds MainScript
+      if (lua_getfield(L, LUA_REGISTRYINDEX, LW_LINK_TABLE) == LUA_TTABLE) {
+        lua_pushvalue(L, -2);
+        lua_linkglobals(L, -2);
+        lua_pop(L, 1);
+      }
+      lua_pop(L, 1); // Remove export table
+    }
+    #endif
+  }
+  else if (status == LUA_OK && (c->run == LE_RunScript || c->run == LE_RunSimulated)) {
+    // Scripts run after the function script, as in the Lua task
+    if (strcmp(c->path, LF_Filename) != 0 && SPIFFS.exists(LF_Filename)) {
+      #if LUA_LINK_FUNC_SCRIPT
+      LW.LW_LinkFile(LF_Filename);
+      #else
+      LW.LW_ExecuteFile(LF_Filename);
+      #endif
+    }
+    status = LW.LW_LoadFile(c->path);
+  }
+
+  if (status != LUA_OK) {
+    fprintf(_report, "%s: %s\n", c->name, lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Run n iterations of a case
+ *
+ * @param c Case to run
+ * @param n Number of iterations
+ * @param elapsed_ns Wall time of the iterations
+ * @return true Iterations completed
+ * @return false The case failed
+ */
+bool LE_Bench::LE_Iterate(LE_BenchCase *c, uint32_t n, uint64_t *elapsed_ns) {
+  lua_State *L = LW.LW_GetState();
+  bool ok = true;
+
+  LW.LW_ResetAllocStats();
+  _max_ns = 0;
+  lua_Unsigned dispatched = lua_dispatchcount(L);
+  uint64_t start = LE_NowNs();
+  if (c->loop != NULL) {
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, n);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+      fprintf(_report, "%s: %s\n", c->name, lua_tostring(L, -1));
+      lua_pop(L, 1);
+      ok = false;
+    }
+  }
+  else
+    ok = c->run(this, c, n);
+  *elapsed_ns = LE_NowNs() - start;
+  // Cases creating new VMs leave no count to compare with
+  _dispatched = (LW.LW_GetState() == L) ? lua_dispatchcount(L) - dispatched : 0;
+
+  return ok;
+}
+
+/**
+ * @brief Measure a case: find an iteration count lasting target_ms, then keep the fastest of repeat runs,
+ * and the shortest of their longest iterations, as the others were preempted
+ *
+ * @param c Case to measure
+ * @param r Result of the case
+ * @return true Case measured
+ * @return false The case failed
+ */
+bool LE_Bench::LE_Measure(LE_BenchCase *c, LE_BenchResult *r) {
+  if (!LE_Prepare(c))
+    return false;
+  LE_Responding = c->respond;
+
+  uint64_t target_ns = (uint64_t) target_ms * 1000000;
+  uint64_t elapsed = 0;
+  uint32_t n = 1;
+  bool ok = true;
+
+  // Calibrate the iteration count
+  while ((ok = LE_Iterate(c, n, &elapsed))) {
+    if (elapsed >= target_ns || n >= 0x40000000)
+      break;
+    uint64_t next = (elapsed > 0) ? target_ns * n / elapsed + 1 : (uint64_t) n * 100;
+    if (next > (uint64_t) n * 100)
+      next = (uint64_t) n * 100;
+    if (next <= n)
+      next = (uint64_t) n * 2;
+    n = (next > 0x40000000) ? 0x40000000 : (uint32_t) next;
+  }
+
+  snprintf(r->name, sizeof(r->name), "%s", c->name);
+  r->iterations = n;
+  r->ns_per_op = -1;
+  r->max_ns = 0;
+  r->dispatch_per_op = 0;
+  for (int i = 0; ok && i < repeat; i++) {
+    if (!(ok = LE_Iterate(c, n, &elapsed)))
+      break;
+    if (_max_ns > 0 && (r->max_ns == 0 || _max_ns < r->max_ns))
+      r->max_ns = (double) _max_ns;
+    const LW_AllocStats &st = LW.LW_GetAllocStats();
+    double ns = (double) elapsed / n;
+    if (r->ns_per_op < 0 || ns < r->ns_per_op) {
+      r->ns_per_op = ns;
+      r->allocs_per_op = (double) (st.allocs + st.reallocs) / n;
+      r->bytes_per_op = (double) st.allocated / n;
+      r->peak_heap = st.peak;
+      r->dispatch_per_op = (double) _dispatched / n;
+    }
+  }
+
+  LE_Responding = false;
+  return ok;
+}
+
+/**
+ * @brief Print the result of a case, with the change against the baseline results when given
+ *
+ * @param r Result to print
+ * @param baseline Content of a results file, or NULL
+ */
+void LE_Bench::LE_PrintResult(const LE_BenchResult *r, const char *baseline) {
+  fprintf(_report, "%-26s %10u %12.1f %10.2f %10.1f %10.1f", r->name, (unsigned) r->iterations, r->ns_per_op,
+          r->allocs_per_op, r->bytes_per_op, r->peak_heap / 1024.0);
+  if (r->max_ns > 0)
+    fprintf(_report, " %10.0f", r->max_ns);
+  else
+    fprintf(_report, " %10s", "-");
+  if (r->dispatch_per_op > 0)
+    fprintf(_report, " %10.1f", r->dispatch_per_op);
+  else
+    fprintf(_report, " %10s", "-");
+
+  char key[64];
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", r->name);
+  const char *entry = (baseline != NULL) ? strstr(baseline, key) : NULL;
+  const char *field = (entry != NULL) ? strstr(entry, "\"ns_per_op\": ") : NULL;
+  const char *eol = (entry != NULL) ? strchr(entry, '\n') : NULL;
+  if (field != NULL && (eol == NULL || field < eol)) {
+    double base = atof(field + strlen("\"ns_per_op\": "));
+    if (base > 0)
+      fprintf(_report, " %12.1f %+7.1f%%", base, (r->ns_per_op - base) * 100 / base);
+  }
+  fprintf(_report, "\n");
+}
+
+/**
+ * @brief Measure the cases and print their results
+ *
+ * @param filter Run only the cases whose name contains this string, or NULL for all
+ * @param baseline Results file to compare with, or NULL
+ * @return int Number of failed cases
+ */
+int LE_Bench::LE_Run(const char *filter, const char *baseline) {
+  char *base = NULL;
+  if (baseline != NULL) {
+    FILE *f = fopen(baseline, "rb");
+    if (f != NULL) {
+      fseek(f, 0, SEEK_END);
+      long size = ftell(f);
+      fseek(f, 0, SEEK_SET);
+      base = (char *) calloc(size + 1, 1);
+      if (base != NULL && fread(base, 1, size, f) != (size_t) size) {
+        free(base);
+        base = NULL;
+      }
+      fclose(f);
+    }
+    if (base == NULL)
+      fprintf(stderr, "cannot read baseline %s\n", baseline);
+  }
+
+  // Keep the report on the console and discard the output of the scripts and bindings
+  fflush(stdout);
+  int fd = dup(fileno(stdout));
+  FILE *report = (fd >= 0) ? fdopen(fd, "w") : NULL;
+  if (report != NULL && freopen("/dev/null", "w", stdout) != NULL)
+    _report = report;
+
+  if (!LE.Lua_BuffInit(LE_BENCH_SHARED_BUFF))
+    return _ncases;
+  LE_BenchTask = xTaskGetCurrentTaskHandle();
+  xTaskCreate(&LE_Responder, "bench_responder", LUA_STACK_SIZE, NULL, LUA_TASK_PRIORITY, &_responder);
+
+  fprintf(_report, "%-26s %10s %12s %10s %10s %10s %10s %10s", "case", "iters", "ns/op", "allocs/op", "B/op",
+          "peak KB", "max ns", "disp/op");
+  if (base != NULL)
+    fprintf(_report, " %12s %8s", "base ns/op", "change");
+  fprintf(_report, "\n");
+
+  int failed = 0;
+  _nresults = 0;
+  for (int i = 0; i < _ncases; i++) {
+    LE_BenchCase *c = &_cases[i];
+    if (filter != NULL && strstr(c->name, filter) == NULL)
+      continue;
+    LE_BenchResult *r = &_results[_nresults];
+    if (!LE_Measure(c, r)) {
+      fprintf(_report, "%-26s failed\n", c->name);
+      failed++;
+      continue;
+    }
+    LE_PrintResult(r, base);
+    fflush(_report);
+    _nresults++;
+  }
+
+  LW.LW_CloseLVM();
+  free(base);
+  return failed;
+}
+
+/**
+ * @brief Write the results as JSON, one case per line
+ *
+ * @param filename Results file
+ * @return true Results written
+ * @return false File could not be written
+ */
+bool LE_Bench::LE_WriteJson(const char *filename) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL)
+    return false;
+
+  fprintf(f, "{\n  \"version\": %d,\n  \"target_ms\": %u,\n  \"repeat\": %d,\n  \"results\": [\n",
+          LE_BENCH_JSON_VERSION, (unsigned) target_ms, repeat);
+  for (int i = 0; i < _nresults; i++) {
+    const LE_BenchResult *r = &_results[i];
+    fprintf(f, "    {\"name\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f, "
+            "\"bytes_per_op\": %.1f, \"peak_heap\": %u, \"max_ns\": %.0f, \"dispatch_per_op\": %.2f}%s\n", r->name,
+            (unsigned) r->iterations, r->ns_per_op, r->allocs_per_op, r->bytes_per_op, (unsigned) r->peak_heap, r->max_ns,
+            r->dispatch_per_op, (i + 1 < _nresults) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+
+  return fclose(f) == 0;
+}
+
+static void LE_BenchUsage(const char *progname) {
+  fprintf(stderr,
+  "usage: %s [options]\n"
+  "Available options are:\n"
+  "  -f text   run only the cases whose name contains 'text'\n"
+  "  -t ms     time spent measuring one case (default %d)\n"
+  "  -r count  measurements per case, the fastest is reported (default %d)\n"
+  "  -o file   write the results as JSON to 'file'\n"
+  "  -c file   compare with the results of an earlier run\n",
+  progname, LE_BENCH_TARGET_MS, LE_BENCH_REPEAT);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  const char *filter = NULL;
+  const char *output = NULL;
+  const char *baseline = NULL;
+  uint32_t target_ms = LE_BENCH_TARGET_MS;
+  int repeat = LE_BENCH_REPEAT;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+      filter = argv[++i];
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      target_ms = (uint32_t) atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      repeat = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      baseline = argv[++i];
+    else
+      LE_BenchUsage(argv[0]);
+  }
+  if (target_ms == 0 || repeat <= 0)
+    LE_BenchUsage(argv[0]);
+
+  Serial.begin(115200);
+  if (!SPIFFS.begin(true)) {
+    fprintf(stderr, "cannot mount the script filesystem\n");
+    return EXIT_FAILURE;
+  }
+
+  static LE_Bench bench;
+  bench.target_ms = target_ms;
+  bench.repeat = repeat;
+  int failed = bench.LE_Run(filter, baseline);
+
+  if (output != NULL && !bench.LE_WriteJson(output)) {
+    fprintf(stderr, "cannot write %s\n", output);
+    return EXIT_FAILURE;
+  }
+
+  // Leave without returning, as the responder task never ends
+  fflush(NULL);
+  _exit(failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef LE_BENCH_H
+#define LE_BENCH_H
+
+// Microbenchmarks of the Lua interpreter and the LuaEngine host bindings,
+// built as the program of the bench environment (-DLE_BENCH)
+#ifdef LE_BENCH
+
+#include "LuaEngine.h"
+
+// Default time spent measuring one case, in milliseconds
+#ifndef LE_BENCH_TARGET_MS
+#define LE_BENCH_TARGET_MS 200
+#endif
+
+// Default number of measurements of a case, the fastest one is reported
+#ifndef LE_BENCH_REPEAT
+#define LE_BENCH_REPEAT 3
+#endif
+
+// VM instructions after which a data/ script run is stopped, for scripts that loop forever
+#ifndef LE_BENCH_SCRIPT_BUDGET
+#define LE_BENCH_SCRIPT_BUDGET 100000
+#endif
+
+// Simulated time of a data/ script run on the simulated clock, in milliseconds
+#ifndef LE_BENCH_SIM_MS
+#define LE_BENCH_SIM_MS 3600000
+#endif
+
+// VM instructions after which a data/ script run on the simulated clock is stopped, for scripts that never delay
+#ifndef LE_BENCH_SIM_BUDGET
+#define LE_BENCH_SIM_BUDGET 100000000
+#endif
+
+#define LE_BENCH_MAX_CASES 64 // Maximum number of cases, data/ scripts included
+#define LE_BENCH_SHARED_BUFF 8 // Elements of the shared Lua buffer used by the buffer cases
+#define LE_BENCH_GROW_KEYS 4096 // Keys of the table_grow table, replaced by a new one once full
+#define LE_BENCH_JSON_VERSION 3 // Version of the results file format
+
+class LE_Bench;
+
+/**
+ * @brief Benchmark case: a Lua chunk looping over the iteration count, or a native function
+ *
+ */
+struct LE_BenchCase {
+  char name[48]; // Case name, unique in the results
+  const char *setup; // Lua chunk run once before the measurements, or NULL
+  const char *loop; // Lua chunk run with the iteration count as argument, or NULL for a native case
+  bool (*run)(LE_Bench *b, LE_BenchCase *c, uint32_t n); // Native case running n iterations
+  bool respond; // Buff_*_Wait notifications are answered during the case
+  char path[48]; // Script file of the data/ script cases
+};
+
+/**
+ * @brief Measurement of a case
+ *
+ */
+struct LE_BenchResult {
+  char name[48]; // Case name
+  uint32_t iterations; // Iterations per measurement
+  double ns_per_op; // Wall time per iteration
+  double allocs_per_op; // Lua heap blocks allocated or resized per iteration
+  double bytes_per_op; // Lua heap bytes allocated per iteration
+  size_t peak_heap; // Highest Lua heap usage during the measurement
+  double max_ns; // Longest iteration, for the cases timing each one, else 0
+  double dispatch_per_op; // VM instructions dispatched per iteration, with LUA_USE_DISPATCHCOUNT, else 0
+};
+
+/**
+ * @brief Run the benchmark cases and report their results
+ *
+ */
+class LE_Bench {
+  private:
+
+  LE_BenchCase _cases[LE_BENCH_MAX_CASES];
+  LE_BenchResult _results[LE_BENCH_MAX_CASES];
+  int _ncases;
+  int _nresults;
+  FILE *_report; // Console receiving the report, stdout before it was silenced
+  TaskHandle_t _responder; // Task answering the Buff_*_Wait notifications
+  uint64_t _max_ns; // Longest iteration of the current run, for the cases timing each one
+  lua_Unsigned _dispatched; // VM instructions dispatched by the current run
+
+  static void LE_Responder(void *pvParameters);
+  static void LE_CountHook(lua_State *L, lua_Debug *ar);
+  static int LE_NoDelay(lua_State *L);
+  static bool LE_RunReset(LE_Bench *b, LE_BenchCase *c, uint32_t n);
+  static bool LE_RunTableGrow(LE_Bench *b, LE_BenchCase *c, uint32_t n);
+  static bool LE_RunLoad(LE_Bench *b, LE_BenchCase *c, uint32_t n);
+  static bool LE_RunScript(LE_Bench *b, LE_BenchCase *c, uint32_t n);
+  static bool LE_RunSimulated(LE_Bench *b, LE_BenchCase *c, uint32_t n);
+
+  void LE_AddCase(const char *name, const char *setup, const char *loop, bool respond = false);
+  void LE_AddNative(const char *name, bool (*run)(LE_Bench *, LE_BenchCase *, uint32_t), const char *path);
+  void LE_AddScripts();
+  bool LE_Prepare(LE_BenchCase *c);
+  bool LE_Iterate(LE_BenchCase *c, uint32_t n, uint64_t *elapsed_ns);
+  bool LE_Measure(LE_BenchCase *c, LE_BenchResult *r);
+  void LE_PrintResult(const LE_BenchResult *r, const char *baseline);
+
+  public:
+
+  LuaEngine LE; // Engine providing the host bindings and the shared buffer
+  LuaWrapper LW; // Wrapper running the measured VM
+  uint32_t target_ms; // Time spent measuring one case
+  int repeat; // Measurements per case
+
+  LE_Bench();
+
+  int LE_Run(const char *filter, const char *baseline);
+  bool LE_WriteJson(const char *filename);
+};
+
+#endif
+
+#endif
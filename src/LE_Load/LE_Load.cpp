@@ -0,0 +1,456 @@
+#ifdef LE_LOAD
+
+#include "LE_Load/LE_Load.h"
+#include <algorithm>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LE_LOAD_TS_MASK ((1u << LE_LOAD_TS_BITS) - 1)
+
+// Built-in script: read every producer slot, then wait for the next period
+static const char LE_LoadScript[] =
+  "local n, period = ...\n"
+  "while true do\n"
+  "  for id = 1, n do Buff_Read(id) end\n"
+  "  delay(period)\n"
+  "end\n";
+
+static LE_Load *LE_LoadRun; // Harness of the running script, for the stop hook
+
+/**
+ * @brief Monotonic time in nanoseconds
+ *
+ * @return uint64_t Current time
+ */
+static uint64_t LE_NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Sleep until a monotonic time
+ *
+ * @param deadline_ns Wakeup time in nanoseconds
+ */
+static void LE_SleepUntil(uint64_t deadline_ns) {
+  struct timespec ts;
+  ts.tv_sec = deadline_ns / 1000000000;
+  ts.tv_nsec = deadline_ns % 1000000000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    ;
+}
+
+/**
+ * @brief CPU time used by a task
+ *
+ * @param task Task to check
+ * @return uint64_t CPU time in nanoseconds, 0 when unavailable
+ */
+static uint64_t LE_CpuNs(TaskHandle_t task) {
+  clockid_t cid;
+  struct timespec ts;
+  if (pthread_getcpuclockid(task->thread, &cid) != 0 || clock_gettime(cid, &ts) != 0)
+    return 0;
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Construct the harness with its default load
+ *
+ */
+LE_Load::LE_Load() {
+  _nresults = 0;
+  _lua_task = NULL;
+  _running = false;
+  _run_id = 0;
+  _stop = false;
+  _script_done = false;
+  _rate = 0;
+  nproducers = 4;
+  pattern = LE_LOAD_PERIODIC;
+  burst = 8;
+  duration_ms = 5000;
+  period_ms = 10;
+  script = NULL;
+}
+
+/**
+ * @brief Producer task: write increasing sequence numbers to the buffer slot at the rate of the run
+ *
+ * @param pvParameters Producer
+ */
+void LE_Load::LE_ProducerTask(void *pvParameters) {
+  LE_Producer *p = (LE_Producer *) pvParameters;
+  LE_Load *load = p->load;
+  unsigned int seed = (unsigned int) p->id * 2654435761u;
+  uint32_t run_id = 0;
+  uint64_t next = 0;
+  uint32_t seq = 0;
+
+  while (1) {
+    if (!load->_running) {
+      delay(1);
+      continue;
+    }
+    if (run_id != load->_run_id) { // New run: restart the schedule and the sequence
+      run_id = load->_run_id;
+      next = LE_NowNs();
+      seq = 0;
+    }
+
+    double interval_ns = 1e9 / load->_rate;
+    int count = 1;
+    if (load->pattern == LE_LOAD_POISSON) {
+      double u = (rand_r(&seed) + 1.0) / ((double) RAND_MAX + 2.0);
+      next += (uint64_t) (-log(u) * interval_ns);
+    }
+    else if (load->pattern == LE_LOAD_BURST) {
+      count = load->burst;
+      next += (uint64_t) (interval_ns * count);
+    }
+    else
+      next += (uint64_t) interval_ns;
+
+    LE_SleepUntil(next);
+    for (int i = 0; i < count && load->_running && run_id == load->_run_id; i++) {
+      seq++;
+      p->write_ns[seq & LE_LOAD_TS_MASK] = LE_NowNs();
+      LuaEngine::LuaBuffVar[p->id - 1] = (float) seq;
+      p->written = seq;
+    }
+  }
+}
+
+/**
+ * @brief Record a value read by the script from a producer slot
+ *
+ * @param id Buffer slot read
+ * @param value Value read
+ * @param now Time of the read
+ */
+void LE_Load::LE_Observe(int id, lua_Number value, uint64_t now) {
+  if (id < 1 || id > nproducers || value <= 0)
+    return;
+  LE_Producer *p = &_producers[id - 1];
+  uint32_t seq = (uint32_t) value;
+  if (seq <= p->last) // Already seen
+    return;
+
+  p->seen++;
+  p->last = seq;
+  if (_samples.size() < LE_LOAD_MAX_SAMPLES)
+    _samples.push_back((uint32_t) std::min<uint64_t>(now - p->write_ns[seq & LE_LOAD_TS_MASK], UINT32_MAX));
+}
+
+/**
+ * @brief Buff_Read wrapper recording the end-to-end latency of the values read
+ *
+ * @param L Lua state
+ * @return int Number of results for Lua interpreter
+ */
+int LE_Load::LE_ReadHook(lua_State *L) {
+  LE_Load *load = (LE_Load *) lua_touserdata(L, lua_upvalueindex(2));
+  int nargs = lua_gettop(L);
+  int id = (int) luaL_optinteger(L, 1, 0);
+
+  lua_pushvalue(L, lua_upvalueindex(1)); // Original binding
+  lua_insert(L, 1);
+  lua_call(L, nargs, LUA_MULTRET);
+  if (lua_gettop(L) >= 1 && lua_isnumber(L, 1))
+    load->LE_Observe(id, lua_tonumber(L, 1), LE_NowNs());
+  return lua_gettop(L);
+}
+
+/**
+ * @brief delay() wrapper stopping the script when the run ended during the delay
+ *
+ * @param L Lua state
+ * @return int Number of results for Lua interpreter
+ */
+int LE_Load::LE_DelayHook(lua_State *L) {
+  lua_pushvalue(L, lua_upvalueindex(1)); // Original binding
+  lua_insert(L, 1);
+  lua_call(L, lua_gettop(L) - 1, 0);
+  if (LE_LoadRun->_stop)
+    return luaL_error(L, LE_LOAD_STOP_MSG);
+  return 0;
+}
+
+/**
+ * @brief Stop a script that does not delay once the run has ended
+ *
+ * @param L Lua state
+ * @param ar Hook event
+ */
+void LE_Load::LE_StopHook(lua_State *L, lua_Debug *ar) {
+  (void) ar;
+  if (LE_LoadRun->_stop)
+    luaL_error(L, LE_LOAD_STOP_MSG);
+}
+
+/**
+ * @brief Lua task: run the script on a fresh VM at every run, until the run stops it
+ *
+ * @param pvParameters Harness
+ */
+void LE_Load::LE_LuaTask(void *pvParameters) {
+  LE_Load *load = (LE_Load *) pvParameters;
+  LuaWrapper LW;
+
+  while (1) {
+    xTaskNotifyWait(0, 0, NULL, portMAX_DELAY); // Start of a run
+
+    LW.LW_ResetLVM();
+    load->LE.Lua_TaskMapFunc(LW);
+    lua_State *L = LW.LW_GetState();
+
+    // Wrap Buff_Read to time the values the script reads, and delay to stop the script at the end of the run
+    lua_getglobal(L, Lua_BuffRead_FuncName);
+    lua_pushlightuserdata(L, load);
+    lua_pushcclosure(L, LE_ReadHook, 2);
+    lua_setglobal(L, Lua_BuffRead_FuncName);
+    lua_getglobal(L, Lua_Delay_FuncName);
+    lua_pushcclosure(L, LE_DelayHook, 1);
+    lua_setglobal(L, Lua_Delay_FuncName);
+    lua_sethook(L, LE_StopHook, LUA_MASKCOUNT, 1000);
+
+    int status;
+    int nargs = 0;
+    if (load->script != NULL) {
+      if (strcmp(load->script, LF_Filename) != 0 && SPIFFS.exists(LF_Filename)) {
+        #if LUA_LINK_FUNC_SCRIPT
+        LW.LW_LinkFile(LF_Filename);
+        #else
+        LW.LW_ExecuteFile(LF_Filename);
+        #endif
+      }
+      status = LW.LW_LoadFile(load->script);
+    }
+    else {
+      status = luaL_loadstring(L, LE_LoadScript);
+      lua_pushinteger(L, load->nproducers);
+      lua_pushinteger(L, load->period_ms);
+      nargs = 2;
+    }
+    if (status == LUA_OK)
+      status = lua_pcall(L, nargs, 0, 0);
+    if (status != LUA_OK && !load->_stop)
+      fprintf(stderr, "# lua error: %s\n", lua_tostring(L, -1));
+
+    LW.LW_CloseLVM();
+    load->_script_done = true;
+  }
+}
+
+/**
+ * @brief Run the producers at one rate for duration_ms while the script runs
+ *
+ * @param rate Updates per second per producer
+ * @param r Results of the run
+ * @return true Run completed
+ * @return false The script ended before the end of the run
+ */
+bool LE_Load::LE_Step(double rate, LE_LoadResult *r) {
+  for (int i = 0; i < nproducers; i++) {
+    _producers[i].written = 0;
+    _producers[i].seen = 0;
+    _producers[i].last = 0;
+    LuaEngine::LuaBuffVar[i] = -1;
+  }
+  _samples.clear();
+  _rate = rate;
+  _stop = false;
+  _script_done = false;
+  _run_id++;
+
+  LE_LoadRun = this;
+  uint64_t cpu_start = LE_CpuNs(_lua_task);
+  uint64_t start = LE_NowNs();
+  xTaskNotify(_lua_task, 0, eSetValueWithOverwrite);
+  _running = true;
+
+  LE_SleepUntil(start + (uint64_t) duration_ms * 1000000);
+  bool early = _script_done;
+  _running = false;
+  _stop = true;
+  while (!_script_done)
+    delay(1);
+  uint64_t wall = LE_NowNs() - start;
+  uint64_t cpu = LE_CpuNs(_lua_task) - cpu_start;
+
+  memset(r, 0, sizeof(*r));
+  r->rate = rate;
+  for (int i = 0; i < nproducers; i++) {
+    r->written += _producers[i].written;
+    r->seen += _producers[i].seen;
+    r->lost += _producers[i].last - _producers[i].seen; // Sequence numbers skipped by the reads
+  }
+  r->lua_cpu = (wall > 0) ? (double) cpu / wall : 0;
+
+  if (!_samples.empty()) {
+    std::sort(_samples.begin(), _samples.end());
+    size_t n = _samples.size();
+    r->p50_us = _samples[n * 50 / 100] / 1000.0;
+    r->p90_us = _samples[n * 90 / 100] / 1000.0;
+    r->p99_us = _samples[n * 99 / 100] / 1000.0;
+    r->p999_us = _samples[n * 999 / 1000] / 1000.0;
+    r->max_us = _samples[n - 1] / 1000.0;
+  }
+  return !early;
+}
+
+/**
+ * @brief Create the producer and Lua tasks, then run the load at each rate and print the results
+ *
+ * @param rates Updates per second per producer of each run
+ * @param nrates Number of runs
+ * @return true All runs completed
+ * @return false The tasks could not be created or the script ended early
+ */
+bool LE_Load::LE_Run(const double *rates, int nrates) {
+  if (!LE.Lua_BuffInit(nproducers))
+    return false;
+
+  if (xTaskCreate(&LE_LuaTask, "lua_task", LUA_STACK_SIZE, this, LUA_TASK_PRIORITY, &_lua_task) != pdPASS)
+    return false;
+  for (int i = 0; i < nproducers; i++) {
+    LE_Producer *p = &_producers[i];
+    p->load = this;
+    p->id = i + 1;
+    p->write_ns = (uint64_t *) calloc(LE_LOAD_TS_MASK + 1, sizeof(uint64_t));
+    if (p->write_ns == NULL ||
+        xTaskCreate(&LE_ProducerTask, "producer", LUA_STACK_SIZE, p, LUA_TASK_PRIORITY, &p->task) != pdPASS)
+      return false;
+  }
+
+  printf("%d producers, %s pattern, %u ms per rate, %s\n", nproducers,
+         pattern == LE_LOAD_POISSON ? "poisson" : pattern == LE_LOAD_BURST ? "burst" : "periodic",
+         (unsigned) duration_ms, script != NULL ? script : "built-in reader script");
+  printf("%10s %10s %10s %10s %7s %9s %9s %9s %9s %9s %7s\n", "rate/s", "written", "seen", "lost", "lost%",
+         "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "lua cpu");
+
+  bool ok = true;
+  _nresults = 0;
+  for (int i = 0; i < nrates && _nresults < LE_LOAD_MAX_RATES; i++) {
+    LE_LoadResult *r = &_results[_nresults++];
+    if (!LE_Step(rates[i], r)) {
+      fprintf(stderr, "script ended before the end of the run\n");
+      ok = false;
+    }
+    double seen_or_lost = (double) r->seen + r->lost;
+    printf("%10.0f %10u %10u %10u %6.2f%% %9.1f %9.1f %9.1f %9.1f %9.1f %6.1f%%\n", r->rate, (unsigned) r->written,
+           (unsigned) r->seen, (unsigned) r->lost, seen_or_lost > 0 ? r->lost * 100 / seen_or_lost : 0.0,
+           r->p50_us, r->p90_us, r->p99_us, r->p999_us, r->max_us, r->lua_cpu * 100);
+    fflush(stdout);
+  }
+  return ok;
+}
+
+/**
+ * @brief Write the results as JSON, one rate per line
+ *
+ * @param filename Results file
+ * @return true Results written
+ * @return false File could not be written
+ */
+bool LE_Load::LE_WriteJson(const char *filename) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL)
+    return false;
+
+  fprintf(f, "{\n  \"producers\": %d,\n  \"pattern\": \"%s\",\n  \"duration_ms\": %u,\n  \"results\": [\n", nproducers,
+          pattern == LE_LOAD_POISSON ? "poisson" : pattern == LE_LOAD_BURST ? "burst" : "periodic",
+          (unsigned) duration_ms);
+  for (int i = 0; i < _nresults; i++) {
+    const LE_LoadResult *r = &_results[i];
+    fprintf(f, "    {\"rate\": %.1f, \"written\": %u, \"seen\": %u, \"lost\": %u, \"p50_us\": %.1f, \"p90_us\": %.1f, "
+            "\"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f, \"lua_cpu\": %.4f}%s\n", r->rate,
+            (unsigned) r->written, (unsigned) r->seen, (unsigned) r->lost, r->p50_us, r->p90_us, r->p99_us,
+            r->p999_us, r->max_us, r->lua_cpu, (i + 1 < _nresults) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+
+  return fclose(f) == 0;
+}
+
+static void LE_LoadUsage(const char *progname) {
+  fprintf(stderr,
+  "usage: %s [options]\n"
+  "Available options are:\n"
+  "  -p count  producer tasks, one buffer slot each (default 4, at most %d)\n"
+  "  -r rates  comma separated updates per second per producer (default 100)\n"
+  "  -m name   arrival pattern: periodic, poisson or burst (default periodic)\n"
+  "  -b count  updates per burst of the burst pattern (default 8)\n"
+  "  -d ms     length of the run at each rate (default 5000)\n"
+  "  -i ms     loop period of the built-in reader script (default 10)\n"
+  "  -s file   run this script of the filesystem instead of the built-in one\n"
+  "  -o file   write the results as JSON to 'file'\n",
+  progname, LE_LOAD_MAX_PRODUCERS);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  static LE_Load load;
+  double rates[LE_LOAD_MAX_RATES] = { 100 };
+  int nrates = 1;
+  const char *output = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+      load.nproducers = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      nrates = 0;
+      for (char *tok = strtok(argv[++i], ","); tok != NULL && nrates < LE_LOAD_MAX_RATES; tok = strtok(NULL, ","))
+        rates[nrates++] = atof(tok);
+    }
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      const char *name = argv[++i];
+      if (strcmp(name, "periodic") == 0)
+        load.pattern = LE_LOAD_PERIODIC;
+      else if (strcmp(name, "poisson") == 0)
+        load.pattern = LE_LOAD_POISSON;
+      else if (strcmp(name, "burst") == 0)
+        load.pattern = LE_LOAD_BURST;
+      else
+        LE_LoadUsage(argv[0]);
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+      load.burst = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+      load.duration_ms = (uint32_t) atoi(argv[++i]);
+    else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+      load.period_ms = (uint32_t) atoi(argv[++i]);
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+      load.script = argv[++i];
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else
+      LE_LoadUsage(argv[0]);
+  }
+  if (load.nproducers < 1 || load.nproducers > LE_LOAD_MAX_PRODUCERS || load.burst < 1 || load.duration_ms == 0 ||
+      nrates == 0)
+    LE_LoadUsage(argv[0]);
+  for (int i = 0; i < nrates; i++)
+    if (rates[i] <= 0)
+      LE_LoadUsage(argv[0]);
+
+  Serial.begin(115200);
+  if (!SPIFFS.begin(true)) {
+    fprintf(stderr, "cannot mount the script filesystem\n");
+    return EXIT_FAILURE;
+  }
+
+  bool ok = load.LE_Run(rates, nrates);
+  if (output != NULL && !load.LE_WriteJson(output)) {
+    fprintf(stderr, "cannot write %s\n", output);
+    ok = false;
+  }
+
+  // Leave without returning, as the producer and Lua tasks never end
+  fflush(NULL);
+  _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef LE_LOAD_H
+#define LE_LOAD_H
+
+// Synthetic load on the shared Lua buffer: producer tasks write updates at
+// configured rates while a script reads them, built as the program of the
+// load environment (-DLE_LOAD) on the host port
+#ifdef LE_LOAD
+
+#include "LuaEngine.h"
+#include <vector>
+
+#define LE_LOAD_MAX_PRODUCERS 32 // Maximum number of producer tasks, one buffer slot each
+#define LE_LOAD_MAX_RATES 16 // Maximum number of rates in a sweep
+#define LE_LOAD_TS_BITS 16 // Write times kept per producer, as a power of 2
+#define LE_LOAD_MAX_SAMPLES 2000000 // Latency samples kept per run
+#define LE_LOAD_STOP_MSG "load run ended" // Error stopping the script at the end of a run
+
+/**
+ * @brief Arrival pattern of the updates of a producer
+ *
+ */
+enum LE_LoadPattern {
+  LE_LOAD_PERIODIC, // Evenly spaced updates
+  LE_LOAD_POISSON, // Exponentially distributed intervals with the same mean rate
+  LE_LOAD_BURST // Bursts of back-to-back updates, at the same mean rate
+};
+
+/**
+ * @brief Producer task writing sequence numbers to its buffer slot
+ *
+ */
+struct LE_Producer {
+  class LE_Load *load; // Harness running the producer
+  int id; // Buffer slot written, from 1
+  TaskHandle_t task; // Producer task
+  uint64_t *write_ns; // Write time of each sequence number, indexed modulo the table size
+  std::atomic<uint32_t> written; // Updates written in the current run
+  uint32_t seen; // Updates read by the script in the current run
+  uint32_t last; // Last sequence number read by the script
+};
+
+/**
+ * @brief Results of a run at one rate
+ *
+ */
+struct LE_LoadResult {
+  double rate; // Updates per second per producer
+  uint32_t written; // Updates written by all producers
+  uint32_t seen; // Updates read by the script
+  uint32_t lost; // Updates overwritten before the script read them
+  double p50_us, p90_us, p99_us, p999_us, max_us; // End-to-end latency percentiles
+  double lua_cpu; // Lua task CPU time over wall time
+};
+
+/**
+ * @brief Drive the shared Lua buffer with producer tasks and measure how the script keeps up
+ *
+ */
+class LE_Load {
+  private:
+
+  LE_Producer _producers[LE_LOAD_MAX_PRODUCERS];
+  LE_LoadResult _results[LE_LOAD_MAX_RATES];
+  int _nresults;
+  std::vector<uint32_t> _samples; // Latencies of the current run, in ns
+  TaskHandle_t _lua_task; // Task running the script
+  std::atomic<bool> _running; // Producers write and the script runs
+  std::atomic<uint32_t> _run_id; // Number of the current run, restarting the producer schedules
+  std::atomic<bool> _stop; // The script is stopped at its next hook
+  std::atomic<bool> _script_done; // The script returned or failed
+  double _rate; // Rate of the current run, set before the run starts
+
+  static void LE_ProducerTask(void *pvParameters);
+  static void LE_LuaTask(void *pvParameters);
+  static void LE_StopHook(lua_State *L, lua_Debug *ar);
+  static int LE_ReadHook(lua_State *L);
+  static int LE_DelayHook(lua_State *L);
+  void LE_Observe(int id, lua_Number value, uint64_t now);
+  bool LE_Step(double rate, LE_LoadResult *r);
+
+  public:
+
+  LuaEngine LE; // Engine providing the host bindings and the shared buffer
+  int nproducers; // Number of producers
+  LE_LoadPattern pattern; // Arrival pattern of the updates
+  int burst; // Updates per burst of the burst pattern
+  uint32_t duration_ms; // Length of the run at each rate
+  uint32_t period_ms; // Loop period of the built-in script
+  const char *script; // Script file run instead of the built-in script, or NULL
+
+  LE_Load();
+
+  bool LE_Run(const double *rates, int nrates);
+  bool LE_WriteJson(const char *filename);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,702 @@
+#ifndef ARDUINO
+
+#include "LE_Port/LE_Native.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+LE_NativeSerial Serial;
+LE_NativeEsp ESP;
+SPIFFSFS SPIFFS;
+
+static thread_local LE_Task *LE_CurrentTask = NULL; // Task of the calling thread
+
+/**
+ * @brief Monotonic time in microseconds
+ *
+ * @return uint64_t Current time
+ */
+static uint64_t LE_Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static const uint64_t LE_StartTime = LE_Now(); // Time of the program start
+
+/**
+ * @brief Time since the program start in microseconds
+ *
+ * @return uint64_t Elapsed time
+ */
+static uint64_t LE_Uptime() {
+  return LE_Now() - LE_StartTime;
+}
+
+/**
+ * @brief Get milliseconds since start
+ *
+ * @return unsigned long Elapsed milliseconds
+ */
+unsigned long millis() {
+  return (unsigned long) (LE_Uptime() / 1000);
+}
+
+/**
+ * @brief Get microseconds since start
+ *
+ * @return unsigned long Elapsed microseconds
+ */
+unsigned long micros() {
+  return (unsigned long) LE_Uptime();
+}
+
+/**
+ * @brief Block the calling thread
+ *
+ * @param ms Duration in milliseconds
+ */
+void delay(uint32_t ms) {
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (long) (ms % 1000) * 1000000;
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    ;
+}
+
+/**
+ * @brief Start the serial port; stdout is line buffered so that output shows up as on a serial monitor
+ *
+ * @param baud Baud rate, ignored
+ */
+void LE_NativeSerial::begin(unsigned long baud) {
+  (void) baud;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+int LE_NativeSerial::printf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+size_t LE_NativeSerial::write(uint8_t c) {
+  return (putchar(c) == EOF) ? 0 : 1;
+}
+
+size_t LE_NativeSerial::write(const char *s) {
+  return fwrite(s, 1, strlen(s), stdout);
+}
+
+size_t LE_NativeSerial::write(const uint8_t *buf, size_t size) {
+  return fwrite(buf, 1, size, stdout);
+}
+
+/**
+ * @brief Free heap, as the heap size less the bytes allocated by the process
+ *
+ * @return uint32_t Free heap in bytes, 0 once the process uses more than the ESP32 heap
+ */
+uint32_t LE_NativeEsp::getFreeHeap() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  size_t used = mallinfo2().uordblks;
+#else
+  size_t used = (size_t) mallinfo().uordblks;
+#endif
+  return (used < LE_NATIVE_HEAP_SIZE) ? LE_NATIVE_HEAP_SIZE - used : 0;
+}
+
+/**
+ * @brief Thread entry of a task
+ *
+ * @param arg Task to run
+ * @return void* Unused
+ */
+static void *LE_TaskEntry(void *arg) {
+  LE_Task *task = (LE_Task *) arg;
+  LE_CurrentTask = task;
+  task->func(task->param);
+  return NULL;
+}
+
+/**
+ * @brief Task of the calling thread, adopting threads not created by xTaskCreate
+ *
+ * @return LE_Task* Task of the calling thread
+ */
+static LE_Task *LE_Self() {
+  if (LE_CurrentTask == NULL) {
+    LE_Task *task = (LE_Task *) calloc(1, sizeof(LE_Task));
+    if (task == NULL)
+      abort();
+    task->thread = pthread_self();
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    LE_CurrentTask = task;
+  }
+  return LE_CurrentTask;
+}
+
+/**
+ * @brief Create a task running on its own thread
+ *
+ * @param func Task function
+ * @param name Task name
+ * @param stack_depth Stack size on the ESP32 in bytes, scaled by LE_NATIVE_STACK_SCALE
+ * @param param Task parameter
+ * @param priority Task priority, ignored
+ * @param handle Handle of the created task
+ * @return BaseType_t pdPASS when the task was created
+ */
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+  (void) name;
+  (void) priority;
+
+  LE_Task *task = (LE_Task *) calloc(1, sizeof(LE_Task));
+  if (task == NULL)
+    return pdFAIL;
+
+  size_t stack_size = (size_t) stack_depth * LE_NATIVE_STACK_SCALE;
+  if (stack_size < (size_t) PTHREAD_STACK_MIN)
+    stack_size = (size_t) PTHREAD_STACK_MIN;
+  stack_size = (stack_size + 4095) & ~(size_t) 4095;
+
+  // Paint the stack so that the high water mark can be measured
+  if (posix_memalign((void **) &task->stack, 4096, stack_size) != 0) {
+    free(task);
+    return pdFAIL;
+  }
+  memset(task->stack, LE_STACK_PAINT, stack_size);
+  task->stack_size = stack_size;
+  task->func = func;
+  task->param = param;
+  pthread_mutex_init(&task->lock, NULL);
+  pthread_cond_init(&task->cond, NULL);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, task->stack, stack_size);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int err = pthread_create(&task->thread, &attr, LE_TaskEntry, task);
+  pthread_attr_destroy(&attr);
+
+  if (err != 0) {
+    free(task->stack);
+    free(task);
+    return pdFAIL;
+  }
+  if (handle != NULL)
+    *handle = task;
+
+  return pdPASS;
+}
+
+/**
+ * @brief Delete a task; only the calling task can be deleted, as threads cannot be killed safely
+ *
+ * @param task Task to delete, NULL for the calling task
+ */
+void vTaskDelete(TaskHandle_t task) {
+  if (task == NULL || task == LE_CurrentTask)
+    pthread_exit(NULL);
+}
+
+/**
+ * @brief Block the calling task
+ *
+ * @param ticks Duration in ticks
+ */
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+/**
+ * @brief Give the CPU to the other ready tasks
+ *
+ */
+void taskYIELD() {
+  sched_yield();
+}
+
+/**
+ * @brief Get ticks since start
+ *
+ * @return TickType_t Elapsed ticks
+ */
+TickType_t xTaskGetTickCount() {
+  return (TickType_t) (millis() / portTICK_PERIOD_MS);
+}
+
+/**
+ * @brief Get the handle of the calling task
+ *
+ * @return TaskHandle_t Handle of the calling task
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return LE_Self();
+}
+
+/**
+ * @brief Smallest amount of stack left unused by a task so far
+ *
+ * @param task Task to check, NULL for the calling task
+ * @return UBaseType_t Unused host stack in bytes, 0 for threads not created by xTaskCreate
+ */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  if (task == NULL)
+    task = LE_Self();
+  if (task->stack == NULL)
+    return 0;
+
+  // The stack grows down, count the painted bytes left at its bottom
+  size_t n = 0;
+  while (n < task->stack_size && task->stack[n] == LE_STACK_PAINT)
+    n++;
+
+  return (UBaseType_t) n;
+}
+
+/**
+ * @brief Send a notification to a task
+ *
+ * @param task Task to notify
+ * @param value Notification value
+ * @param action How the value updates the notification value of the task
+ * @return BaseType_t pdFAIL when a pending value was not overwritten, pdPASS otherwise
+ */
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+  BaseType_t ret = pdPASS;
+
+  pthread_mutex_lock(&task->lock);
+  switch (action) {
+    case eSetBits:
+      task->notify_value |= value;
+      break;
+    case eIncrement:
+      task->notify_value++;
+      break;
+    case eSetValueWithOverwrite:
+      task->notify_value = value;
+      break;
+    case eSetValueWithoutOverwrite:
+      if (task->notify_pending)
+        ret = pdFAIL;
+      else
+        task->notify_value = value;
+      break;
+    case eNoAction:
+      break;
+  }
+  task->notify_pending = true;
+  pthread_cond_signal(&task->cond);
+  pthread_mutex_unlock(&task->lock);
+
+  return ret;
+}
+
+/**
+ * @brief Wait for a notification to the calling task
+ *
+ * @param clear_on_entry Bits of the notification value cleared before waiting, if no notification is pending
+ * @param clear_on_exit Bits of the notification value cleared after receiving a notification
+ * @param value Notification value received, may be NULL
+ * @param ticks Timeout in ticks, portMAX_DELAY to wait forever
+ * @return BaseType_t pdTRUE when a notification was received
+ */
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks) {
+  LE_Task *task = LE_Self();
+  BaseType_t ret = pdFALSE;
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  uint64_t ns = (uint64_t) deadline.tv_nsec + (uint64_t) ticks * portTICK_PERIOD_MS * 1000000;
+  deadline.tv_sec += ns / 1000000000;
+  deadline.tv_nsec = ns % 1000000000;
+
+  pthread_mutex_lock(&task->lock);
+  if (!task->notify_pending)
+    task->notify_value &= ~clear_on_entry;
+
+  while (!task->notify_pending && ticks > 0) {
+    int err = (ticks == portMAX_DELAY) ? pthread_cond_wait(&task->cond, &task->lock)
+                                       : pthread_cond_timedwait(&task->cond, &task->lock, &deadline);
+    if (err == ETIMEDOUT)
+      break;
+  }
+
+  if (task->notify_pending) {
+    if (value != NULL)
+      *value = task->notify_value;
+    task->notify_value &= ~clear_on_exit;
+    task->notify_pending = false;
+    ret = pdTRUE;
+  }
+  pthread_mutex_unlock(&task->lock);
+
+  return ret;
+}
+
+/**
+ * @brief Read a value from the namespace file
+ *
+ * @param key Key to read
+ * @param value Buffer receiving the value as text
+ * @param size Size of the buffer
+ * @return true The key exists
+ */
+bool Preferences::LE_GetValue(const char *key, char *value, size_t size) {
+  char line[256];
+  size_t klen = strlen(key);
+  bool found = false;
+
+  if (_path[0] == '\0')
+    return false;
+
+  FILE *f = fopen(_path, "r");
+  if (f == NULL)
+    return false;
+
+  while (!found && fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, key, klen) == 0 && line[klen] == '=') {
+      strncpy(value, line + klen + 1, size - 1);
+      value[size - 1] = '\0';
+      value[strcspn(value, "\n")] = '\0';
+      found = true;
+    }
+  }
+  fclose(f);
+
+  return found;
+}
+
+/**
+ * @brief Write a value to the namespace file, or remove the key
+ *
+ * @param key Key to write
+ * @param value Value as text, NULL to remove the key
+ * @return true The file was updated
+ */
+bool Preferences::LE_PutValue(const char *key, const char *value) {
+  char line[256];
+  char tmp_path[sizeof(_path) + 4];
+  size_t klen = strlen(key);
+
+  if (_path[0] == '\0' || _read_only)
+    return false;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _path);
+  FILE *out = fopen(tmp_path, "w");
+  if (out == NULL)
+    return false;
+
+  // Copy the other keys, then append the new value
+  FILE *in = fopen(_path, "r");
+  if (in != NULL) {
+    while (fgets(line, sizeof(line), in) != NULL) {
+      if (!(strncmp(line, key, klen) == 0 && line[klen] == '='))
+        fputs(line, out);
+    }
+    fclose(in);
+  }
+  if (value != NULL)
+    fprintf(out, "%s=%s\n", key, value);
+
+  if (fclose(out) != 0 || ::rename(tmp_path, _path) != 0)
+    return false;
+
+  return true;
+}
+
+/**
+ * @brief Open a namespace, stored as a file in the NVS directory
+ *
+ * @param name Namespace name
+ * @param read_only Open the namespace read only
+ * @param partition NVS partition label, ignored
+ * @return true The namespace is open
+ */
+bool Preferences::begin(const char *name, bool read_only, const char *partition) {
+  (void) partition;
+
+  const char *dir = getenv("LE_NVS_DIR");
+  if (dir == NULL)
+    dir = LE_NATIVE_NVS_DIR;
+  ::mkdir(dir, 0755);
+
+  snprintf(_path, sizeof(_path), "%s/%s", dir, name);
+  _read_only = read_only;
+
+  return true;
+}
+
+bool Preferences::isKey(const char *key) {
+  char value[64];
+  return LE_GetValue(key, value, sizeof(value));
+}
+
+bool Preferences::remove(const char *key) {
+  return LE_PutValue(key, NULL);
+}
+
+bool Preferences::clear() {
+  if (_path[0] == '\0' || _read_only)
+    return false;
+  ::remove(_path);
+  return true;
+}
+
+size_t Preferences::putInt(const char *key, int32_t value) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%d", value);
+  return LE_PutValue(key, buf) ? sizeof(value) : 0;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u", value);
+  return LE_PutValue(key, buf) ? sizeof(value) : 0;
+}
+
+size_t Preferences::putFloat(const char *key, float value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.9g", value);
+  return LE_PutValue(key, buf) ? sizeof(value) : 0;
+}
+
+int32_t Preferences::getInt(const char *key, int32_t default_value) {
+  char value[64];
+  return LE_GetValue(key, value, sizeof(value)) ? (int32_t) strtol(value, NULL, 10) : default_value;
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t default_value) {
+  char value[64];
+  return LE_GetValue(key, value, sizeof(value)) ? (uint32_t) strtoul(value, NULL, 10) : default_value;
+}
+
+float Preferences::getFloat(const char *key, float default_value) {
+  char value[64];
+  return LE_GetValue(key, value, sizeof(value)) ? strtof(value, NULL) : default_value;
+}
+
+namespace fs {
+
+LE_FileImpl::~LE_FileImpl() {
+  if (file != NULL)
+    fclose(file);
+  if (dir != NULL)
+    closedir(dir);
+}
+
+size_t File::read(uint8_t *buf, size_t size) {
+  return (_impl && _impl->file != NULL) ? fread(buf, 1, size, _impl->file) : 0;
+}
+
+int File::read() {
+  return (_impl && _impl->file != NULL) ? fgetc(_impl->file) : -1;
+}
+
+int File::available() {
+  if (!_impl || _impl->file == NULL)
+    return 0;
+  long left = (long) size() - ftell(_impl->file);
+  return (left > 0) ? (int) left : 0;
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+  return (_impl && _impl->file != NULL) ? fwrite(buf, 1, size, _impl->file) : 0;
+}
+
+void File::flush() {
+  if (_impl && _impl->file != NULL)
+    fflush(_impl->file);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  static const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+  return _impl && _impl->file != NULL && fseek(_impl->file, pos, whence[mode]) == 0;
+}
+
+size_t File::position() const {
+  return (_impl && _impl->file != NULL) ? (size_t) ftell(_impl->file) : 0;
+}
+
+size_t File::size() const {
+  struct stat st;
+  if (!_impl)
+    return 0;
+  if (_impl->file != NULL)
+    fflush(_impl->file); // Count buffered writes
+  return (stat(_impl->host_path, &st) == 0) ? (size_t) st.st_size : 0;
+}
+
+void File::close() {
+  if (!_impl)
+    return;
+  if (_impl->file != NULL)
+    fclose(_impl->file);
+  if (_impl->dir != NULL)
+    closedir(_impl->dir);
+  _impl->file = NULL;
+  _impl->dir = NULL;
+}
+
+const char *File::path() const {
+  return _impl ? _impl->path : NULL;
+}
+
+const char *File::name() const {
+  if (!_impl)
+    return NULL;
+  const char *base = strrchr(_impl->path, '/');
+  return (base != NULL) ? base + 1 : _impl->path;
+}
+
+bool File::isDirectory() const {
+  return _impl && _impl->dir != NULL;
+}
+
+/**
+ * @brief Open the next regular file of a directory
+ *
+ * @param mode Open mode of the file
+ * @return File Next file, or an invalid file at the end of the directory
+ */
+File File::openNextFile(const char *mode) {
+  struct dirent *ent;
+
+  if (!_impl || _impl->dir == NULL)
+    return File();
+
+  while ((ent = readdir(_impl->dir)) != NULL) {
+    if (ent->d_name[0] == '.')
+      continue;
+
+    std::shared_ptr<LE_FileImpl> impl = std::make_shared<LE_FileImpl>();
+    impl->dir = NULL;
+    size_t len = strlen(_impl->path);
+    int n = snprintf(impl->path, sizeof(impl->path), "%s%s%s", _impl->path,
+                     (len > 0 && _impl->path[len - 1] == '/') ? "" : "/", ent->d_name);
+    int host_n = snprintf(impl->host_path, sizeof(impl->host_path), "%s/%s", _impl->host_path, ent->d_name);
+    if (n >= (int) sizeof(impl->path) || host_n >= (int) sizeof(impl->host_path)) // Path too long
+      continue;
+
+    struct stat st;
+    if (stat(impl->host_path, &st) != 0 || !S_ISREG(st.st_mode))
+      continue;
+
+    impl->file = fopen(impl->host_path, (*mode == 'w') ? "wb" : (*mode == 'a') ? "ab" : "rb");
+    if (impl->file != NULL)
+      return File(impl);
+  }
+
+  return File();
+}
+
+/**
+ * @brief Map a filesystem path to a path on the host
+ *
+ * @param path Path on the filesystem
+ * @param host_path Buffer receiving the host path
+ * @param size Size of the buffer
+ */
+void FS::LE_HostPath(const char *path, char *host_path, size_t size) {
+  const char *root = getenv("LE_SPIFFS_DIR");
+  if (root == NULL)
+    root = _root;
+  snprintf(host_path, size, "%s%s%s", root, (*path == '/') ? "" : "/", path);
+}
+
+/**
+ * @brief Open a file or directory
+ *
+ * @param path Path on the filesystem
+ * @param mode FILE_READ, FILE_WRITE or FILE_APPEND
+ * @param create Unused, files opened for writing are always created
+ * @return File Open file, invalid on failure
+ */
+File FS::open(const char *path, const char *mode, bool create) {
+  (void) create;
+
+  std::shared_ptr<LE_FileImpl> impl = std::make_shared<LE_FileImpl>();
+  impl->file = NULL;
+  impl->dir = NULL;
+  strncpy(impl->path, path, sizeof(impl->path) - 1);
+  impl->path[sizeof(impl->path) - 1] = '\0';
+  LE_HostPath(path, impl->host_path, sizeof(impl->host_path));
+
+  struct stat st;
+  if (*mode == 'r' && stat(impl->host_path, &st) == 0 && S_ISDIR(st.st_mode))
+    impl->dir = opendir(impl->host_path);
+  else
+    impl->file = fopen(impl->host_path, (*mode == 'w') ? "wb" : (*mode == 'a') ? "ab" : "rb");
+
+  return File(impl);
+}
+
+bool FS::exists(const char *path) {
+  char host_path[512];
+  struct stat st;
+  LE_HostPath(path, host_path, sizeof(host_path));
+  return stat(host_path, &st) == 0;
+}
+
+bool FS::remove(const char *path) {
+  char host_path[512];
+  LE_HostPath(path, host_path, sizeof(host_path));
+  return ::remove(host_path) == 0;
+}
+
+bool FS::rename(const char *path_from, const char *path_to) {
+  char host_from[512], host_to[512];
+  LE_HostPath(path_from, host_from, sizeof(host_from));
+  LE_HostPath(path_to, host_to, sizeof(host_to));
+  return ::rename(host_from, host_to) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+  char host_path[512];
+  LE_HostPath(path, host_path, sizeof(host_path));
+  return ::mkdir(host_path, 0755) == 0;
+}
+
+bool FS::rmdir(const char *path) {
+  char host_path[512];
+  LE_HostPath(path, host_path, sizeof(host_path));
+  return ::rmdir(host_path) == 0;
+}
+
+} // namespace fs
+
+/**
+ * @brief Mount the SPIFFS directory
+ *
+ * @param format_on_fail Create the directory when it does not exist
+ * @param base_path VFS mount point, ignored
+ * @param max_open_files Maximum number of open files, ignored
+ * @param partition_label SPIFFS partition label, ignored
+ * @return true The directory exists
+ */
+bool SPIFFSFS::begin(bool format_on_fail, const char *base_path, uint8_t max_open_files, const char *partition_label) {
+  (void) base_path;
+  (void) max_open_files;
+  (void) partition_label;
+
+  char host_path[512];
+  struct stat st;
+  LE_HostPath("/", host_path, sizeof(host_path));
+  if (stat(host_path, &st) == 0)
+    return S_ISDIR(st.st_mode);
+
+  return format_on_fail && ::mkdir(host_path, 0755) == 0;
+}
+
+#endif
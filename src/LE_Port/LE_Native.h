@@ -0,0 +1,289 @@
+#ifndef LE_NATIVE_H
+#define LE_NATIVE_H
+
+// Native (Linux) implementation of the Arduino, FreeRTOS, Preferences and
+// SPIFFS APIs used by LuaEngine, so that the engine runs on a development host
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <memory>
+
+// Directory holding the SPIFFS files, overridden by the LE_SPIFFS_DIR environment variable
+#ifndef LE_NATIVE_SPIFFS_DIR
+#define LE_NATIVE_SPIFFS_DIR "data"
+#endif
+
+// Directory holding the Preferences namespaces, overridden by the LE_NVS_DIR environment variable
+#ifndef LE_NATIVE_NVS_DIR
+#define LE_NATIVE_NVS_DIR ".nvs"
+#endif
+
+// Heap size reported by ESP.getFreeHeap (ESP32 internal DRAM)
+#ifndef LE_NATIVE_HEAP_SIZE
+#define LE_NATIVE_HEAP_SIZE (320 * 1024)
+#endif
+
+// Host stack per byte of task stack requested, as host code needs more stack than the ESP32
+#ifndef LE_NATIVE_STACK_SCALE
+#define LE_NATIVE_STACK_SCALE 8
+#endif
+
+#define LE_STACK_PAINT 0xA5 // Fill byte of unused task stack
+
+// Arduino core
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+
+/**
+ * @brief Serial port writing to stdout
+ *
+ */
+class LE_NativeSerial {
+  public:
+
+  void begin(unsigned long baud);
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  size_t write(uint8_t c);
+  size_t write(const char *s);
+  size_t write(const uint8_t *buf, size_t size);
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t) c); }
+  size_t print(int n) { return printf("%d", n); }
+  size_t print(unsigned int n) { return printf("%u", n); }
+  size_t print(long n) { return printf("%ld", n); }
+  size_t print(unsigned long n) { return printf("%lu", n); }
+  size_t print(double n) { return printf("%.2f", n); }
+  template <typename T> size_t println(T v) { return print(v) + println(); }
+  size_t println() { return write("\r\n"); }
+  void flush() { fflush(stdout); }
+};
+
+extern LE_NativeSerial Serial;
+
+/**
+ * @brief ESP32 system information
+ *
+ */
+class LE_NativeEsp {
+  public:
+
+  uint32_t getHeapSize() { return LE_NATIVE_HEAP_SIZE; }
+  uint32_t getFreeHeap();
+};
+
+extern LE_NativeEsp ESP;
+
+// FreeRTOS tasks and notifications, one pthread per task and 1 ms ticks
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t) 0xFFFFFFFF)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+/**
+ * @brief Actions of a task notification
+ *
+ */
+enum eNotifyAction {
+  eNoAction,
+  eSetBits,
+  eIncrement,
+  eSetValueWithOverwrite,
+  eSetValueWithoutOverwrite
+};
+
+/**
+ * @brief Native task: a thread on a painted stack with a notification slot
+ *
+ */
+struct LE_Task {
+  pthread_t thread; // Thread running the task
+  TaskFunction_t func; // Task function
+  void *param; // Task parameter
+  uint8_t *stack; // Painted stack, NULL for threads not created by xTaskCreate
+  size_t stack_size; // Size of the stack
+  pthread_mutex_t lock; // Protects the notification slot
+  pthread_cond_t cond; // Signals a notification
+  uint32_t notify_value; // Notification value
+  bool notify_pending; // A notification was sent and not yet received
+};
+
+typedef LE_Task *TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void taskYIELD();
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks);
+
+// Preferences stored as one text file per namespace
+
+/**
+ * @brief Preferences namespace backed by a file on the host
+ *
+ */
+class Preferences {
+  private:
+
+  char _path[256]; // File of the open namespace, empty when closed
+  bool _read_only;
+
+  bool LE_GetValue(const char *key, char *value, size_t size);
+  bool LE_PutValue(const char *key, const char *value);
+
+  public:
+
+  Preferences() {
+    _path[0] = '\0';
+    _read_only = false;
+  }
+
+  bool begin(const char *name, bool read_only = false, const char *partition = NULL);
+  void end() { _path[0] = '\0'; }
+  bool isKey(const char *key);
+  bool remove(const char *key);
+  bool clear();
+
+  size_t putInt(const char *key, int32_t value);
+  size_t putUInt(const char *key, uint32_t value);
+  size_t putLong(const char *key, int32_t value) { return putInt(key, value); }
+  size_t putULong(const char *key, uint32_t value) { return putUInt(key, value); }
+  size_t putFloat(const char *key, float value);
+  size_t putBool(const char *key, bool value) { return putUInt(key, value); }
+
+  int32_t getInt(const char *key, int32_t default_value = 0);
+  uint32_t getUInt(const char *key, uint32_t default_value = 0);
+  int32_t getLong(const char *key, int32_t default_value = 0) { return getInt(key, default_value); }
+  uint32_t getULong(const char *key, uint32_t default_value = 0) { return getUInt(key, default_value); }
+  float getFloat(const char *key, float default_value = 0);
+  bool getBool(const char *key, bool default_value = false) { return getUInt(key, default_value) != 0; }
+};
+
+// Filesystem backed by a host directory
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+namespace fs {
+
+/**
+ * @brief Open file or directory, shared by the copies of a File
+ *
+ */
+struct LE_FileImpl {
+  FILE *file; // Open file, NULL for a directory
+  DIR *dir; // Open directory, NULL for a file
+  char path[256]; // Path on the filesystem
+  char host_path[512]; // Path on the host
+
+  ~LE_FileImpl();
+};
+
+/**
+ * @brief File or directory of a native filesystem
+ *
+ */
+class File {
+  private:
+
+  std::shared_ptr<LE_FileImpl> _impl;
+
+  public:
+
+  File() {}
+  File(std::shared_ptr<LE_FileImpl> impl) : _impl(impl) {}
+
+  size_t read(uint8_t *buf, size_t size);
+  int read();
+  int available();
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t size);
+  size_t print(const char *s) { return write((const uint8_t *) s, strlen(s)); }
+  void flush();
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  const char *path() const;
+  const char *name() const;
+  bool isDirectory() const;
+  File openNextFile(const char *mode = FILE_READ);
+  operator bool() const { return _impl && (_impl->file != NULL || _impl->dir != NULL); }
+};
+
+/**
+ * @brief Filesystem rooted at a host directory
+ *
+ */
+class FS {
+  protected:
+
+  char _root[256]; // Host directory of the filesystem root
+
+  void LE_HostPath(const char *path, char *host_path, size_t size);
+
+  public:
+
+  FS(const char *root) {
+    strncpy(_root, root, sizeof(_root) - 1);
+    _root[sizeof(_root) - 1] = '\0';
+  }
+
+  File open(const char *path, const char *mode = FILE_READ, bool create = false);
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *path_from, const char *path_to);
+  bool mkdir(const char *path);
+  bool rmdir(const char *path);
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+
+/**
+ * @brief SPIFFS partition backed by a host directory
+ *
+ */
+class SPIFFSFS : public fs::FS {
+  public:
+
+  SPIFFSFS() : FS(LE_NATIVE_SPIFFS_DIR) {}
+
+  bool begin(bool format_on_fail = false, const char *base_path = "/spiffs", uint8_t max_open_files = 10,
+             const char *partition_label = NULL);
+  void end() {}
+};
+
+extern SPIFFSFS SPIFFS;
+
+#endif
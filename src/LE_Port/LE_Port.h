@@ -0,0 +1,16 @@
+#ifndef LE_PORT_H
+#define LE_PORT_H
+
+// Platform layer of LuaEngine: the Arduino core on the device, a thin
+// Linux implementation of the same APIs on a development host
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Preferences.h>
+#include "FS.h"
+#include "SPIFFS.h"
+#else
+#include "LE_Port/LE_Native.h"
+#endif
+
+#endif
@@ -0,0 +1,823 @@
+#include "LuaArray/LuaArray.h"
+#include <string.h>
+#include <math.h>
+#include <limits>
+
+// Element type names for Lua scripts and their sizes, indexed by LA_*
+static const char *const LA_TypeNames[] = {"float32", "int32", "int16", "uint8", NULL};
+static const uint8_t LA_TypeSizes[] = {sizeof(float), sizeof(int32_t), sizeof(int16_t), sizeof(uint8_t)};
+
+#define LA_HEADER_SZ ((sizeof(LA_Array) + 7) & ~(size_t) 7) // The elements start 8-byte aligned
+
+// Run F<T>(elements, ...) on an array, T being the C type of its elements
+#define LA_DISPATCH(a, F, ...) \
+  do { \
+    switch ((a)->type) { \
+      case LA_FLOAT32: F<float>((float *) (a)->data, __VA_ARGS__); break; \
+      case LA_INT32: F<int32_t>((int32_t *) (a)->data, __VA_ARGS__); break; \
+      case LA_INT16: F<int16_t>((int16_t *) (a)->data, __VA_ARGS__); break; \
+      default: F<uint8_t>((uint8_t *) (a)->data, __VA_ARGS__); break; \
+    } \
+  } while (0)
+
+/**
+ * @brief Accumulator of the sums of an element type: exact 64-bit sums of integer elements
+ *
+ */
+template <typename T> struct LA_Acc { typedef int64_t type; };
+template <> struct LA_Acc<float> { typedef float type; };
+
+/**
+ * @brief Convert a Lua float to an element, integer types saturating and rounding to nearest
+ *
+ */
+template <typename T> static inline T LA_FromNumber(lua_Number x) {
+  if (!(x > (lua_Number) std::numeric_limits<T>::min())) // NaN too
+    return x != x ? 0 : std::numeric_limits<T>::min();
+  if (x >= (lua_Number) std::numeric_limits<T>::max())
+    return std::numeric_limits<T>::max();
+  return (T) (x >= 0 ? x + (lua_Number) 0.5 : x - (lua_Number) 0.5);
+}
+template <> inline float LA_FromNumber<float>(lua_Number x) { return (float) x; }
+
+/**
+ * @brief Convert a Lua integer to an element, integer types saturating
+ *
+ */
+template <typename T> static inline T LA_FromInteger(lua_Integer v) {
+  if (v < (lua_Integer) std::numeric_limits<T>::min())
+    return std::numeric_limits<T>::min();
+  if (v > (lua_Integer) std::numeric_limits<T>::max())
+    return std::numeric_limits<T>::max();
+  return (T) v;
+}
+template <> inline float LA_FromInteger<float>(lua_Integer v) { return (float) v; }
+
+/**
+ * @brief Push an element or a sum, as an integer when it is one and fits
+ *
+ */
+static inline void LA_PushValue(lua_State *L, float v) { lua_pushnumber(L, (lua_Number) v); }
+static inline void LA_PushValue(lua_State *L, int64_t v) {
+  if (v >= (int64_t) LUA_MININTEGER && v <= (int64_t) LUA_MAXINTEGER)
+    lua_pushinteger(L, (lua_Integer) v);
+  else
+    lua_pushnumber(L, (lua_Number) v);
+}
+
+// Kernels over the contiguous elements. The reductions keep LA_LANES independent
+// accumulators, so that the compiler can vectorise or pipeline them without
+// reassociating float additions.
+
+template <typename T> static void LA_FillKernel(T *d, uint32_t n, T v) {
+  for (uint32_t i = 0; i < n; i++)
+    d[i] = v;
+}
+
+template <typename T> static typename LA_Acc<T>::type LA_SumKernel(const T *__restrict d, uint32_t n) {
+  typename LA_Acc<T>::type acc[LA_LANES] = {0};
+  uint32_t i = 0;
+  for (; i + LA_LANES <= n; i += LA_LANES)
+    for (int k = 0; k < LA_LANES; k++)
+      acc[k] += d[i + k];
+  for (; i < n; i++)
+    acc[0] += d[i];
+  for (int k = 1; k < LA_LANES; k++)
+    acc[0] += acc[k];
+  return acc[0];
+}
+
+template <typename T, bool MAX> static T LA_ExtremeKernel(const T *__restrict d, uint32_t n) {
+  T m[LA_LANES];
+  for (int k = 0; k < LA_LANES; k++)
+    m[k] = d[0];
+  uint32_t i = 0;
+  for (; i + LA_LANES <= n; i += LA_LANES)
+    for (int k = 0; k < LA_LANES; k++)
+      m[k] = (MAX ? d[i + k] > m[k] : d[i + k] < m[k]) ? d[i + k] : m[k];
+  for (; i < n; i++)
+    m[0] = (MAX ? d[i] > m[0] : d[i] < m[0]) ? d[i] : m[0];
+  for (int k = 1; k < LA_LANES; k++)
+    m[0] = (MAX ? m[k] > m[0] : m[k] < m[0]) ? m[k] : m[0];
+  return m[0];
+}
+
+template <typename T> static void LA_ScaleKernel(T *__restrict d, uint32_t n, lua_Number k, lua_Number c) {
+  for (uint32_t i = 0; i < n; i++)
+    d[i] = LA_FromNumber<T>(d[i] * k + c);
+}
+
+template <typename T>
+static typename LA_Acc<T>::type LA_DotKernel(const T *__restrict a, const T *__restrict b, uint32_t n) {
+  typename LA_Acc<T>::type acc[LA_LANES] = {0};
+  uint32_t i = 0;
+  for (; i + LA_LANES <= n; i += LA_LANES)
+    for (int k = 0; k < LA_LANES; k++)
+      acc[k] += (typename LA_Acc<T>::type) a[i + k] * b[i + k];
+  for (; i < n; i++)
+    acc[0] += (typename LA_Acc<T>::type) a[i] * b[i];
+  for (int k = 1; k < LA_LANES; k++)
+    acc[0] += acc[k];
+  return acc[0];
+}
+
+template <typename T> static void LA_MovAvgKernel(const T *__restrict d, uint32_t n, uint32_t w, float *__restrict out) {
+  typename LA_Acc<T>::type acc = LA_SumKernel<T>(d, w);
+  float inv = 1.0f / w;
+  out[0] = acc * inv;
+  for (uint32_t i = w; i < n; i++) {
+    acc += d[i] - d[i - w];
+    out[i - w + 1] = acc * inv;
+  }
+}
+
+// Adapters running a kernel on the elements of an array and pushing its result
+
+template <typename T> static void LA_DoFill(T *d, uint32_t n, lua_Number x, lua_Integer v, bool integer) {
+  LA_FillKernel<T>(d, n, integer ? LA_FromInteger<T>(v) : LA_FromNumber<T>(x));
+}
+
+template <typename T> static void LA_DoSet(T *d, uint32_t i, lua_Number x, lua_Integer v, bool integer) {
+  d[i] = integer ? LA_FromInteger<T>(v) : LA_FromNumber<T>(x);
+}
+
+template <typename T> static void LA_DoGet(T *d, uint32_t i, lua_State *L) {
+  LA_PushValue(L, (typename LA_Acc<T>::type) d[i]);
+}
+
+template <typename T> static void LA_DoSum(T *d, uint32_t n, lua_State *L, bool mean) {
+  typename LA_Acc<T>::type s = LA_SumKernel<T>(d, n);
+  if (mean)
+    lua_pushnumber(L, (lua_Number) s / n);
+  else
+    LA_PushValue(L, s);
+}
+
+template <typename T> static void LA_DoExtreme(T *d, uint32_t n, lua_State *L, bool max) {
+  T m = max ? LA_ExtremeKernel<T, true>(d, n) : LA_ExtremeKernel<T, false>(d, n);
+  LA_PushValue(L, (typename LA_Acc<T>::type) m);
+}
+
+template <typename T> static void LA_DoScale(T *d, uint32_t n, lua_Number k, lua_Number c) {
+  LA_ScaleKernel<T>(d, n, k, c);
+}
+
+template <typename T> static void LA_DoDot(T *d, uint32_t n, const void *b, lua_State *L) {
+  LA_PushValue(L, LA_DotKernel<T>(d, (const T *) b, n));
+}
+
+template <typename T> static void LA_DoMovAvg(T *d, uint32_t n, uint32_t w, float *out) {
+  LA_MovAvgKernel<T>(d, n, w, out);
+}
+
+/**
+ * @brief Check that a function argument is a typed array
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param idx Stack index of the argument
+ * @return LA_Array* Array
+ */
+LA_Array *LuaArray::LA_Check(lua_State *L, int idx) {
+  return (LA_Array *) luaL_checkudata(L, idx, LA_METATABLE);
+}
+
+/**
+ * @brief Push a new array of zeros on the stack
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param type Element type (LA_*)
+ * @param len Number of elements
+ * @return LA_Array* Array
+ */
+LA_Array *LuaArray::LA_Push(lua_State *L, uint8_t type, uint32_t len) {
+  size_t data_sz = (size_t) len * LA_TypeSizes[type];
+  LA_Array *a = (LA_Array *) lua_newuserdatauv(L, LA_HEADER_SZ + data_sz, 0);
+  a->data = (uint8_t *) a + LA_HEADER_SZ;
+  a->len = len;
+  a->type = type;
+  memset(a->data, 0, data_sz);
+  luaL_setmetatable(L, LA_METATABLE);
+  return a;
+}
+
+/**
+ * @brief Store a Lua number in an element
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param a Array
+ * @param i Element index, from 0
+ * @param idx Stack index of the value
+ * @return true The value was stored
+ * @return false The value is not a number
+ */
+bool LuaArray::LA_Set(lua_State *L, LA_Array *a, uint32_t i, int idx) {
+  int isnum;
+  if (lua_isinteger(L, idx)) {
+    LA_DISPATCH(a, LA_DoSet, i, 0, lua_tointeger(L, idx), true);
+    return true;
+  }
+  lua_Number x = lua_tonumberx(L, idx, &isnum);
+  if (isnum)
+    LA_DISPATCH(a, LA_DoSet, i, x, 0, false);
+  return isnum;
+}
+
+/**
+ * @brief Create an array: array.new(type, n [, value]) of n elements set to value (default 0), or
+ * array.new(type, t) holding the numbers of the sequence t
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the array
+ */
+int LuaArray::LA_New(lua_State *L) {
+  int type = luaL_checkoption(L, 1, NULL, LA_TypeNames);
+  size_t max_len = (~(size_t) 0 - LA_HEADER_SZ) / LA_TypeSizes[type];
+  if (max_len > UINT32_MAX)
+    max_len = UINT32_MAX;
+
+  if (lua_istable(L, 2)) {
+    lua_Unsigned n = lua_rawlen(L, 2);
+    luaL_argcheck(L, n <= max_len, 2, "table too large");
+    LA_Array *a = LA_Push(L, type, (uint32_t) n);
+    for (uint32_t i = 0; i < a->len; i++) {
+      lua_rawgeti(L, 2, (lua_Integer) i + 1);
+      if (!LA_Set(L, a, i, -1))
+        return luaL_error(L, "bad element #%d of table (number expected, got %s)", (int) i + 1, luaL_typename(L, -1));
+      lua_pop(L, 1);
+    }
+    return 1;
+  }
+
+  lua_Integer n = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, n >= 0 && (lua_Unsigned) n <= max_len, 2, "invalid array size");
+  bool fill = !lua_isnoneornil(L, 3);
+  lua_Number x = fill ? luaL_checknumber(L, 3) : 0;
+  lua_settop(L, 3);
+  LA_Array *a = LA_Push(L, type, (uint32_t) n);
+  if (fill)
+    LA_DISPATCH(a, LA_DoFill, a->len, x, lua_tointeger(L, 3), lua_isinteger(L, 3));
+  return 1;
+}
+
+/**
+ * @brief __index metamethod: element a[i], nil out of range, or method of the arrays
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the element or method
+ */
+int LuaArray::LA_Index(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    int isint;
+    lua_Integer i = lua_tointegerx(L, 2, &isint);
+    if (isint && i >= 1 && (lua_Unsigned) i <= a->len)
+      LA_DISPATCH(a, LA_DoGet, (uint32_t) (i - 1), L);
+    else
+      lua_pushnil(L);
+    return 1;
+  }
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(1)); // Method table
+  return 1;
+}
+
+/**
+ * @brief __newindex metamethod: set element a[i], integer types saturating and rounding to nearest
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: none
+ */
+int LuaArray::LA_NewIndex(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  int isint;
+  lua_Integer i = lua_tointegerx(L, 2, &isint);
+  if (lua_type(L, 2) != LUA_TNUMBER || !isint || i < 1 || (lua_Unsigned) i > a->len)
+    return luaL_error(L, "array index out of range");
+  if (!LA_Set(L, a, (uint32_t) (i - 1), 3))
+    return luaL_typeerror(L, 3, "number");
+  return 0;
+}
+
+/**
+ * @brief __len metamethod: number of elements
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the length
+ */
+int LuaArray::LA_Len(lua_State *L) {
+  lua_pushinteger(L, (lua_Integer) LA_Check(L, 1)->len);
+  return 1;
+}
+
+/**
+ * @brief __tostring metamethod: element type and length, e.g. "float32[64]: 0x3ffb1234"
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the string
+ */
+int LuaArray::LA_ToString(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  lua_pushfstring(L, "%s[%d]: %p", LA_TypeNames[a->type], (int) a->len, (void *) a);
+  return 1;
+}
+
+/**
+ * @brief a:fill(value): set all elements to value
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the array
+ */
+int LuaArray::LA_Fill(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  lua_Number x = luaL_checknumber(L, 2);
+  LA_DISPATCH(a, LA_DoFill, a->len, x, lua_tointeger(L, 2), lua_isinteger(L, 2));
+  lua_settop(L, 1);
+  return 1;
+}
+
+/**
+ * @brief a:sum(): sum of the elements, an integer for integer arrays when it fits
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the sum
+ */
+int LuaArray::LA_Sum(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  LA_DISPATCH(a, LA_DoSum, a->len, L, false);
+  return 1;
+}
+
+/**
+ * @brief a:mean(): mean of the elements, nil for an empty array
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the mean
+ */
+int LuaArray::LA_Mean(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  if (a->len == 0)
+    lua_pushnil(L);
+  else
+    LA_DISPATCH(a, LA_DoSum, a->len, L, true);
+  return 1;
+}
+
+/**
+ * @brief a:min(): smallest element, nil for an empty array
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the minimum
+ */
+int LuaArray::LA_Min(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  if (a->len == 0)
+    lua_pushnil(L);
+  else
+    LA_DISPATCH(a, LA_DoExtreme, a->len, L, false);
+  return 1;
+}
+
+/**
+ * @brief a:max(): largest element, nil for an empty array
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the maximum
+ */
+int LuaArray::LA_Max(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  if (a->len == 0)
+    lua_pushnil(L);
+  else
+    LA_DISPATCH(a, LA_DoExtreme, a->len, L, true);
+  return 1;
+}
+
+/**
+ * @brief a:scale(k [, offset]): replace each element x by x * k + offset, integer types saturating
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the array
+ */
+int LuaArray::LA_Scale(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  lua_Number k = luaL_checknumber(L, 2);
+  lua_Number c = luaL_optnumber(L, 3, 0);
+  LA_DISPATCH(a, LA_DoScale, a->len, k, c);
+  lua_settop(L, 1);
+  return 1;
+}
+
+/**
+ * @brief a:dot(b): dot product with an array of the same type and length
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the dot product
+ */
+int LuaArray::LA_Dot(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  LA_Array *b = LA_Check(L, 2);
+  luaL_argcheck(L, b->type == a->type && b->len == a->len, 2, "array of the same type and length expected");
+  LA_DISPATCH(a, LA_DoDot, a->len, b->data, L);
+  return 1;
+}
+
+/**
+ * @brief a:movavg(w [, out]): moving averages over windows of w elements, written to the float32 array out
+ * (default: a new one) from its first element
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the array of the #a - w + 1 averages
+ */
+int LuaArray::LA_MovAvg(lua_State *L) {
+  LA_Array *a = LA_Check(L, 1);
+  lua_Integer w = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, w >= 1 && (lua_Unsigned) w <= a->len, 2, "window out of range");
+  uint32_t n_out = a->len - (uint32_t) w + 1;
+
+  LA_Array *out;
+  if (lua_isnoneornil(L, 3))
+    out = LA_Push(L, LA_FLOAT32, n_out);
+  else {
+    out = LA_Check(L, 3);
+    luaL_argcheck(L, out->type == LA_FLOAT32 && out->len >= n_out, 3, "float32 array too short");
+    luaL_argcheck(L, out != a, 3, "output must not be the input array");
+    lua_settop(L, 3);
+  }
+  LA_DISPATCH(a, LA_DoMovAvg, a->len, (uint32_t) w, (float *) out->data);
+  return 1;
+}
+
+/**
+ * @brief Drop the candidate of a slot leaving the window, which is the oldest one when present
+ *
+ * @param q Deque
+ * @param cap Capacity of the window
+ * @param slot Slot of the sample leaving the window
+ */
+static inline void LA_DequeEvict(LA_Deque *q, uint32_t cap, uint32_t slot) {
+  if (q->len > 0 && q->slot[q->head] == slot) {
+    q->head = (q->head + 1 == cap) ? 0 : q->head + 1;
+    q->len--;
+  }
+}
+
+/**
+ * @brief Add the candidate of a new sample, dropping the candidates it outlives and beats
+ *
+ * @param q Deque
+ * @param v Ring of samples
+ * @param cap Capacity of the window
+ * @param slot Slot of the new sample
+ * @param max Deque of the maximum, else of the minimum
+ */
+static inline void LA_DequePush(LA_Deque *q, const lua_Number *v, uint32_t cap, uint32_t slot, bool max) {
+  lua_Number x = v[slot];
+  while (q->len > 0) {
+    uint32_t back = q->head + q->len - 1;
+    if (back >= cap)
+      back -= cap;
+    if (max ? v[q->slot[back]] > x : v[q->slot[back]] < x)
+      break;
+    q->len--;
+  }
+  uint32_t pos = q->head + q->len;
+  q->slot[pos >= cap ? pos - cap : pos] = slot;
+  q->len++;
+}
+
+/**
+ * @brief Empty a window
+ *
+ * @param w Window
+ */
+static void LA_WinReset(LA_Window *w) {
+  w->count = w->head = w->turn = 0;
+  w->sum = w->m2 = 0;
+  w->minq.head = w->minq.len = 0;
+  w->maxq.head = w->maxq.len = 0;
+}
+
+/**
+ * @brief Check that a function argument is a rolling window
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param idx Stack index of the argument
+ * @return LA_Window* Window
+ */
+LA_Window *LuaArray::LA_WinCheck(lua_State *L, int idx) {
+  return (LA_Window *) luaL_checkudata(L, idx, LA_WIN_METATABLE);
+}
+
+/**
+ * @brief Recompute the sums of a window from its samples, clearing the rounding errors of the sliding updates
+ *
+ * @param w Window
+ */
+void LuaArray::LA_WinResync(LA_Window *w) {
+  lua_Number sum = 0, m2 = 0;
+  for (uint32_t i = 0; i < w->count; i++)
+    sum += w->values[i];
+  lua_Number mean = sum / w->count;
+  for (uint32_t i = 0; i < w->count; i++)
+    m2 += (w->values[i] - mean) * (w->values[i] - mean);
+  w->sum = sum;
+  w->m2 = m2;
+  w->turn = 0;
+}
+
+/**
+ * @brief Create a rolling window: array.window(n) keeping the last n samples pushed
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the window
+ */
+int LuaArray::LA_WinNew(lua_State *L) {
+  lua_Integer cap = luaL_checkinteger(L, 1);
+  size_t hdr_sz = (sizeof(LA_Window) + 7) & ~(size_t) 7; // The samples start 8-byte aligned
+  size_t slot_sz = sizeof(lua_Number) + 2 * sizeof(uint32_t); // Sample and its two deque entries
+  size_t max_cap = (~(size_t) 0 - hdr_sz) / slot_sz;
+  if (max_cap > UINT32_MAX / 2) // Ring positions are added without overflow
+    max_cap = UINT32_MAX / 2;
+  luaL_argcheck(L, cap >= 1 && (lua_Unsigned) cap <= max_cap, 1, "invalid window size");
+
+  LA_Window *w = (LA_Window *) lua_newuserdatauv(L, hdr_sz + (size_t) cap * slot_sz, 0);
+  w->values = (lua_Number *) ((uint8_t *) w + hdr_sz);
+  w->minq.slot = (uint32_t *) (w->values + cap);
+  w->maxq.slot = w->minq.slot + cap;
+  w->cap = (uint32_t) cap;
+  LA_WinReset(w);
+  luaL_setmetatable(L, LA_WIN_METATABLE);
+  return 1;
+}
+
+/**
+ * @brief __index metamethod: sample w[i], from 1 for the oldest to #w for the newest, nil out of range, or
+ * method of the windows
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the sample or method
+ */
+int LuaArray::LA_WinIndex(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    int isint;
+    lua_Integer i = lua_tointegerx(L, 2, &isint);
+    if (isint && i >= 1 && (lua_Unsigned) i <= w->count) {
+      uint32_t slot = w->head + w->cap - w->count + (uint32_t) (i - 1);
+      lua_pushnumber(L, w->values[slot >= w->cap ? slot - w->cap : slot]);
+    }
+    else
+      lua_pushnil(L);
+    return 1;
+  }
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(1)); // Method table
+  return 1;
+}
+
+/**
+ * @brief __len metamethod: number of samples held
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the count
+ */
+int LuaArray::LA_WinLen(lua_State *L) {
+  lua_pushinteger(L, (lua_Integer) LA_WinCheck(L, 1)->count);
+  return 1;
+}
+
+/**
+ * @brief __tostring metamethod: samples held and capacity, e.g. "window[12/64]: 0x3ffb1234"
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the string
+ */
+int LuaArray::LA_WinToString(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  lua_pushfstring(L, "window[%d/%d]: %p", (int) w->count, (int) w->cap, (void *) w);
+  return 1;
+}
+
+/**
+ * @brief w:push(x): add a sample, dropping the oldest one once the window is full
+ *
+ * Runs in constant amortised time. The sums are recomputed from the samples once per
+ * turn of a full window, which bounds the rounding errors of the sliding updates.
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the sample dropped, or none
+ */
+int LuaArray::LA_WinPush(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  lua_Number x = luaL_checknumber(L, 2);
+  uint32_t slot = w->head;
+  int nres = 0;
+
+  if (w->count < w->cap) {
+    // Welford update adding a sample
+    lua_Number mean = (w->count > 0) ? w->sum / w->count : 0;
+    w->count++;
+    w->sum += x;
+    w->m2 += (x - mean) * (x - w->sum / w->count);
+  }
+  else {
+    // Sliding update replacing the oldest sample
+    lua_Number y = w->values[slot];
+    lua_Number mean = w->sum / w->count;
+    w->sum += x - y;
+    w->m2 += (x - y) * (x - w->sum / w->count + y - mean);
+    if (w->m2 < 0)
+      w->m2 = 0;
+    LA_DequeEvict(&w->minq, w->cap, slot);
+    LA_DequeEvict(&w->maxq, w->cap, slot);
+    lua_pushnumber(L, y);
+    nres = 1;
+  }
+
+  w->values[slot] = x;
+  w->head = (slot + 1 == w->cap) ? 0 : slot + 1;
+  LA_DequePush(&w->minq, w->values, w->cap, slot, false);
+  LA_DequePush(&w->maxq, w->values, w->cap, slot, true);
+  if (nres > 0 && ++w->turn == w->cap)
+    LA_WinResync(w);
+  return nres;
+}
+
+/**
+ * @brief w:clear(): drop all samples
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the window
+ */
+int LuaArray::LA_WinClear(lua_State *L) {
+  LA_WinReset(LA_WinCheck(L, 1));
+  lua_settop(L, 1);
+  return 1;
+}
+
+/**
+ * @brief w:full(): whether the window holds its capacity of samples
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the boolean
+ */
+int LuaArray::LA_WinFull(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  lua_pushboolean(L, w->count == w->cap);
+  return 1;
+}
+
+/**
+ * @brief w:sum(): sum of the samples
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the sum
+ */
+int LuaArray::LA_WinSum(lua_State *L) {
+  lua_pushnumber(L, LA_WinCheck(L, 1)->sum);
+  return 1;
+}
+
+/**
+ * @brief w:mean(): mean of the samples, nil for an empty window
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the mean
+ */
+int LuaArray::LA_WinMean(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  if (w->count == 0)
+    lua_pushnil(L);
+  else
+    lua_pushnumber(L, w->sum / w->count);
+  return 1;
+}
+
+/**
+ * @brief w:var(): population variance of the samples, nil for an empty window
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the variance
+ */
+int LuaArray::LA_WinVar(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  if (w->count == 0)
+    lua_pushnil(L);
+  else
+    lua_pushnumber(L, w->m2 / w->count);
+  return 1;
+}
+
+/**
+ * @brief w:std(): population standard deviation of the samples, nil for an empty window
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the standard deviation
+ */
+int LuaArray::LA_WinStd(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  if (w->count == 0)
+    lua_pushnil(L);
+  else
+    lua_pushnumber(L, l_mathop(sqrt)(w->m2 / w->count));
+  return 1;
+}
+
+/**
+ * @brief w:min(): smallest sample, nil for an empty window
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the minimum
+ */
+int LuaArray::LA_WinMin(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  if (w->count == 0)
+    lua_pushnil(L);
+  else
+    lua_pushnumber(L, w->values[w->minq.slot[w->minq.head]]);
+  return 1;
+}
+
+/**
+ * @brief w:max(): largest sample, nil for an empty window
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the maximum
+ */
+int LuaArray::LA_WinMax(lua_State *L) {
+  LA_Window *w = LA_WinCheck(L, 1);
+  if (w->count == 0)
+    lua_pushnil(L);
+  else
+    lua_pushnumber(L, w->values[w->maxq.slot[w->maxq.head]]);
+  return 1;
+}
+
+/**
+ * @brief Open the library of typed arrays and rolling windows, for luaL_requiref
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the library table
+ */
+int LuaArray::LA_Open(lua_State *L) {
+  static const luaL_Reg meta[] = {
+    {"__newindex", LA_NewIndex},
+    {"__len", LA_Len},
+    {"__tostring", LA_ToString},
+    {NULL, NULL}
+  };
+  static const luaL_Reg methods[] = {
+    {"fill", LA_Fill},
+    {"sum", LA_Sum},
+    {"mean", LA_Mean},
+    {"min", LA_Min},
+    {"max", LA_Max},
+    {"scale", LA_Scale},
+    {"dot", LA_Dot},
+    {"movavg", LA_MovAvg},
+    {NULL, NULL}
+  };
+  static const luaL_Reg win_meta[] = {
+    {"__len", LA_WinLen},
+    {"__tostring", LA_WinToString},
+    {NULL, NULL}
+  };
+  static const luaL_Reg win_methods[] = {
+    {"push", LA_WinPush},
+    {"clear", LA_WinClear},
+    {"full", LA_WinFull},
+    {"sum", LA_WinSum},
+    {"mean", LA_WinMean},
+    {"var", LA_WinVar},
+    {"std", LA_WinStd},
+    {"min", LA_WinMin},
+    {"max", LA_WinMax},
+    {NULL, NULL}
+  };
+  static const luaL_Reg lib[] = {
+    {"new", LA_New},
+    {"window", LA_WinNew},
+    {NULL, NULL}
+  };
+
+  luaL_newmetatable(L, LA_METATABLE);
+  luaL_setfuncs(L, meta, 0);
+  luaL_newlib(L, methods);
+  lua_pushcclosure(L, LA_Index, 1);
+  lua_setfield(L, -2, "__index");
+  lua_pushliteral(L, LA_METATABLE); // Hide the metatable, so that the metamethods only ever get arrays
+  lua_setfield(L, -2, "__metatable");
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, LA_WIN_METATABLE);
+  luaL_setfuncs(L, win_meta, 0);
+  luaL_newlib(L, win_methods);
+  lua_pushcclosure(L, LA_WinIndex, 1);
+  lua_setfield(L, -2, "__index");
+  lua_pushliteral(L, LA_WIN_METATABLE);
+  lua_setfield(L, -2, "__metatable");
+  lua_pop(L, 1);
+
+  luaL_newlib(L, lib);
+  return 1;
+}
@@ -0,0 +1,107 @@
+#ifndef LUA_ARRAY_H
+#define LUA_ARRAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "LuaWrapper/lua/src/lua.hpp"
+
+// Typed numeric arrays for Lua scripts: the samples are stored unboxed in one
+// block of the userdata, indexed from 1 like a table, and reduced by C kernels
+// looping over the contiguous memory. Rolling windows keep the last samples
+// pushed in a ring, with their statistics updated on every push
+
+#define LA_METATABLE "LA_Array" // Registry name of the metatable of the arrays
+#define LA_WIN_METATABLE "LA_Window" // Registry name of the metatable of the rolling windows
+#define LA_LANES 4 // Independent accumulators of the reduction kernels
+
+// Element types, in the order of LA_TypeNames
+#define LA_FLOAT32 0
+#define LA_INT32 1
+#define LA_INT16 2
+#define LA_UINT8 3
+
+/**
+ * @brief Header of a typed array, followed by its elements in the same userdata
+ *
+ */
+struct LA_Array {
+  void *data; // First element
+  uint32_t len; // Number of elements
+  uint8_t type; // Element type (LA_*)
+};
+
+/**
+ * @brief Monotonic deque of window slots, kept as a ring of the window capacity
+ *
+ */
+struct LA_Deque {
+  uint32_t *slot; // Slots of the candidates, oldest first
+  uint32_t head; // Position of the oldest candidate
+  uint32_t len; // Number of candidates
+};
+
+/**
+ * @brief Rolling window of the last samples, followed by its ring and deques in the same userdata
+ *
+ * The statistics are updated on every push: sum and sum of squared deviations by
+ * a sliding Welford update, min and max as the heads of monotonic deques.
+ */
+struct LA_Window {
+  lua_Number *values; // Ring of samples
+  uint32_t cap; // Capacity
+  uint32_t count; // Samples held
+  uint32_t head; // Slot of the next push, the oldest sample once full
+  uint32_t turn; // Pushes since the sums were last recomputed
+  lua_Number sum; // Sum of the samples
+  lua_Number m2; // Sum of the squared deviations from the mean
+  LA_Deque minq; // Candidates for the minimum, values increasing
+  LA_Deque maxq; // Candidates for the maximum, values decreasing
+};
+
+/**
+ * @brief Lua library of typed numeric arrays
+ *
+ */
+class LuaArray {
+  private:
+
+  static LA_Array *LA_Check(lua_State *L, int idx);
+  static LA_Array *LA_Push(lua_State *L, uint8_t type, uint32_t len);
+  static bool LA_Set(lua_State *L, LA_Array *a, uint32_t i, int idx);
+
+  static int LA_New(lua_State *L);
+  static int LA_Index(lua_State *L);
+  static int LA_NewIndex(lua_State *L);
+  static int LA_Len(lua_State *L);
+  static int LA_ToString(lua_State *L);
+  static int LA_Fill(lua_State *L);
+  static int LA_Sum(lua_State *L);
+  static int LA_Mean(lua_State *L);
+  static int LA_Min(lua_State *L);
+  static int LA_Max(lua_State *L);
+  static int LA_Scale(lua_State *L);
+  static int LA_Dot(lua_State *L);
+  static int LA_MovAvg(lua_State *L);
+
+  static LA_Window *LA_WinCheck(lua_State *L, int idx);
+  static void LA_WinResync(LA_Window *w);
+  static int LA_WinNew(lua_State *L);
+  static int LA_WinIndex(lua_State *L);
+  static int LA_WinLen(lua_State *L);
+  static int LA_WinToString(lua_State *L);
+  static int LA_WinPush(lua_State *L);
+  static int LA_WinClear(lua_State *L);
+  static int LA_WinFull(lua_State *L);
+  static int LA_WinSum(lua_State *L);
+  static int LA_WinMean(lua_State *L);
+  static int LA_WinVar(lua_State *L);
+  static int LA_WinStd(lua_State *L);
+  static int LA_WinMin(lua_State *L);
+  static int LA_WinMax(lua_State *L);
+
+  public:
+
+  static int LA_Open(lua_State *L);
+};
+
+#endif
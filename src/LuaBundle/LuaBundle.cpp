@@ -0,0 +1,436 @@
+#include "LuaBundle/LuaBundle.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LB_HASH_BITS 12 // Size of the compressor hash table
+#define LB_MAX_CHAIN 64 // Candidates tried per position by the compressor
+
+static uint32_t LB_Get32(const uint8_t *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void LB_Put32(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+}
+
+/**
+ * @brief Check whether a buffer starts with a bundle header
+ *
+ * @param buf Start of the file
+ * @param len Number of bytes available in buf
+ * @return true The buffer holds a bundle
+ */
+bool LuaBundle::LB_IsBundle(const uint8_t *buf, size_t len) {
+  return len >= LB_MAGIC_LEN && memcmp(buf, LB_MAGIC, LB_MAGIC_LEN) == 0;
+}
+
+/**
+ * @brief Decode and validate a bundle header
+ *
+ * @param buf Start of the file
+ * @param len Number of bytes available in buf
+ * @param hdr Decoded header
+ * @return true The header is valid and supported
+ */
+bool LuaBundle::LB_ReadHeader(const uint8_t *buf, size_t len, LB_Header *hdr) {
+  if (!LB_IsBundle(buf, len) || len < LB_HEADER_MIN_LEN)
+    return false;
+
+  hdr->version = buf[4];
+  hdr->flags = buf[5];
+  hdr->wbits = buf[6];
+  hdr->hdr_len = buf[7];
+  hdr->raw_size = LB_Get32(buf + 8);
+  hdr->payload_size = LB_Get32(buf + 12);
+
+  if (hdr->version != LB_VERSION || hdr->hdr_len < LB_HEADER_MIN_LEN || hdr->hdr_len > len)
+    return false;
+  hdr->map_size = (hdr->hdr_len >= LB_HEADER_LEN) ? LB_Get32(buf + 16) : 0;
+  if (!(hdr->flags & LB_FLAG_LINEMAP))
+    hdr->map_size = 0;
+  if ((hdr->flags & LB_FLAG_COMPRESSED) && (hdr->wbits < LB_MIN_WBITS || hdr->wbits > LB_MAX_WBITS))
+    return false;
+
+  return true;
+}
+
+/**
+ * @brief Encode a bundle header
+ *
+ * @param hdr Header to encode
+ * @param buf Output buffer of at least LB_HEADER_LEN bytes
+ */
+void LuaBundle::LB_WriteHeader(const LB_Header *hdr, uint8_t *buf) {
+  memcpy(buf, LB_MAGIC, LB_MAGIC_LEN);
+  buf[4] = hdr->version;
+  buf[5] = hdr->flags;
+  buf[6] = hdr->wbits;
+  buf[7] = hdr->hdr_len;
+  LB_Put32(buf + 8, hdr->raw_size);
+  LB_Put32(buf + 12, hdr->payload_size);
+  LB_Put32(buf + 16, hdr->map_size);
+}
+
+/**
+ * @brief Prepare a decoder for a compressed payload
+ *
+ * @param dec Decoder state
+ * @param win Ring window of (1 << wbits) bytes
+ * @param wbits Window bits from the bundle header
+ * @param raw_size Number of bytes to decode
+ */
+void LuaBundle::LB_DecoderInit(LB_Decoder *dec, uint8_t *win, uint8_t wbits, uint32_t raw_size) {
+  dec->win = win;
+  dec->win_size = (uint32_t) 1 << wbits;
+  dec->pos = 0;
+  dec->out_left = raw_size;
+  dec->copy_len = 0;
+  dec->copy_dist = 0;
+  dec->flags = 0;
+  dec->nflags = 0;
+  dec->b0 = 0;
+  dec->have_b0 = false;
+}
+
+/**
+ * @brief Decode compressed input into the ring window
+ *
+ * Decoding stops when the input runs out, the window wraps or the payload
+ * is complete. The returned bytes stay valid until the next call.
+ *
+ * @param dec Decoder state
+ * @param in Compressed input, advanced past the consumed bytes
+ * @param in_len Bytes available at in, decreased by the consumed bytes
+ * @param out Start of the decoded bytes in the window
+ * @return size_t Number of decoded bytes
+ */
+size_t LuaBundle::LB_Decode(LB_Decoder *dec, const uint8_t **in, size_t *in_len, const uint8_t **out) {
+  uint32_t mask = dec->win_size - 1;
+  uint32_t start = dec->pos;
+
+  while (dec->out_left > 0 && dec->pos < dec->win_size) {
+    if (dec->copy_len > 0) { // Expand the pending back-reference
+      dec->win[dec->pos] = dec->win[(dec->pos - dec->copy_dist) & mask];
+      dec->pos++;
+      dec->copy_len--;
+      dec->out_left--;
+      continue;
+    }
+
+    if (*in_len == 0)
+      break;
+
+    uint8_t c = *(*in)++;
+    (*in_len)--;
+
+    if (dec->nflags == 0) { // Start of a group of 8 tokens
+      dec->flags = c;
+      dec->nflags = 8;
+    }
+    else if (!(dec->flags & 1)) { // Literal
+      dec->win[dec->pos++] = c;
+      dec->out_left--;
+      dec->flags >>= 1;
+      dec->nflags--;
+    }
+    else if (!dec->have_b0) { // First byte of a back-reference
+      dec->b0 = c;
+      dec->have_b0 = true;
+    }
+    else {
+      dec->copy_dist = (((uint16_t) dec->b0 << 4) | (c >> 4)) + 1;
+      dec->copy_len = (c & 0x0F) + LB_MIN_MATCH;
+      dec->have_b0 = false;
+      dec->flags >>= 1;
+      dec->nflags--;
+    }
+  }
+
+  *out = dec->win + start;
+  size_t n = dec->pos - start;
+  if (dec->pos == dec->win_size)
+    dec->pos = 0;
+
+  return n;
+}
+
+/**
+ * @brief Read an unsigned LEB128 varint of a line map
+ *
+ * @param p Read position, advanced past the varint
+ * @param end End of the line map
+ * @param v Decoded value
+ * @return true A complete varint was read
+ */
+static bool LB_GetVarint(const uint8_t **p, const uint8_t *end, uint32_t *v) {
+  uint32_t x = 0;
+  for (int shift = 0; *p < end && shift < 32; shift += 7) {
+    uint8_t c = *(*p)++;
+    x |= (uint32_t) (c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      *v = x;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Find the source line of an instruction in a line map written by lua_dropdebug
+ *
+ * @param map Line map of the chunk
+ * @param len Size of the line map
+ * @param protoid Index of the function prototype in the chunk (pre-order)
+ * @param pc Instruction index in the prototype
+ * @return int Source line, -1 if unknown
+ */
+int LuaBundle::LB_MapLine(const uint8_t *map, size_t len, int protoid, int pc) {
+  const uint8_t *p = map;
+  const uint8_t *end = map + len;
+  uint32_t n, dpc, dline;
+
+  // Skip the records of the preceding prototypes
+  for (int id = 0; id < protoid; id++) {
+    if (!LB_GetVarint(&p, end, &n))
+      return -1;
+    for (uint32_t i = 0; i < 2 * n; i++)
+      if (!LB_GetVarint(&p, end, &dpc))
+        return -1;
+  }
+
+  if (!LB_GetVarint(&p, end, &n))
+    return -1;
+
+  int cur_pc = 0; // Pcs and lines start from 0
+  int cur_line = 0;
+  int line = -1;
+  for (uint32_t i = 0; i < n; i++) {
+    if (!LB_GetVarint(&p, end, &dpc) || !LB_GetVarint(&p, end, &dline))
+      return -1;
+    cur_pc += (int) dpc;
+    if (cur_pc > pc)
+      break;
+    cur_line += (dline & 1) ? -(int) ((dline + 1) >> 1) : (int) (dline >> 1); // Zigzag decoded delta
+    line = cur_line;
+  }
+
+  return line;
+}
+
+/**
+ * @brief Check whether a buffer starts with a script archive header
+ *
+ * @param buf Start of the file
+ * @param len Number of bytes available in buf
+ * @return true The buffer holds a script archive
+ */
+bool LuaBundle::LB_IsArchive(const uint8_t *buf, size_t len) {
+  return len >= LB_MAGIC_LEN && memcmp(buf, LB_ARC_MAGIC, LB_MAGIC_LEN) == 0;
+}
+
+/**
+ * @brief Decode and validate a script archive header
+ *
+ * @param buf Start of the file
+ * @param len Number of bytes available in buf
+ * @param hdr Decoded header
+ * @return true The header is valid and supported
+ */
+bool LuaBundle::LB_ReadArchiveHeader(const uint8_t *buf, size_t len, LB_ArchiveHeader *hdr) {
+  if (!LB_IsArchive(buf, len) || len < LB_ARC_HEADER_LEN)
+    return false;
+
+  hdr->version = buf[4];
+  hdr->index_bits = buf[5];
+  hdr->hdr_len = buf[7];
+  hdr->nmodules = LB_Get32(buf + 8);
+  hdr->names_size = LB_Get32(buf + 12);
+
+  if (hdr->version != LB_ARC_VERSION || hdr->hdr_len < LB_ARC_HEADER_LEN || hdr->hdr_len > len)
+    return false;
+  if (hdr->index_bits > LB_ARC_MAX_BITS || hdr->nmodules > ((uint32_t) 1 << hdr->index_bits))
+    return false;
+
+  return true;
+}
+
+/**
+ * @brief Encode a script archive header
+ *
+ * @param hdr Header to encode
+ * @param buf Output buffer of at least LB_ARC_HEADER_LEN bytes
+ */
+void LuaBundle::LB_WriteArchiveHeader(const LB_ArchiveHeader *hdr, uint8_t *buf) {
+  memcpy(buf, LB_ARC_MAGIC, LB_MAGIC_LEN);
+  buf[4] = hdr->version;
+  buf[5] = hdr->index_bits;
+  buf[6] = 0;
+  buf[7] = hdr->hdr_len;
+  LB_Put32(buf + 8, hdr->nmodules);
+  LB_Put32(buf + 12, hdr->names_size);
+}
+
+/**
+ * @brief Hash a module name for the archive index (32-bit FNV-1a)
+ *
+ * @param name Module name
+ * @return uint32_t Hash of the name
+ */
+uint32_t LuaBundle::LB_Hash(const char *name) {
+  uint32_t h = 2166136261u;
+  while (*name)
+    h = (h ^ (uint8_t) *name++) * 16777619u;
+  return h;
+}
+
+/**
+ * @brief Decode an index bucket
+ *
+ * @param buf Start of the bucket
+ * @param entry Decoded entry
+ */
+void LuaBundle::LB_ReadEntry(const uint8_t *buf, LB_Entry *entry) {
+  entry->hash = LB_Get32(buf);
+  entry->name_ofs = LB_Get32(buf + 4);
+  entry->offset = LB_Get32(buf + 8);
+  entry->size = LB_Get32(buf + 12);
+}
+
+/**
+ * @brief Encode an index bucket
+ *
+ * @param entry Entry to encode
+ * @param buf Output buffer of at least LB_ENTRY_LEN bytes
+ */
+void LuaBundle::LB_WriteEntry(const LB_Entry *entry, uint8_t *buf) {
+  LB_Put32(buf, entry->hash);
+  LB_Put32(buf + 4, entry->name_ofs);
+  LB_Put32(buf + 8, entry->offset);
+  LB_Put32(buf + 12, entry->size);
+}
+
+/**
+ * @brief Look a module up in the index of a script archive
+ *
+ * @param index Index buckets followed by the name table
+ * @param hdr Archive header
+ * @param name Module name
+ * @param entry Index entry of the module
+ * @return true The module is in the archive
+ */
+bool LuaBundle::LB_FindModule(const uint8_t *index, const LB_ArchiveHeader *hdr, const char *name, LB_Entry *entry) {
+  uint32_t nbuckets = (uint32_t) 1 << hdr->index_bits;
+  const char *names = (const char *) index + nbuckets * LB_ENTRY_LEN;
+  uint32_t hash = LB_Hash(name);
+
+  // Linear probing from the home bucket, an empty bucket ends the search
+  for (uint32_t i = 0; i < nbuckets; i++) {
+    LB_ReadEntry(index + ((hash + i) & (nbuckets - 1)) * LB_ENTRY_LEN, entry);
+    if (entry->name_ofs == LB_ENTRY_EMPTY)
+      return false;
+    if (entry->hash == hash && entry->name_ofs < hdr->names_size && strcmp(names + entry->name_ofs, name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+/**
+ * @brief Worst case size of a compressed buffer
+ *
+ * @param len Size of the input
+ * @return size_t Output capacity needed by LB_Compress
+ */
+size_t LuaBundle::LB_CompressBound(size_t len) {
+  return len + len / 8 + 1;
+}
+
+/**
+ * @brief Compress a buffer with the bundle LZ codec (host side)
+ *
+ * @param src Input buffer
+ * @param len Size of the input
+ * @param wbits Window bits, bounding the decoder RAM on the device
+ * @param dst Output buffer of LB_CompressBound(len) bytes
+ * @return size_t Size of the compressed output, 0 on allocation failure
+ */
+size_t LuaBundle::LB_Compress(const uint8_t *src, size_t len, uint8_t wbits, uint8_t *dst) {
+  const size_t hsize = (size_t) 1 << LB_HASH_BITS;
+  size_t win = (size_t) 1 << wbits;
+
+  int32_t *head = (int32_t *) malloc(hsize * sizeof(int32_t));
+  int32_t *prev = (int32_t *) malloc((len > 0 ? len : 1) * sizeof(int32_t));
+  if (head == NULL || prev == NULL) {
+    free(head);
+    free(prev);
+    return 0;
+  }
+  for (size_t i = 0; i < hsize; i++)
+    head[i] = -1;
+
+  size_t o = 0; // Output position
+  size_t flag_pos = 0; // Position of the current flag byte
+  uint8_t nflags = 8; // Tokens written in the current group
+  size_t i = 0;
+
+  while (i < len) {
+    if (nflags == 8) { // Open a new group
+      flag_pos = o++;
+      dst[flag_pos] = 0;
+      nflags = 0;
+    }
+
+    size_t best_len = 0;
+    size_t best_dist = 0;
+
+    if (i + LB_MIN_MATCH <= len) {
+      uint32_t h = ((src[i] << 8) ^ (src[i + 1] << 4) ^ src[i + 2]) & (hsize - 1);
+      int32_t cand = head[h];
+      size_t max_len = (len - i < LB_MAX_MATCH) ? len - i : LB_MAX_MATCH;
+
+      for (int chain = 0; cand >= 0 && i - cand <= win && chain < LB_MAX_CHAIN; chain++) {
+        size_t l = 0;
+        while (l < max_len && src[cand + l] == src[i + l])
+          l++;
+        if (l > best_len) {
+          best_len = l;
+          best_dist = i - cand;
+          if (l == max_len)
+            break;
+        }
+        cand = prev[cand];
+      }
+    }
+
+    size_t step;
+    if (best_len >= LB_MIN_MATCH) { // Back-reference
+      dst[flag_pos] |= (uint8_t) (1 << nflags);
+      dst[o++] = (uint8_t) ((best_dist - 1) >> 4);
+      dst[o++] = (uint8_t) ((((best_dist - 1) & 0x0F) << 4) | (best_len - LB_MIN_MATCH));
+      step = best_len;
+    }
+    else { // Literal
+      dst[o++] = src[i];
+      step = 1;
+    }
+    nflags++;
+
+    // Index every position covered by the token
+    for (size_t end = i + step; i < end; i++) {
+      if (i + LB_MIN_MATCH <= len) {
+        uint32_t h = ((src[i] << 8) ^ (src[i + 1] << 4) ^ src[i + 2]) & (hsize - 1);
+        prev[i] = head[h];
+        head[h] = (int32_t) i;
+      }
+    }
+  }
+
+  free(head);
+  free(prev);
+
+  return o;
+}
@@ -0,0 +1,134 @@
+#ifndef LUA_BUNDLE_H
+#define LUA_BUNDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Script bundle file layout (little-endian):
+//   [0..3]  LB_MAGIC
+//   [4]     Format version
+//   [5]     Flags (LB_FLAG_*)
+//   [6]     Window bits of the compressed payload
+//   [7]     Header length in bytes
+//   [8..11] Size of the binary chunk
+//   [12..15] Size of the payload following the header
+//   [16..19] Size of the line map following the payload (absent in 16-byte headers)
+#define LB_MAGIC "\x1bLBN"
+#define LB_MAGIC_LEN 4
+#define LB_VERSION 1
+#define LB_HEADER_MIN_LEN 16 // Header length of bundles without a line map field
+#define LB_HEADER_LEN 20
+
+// Bundle flags
+#define LB_FLAG_COMPRESSED 0x01 // Payload is LZ compressed
+#define LB_FLAG_STRIPPED 0x02 // Binary chunk was dumped without debug information
+#define LB_FLAG_LINEMAP 0x04 // A line map of the stripped chunk follows the payload
+
+// Script archive file layout (little-endian):
+//   [0..3]  LB_ARC_MAGIC
+//   [4]     Format version
+//   [5]     Index bits, the index has (1 << bits) buckets
+//   [6]     Reserved
+//   [7]     Header length in bytes
+//   [8..11] Number of modules
+//   [12..15] Size of the name table
+// The header is followed by the index buckets (LB_ENTRY_LEN bytes each,
+// open addressing on the module name hash), the NUL terminated module
+// names, and the module bundles at the offsets given by the index.
+#define LB_ARC_MAGIC "\x1bLBA"
+#define LB_ARC_VERSION 1
+#define LB_ARC_HEADER_LEN 16
+#define LB_ARC_MAX_BITS 16 // Largest index (65536 buckets)
+#define LB_ENTRY_LEN 16 // Index bucket: name hash, name offset, module offset, module size
+#define LB_ENTRY_EMPTY 0xFFFFFFFF // Name offset of an empty bucket
+
+// LZ codec parameters
+#define LB_MIN_WBITS 8 // Smallest window (256 bytes)
+#define LB_MAX_WBITS 12 // Largest window (4 KB), limited by the 12-bit match distance
+#define LB_DEF_WBITS 10 // Default window (1 KB of decoder RAM on the device)
+#define LB_MIN_MATCH 3 // Shortest back-reference
+#define LB_MAX_MATCH (LB_MIN_MATCH + 15) // Longest back-reference
+
+/**
+ * @brief Header of a script bundle
+ *
+ */
+struct LB_Header {
+  uint8_t version; // Format version
+  uint8_t flags; // Bundle flags
+  uint8_t wbits; // Window bits of the compressed payload
+  uint8_t hdr_len; // Header length in bytes
+  uint32_t raw_size; // Size of the binary chunk
+  uint32_t payload_size; // Size of the payload following the header
+  uint32_t map_size; // Size of the line map following the payload
+};
+
+/**
+ * @brief Header of a script archive
+ *
+ */
+struct LB_ArchiveHeader {
+  uint8_t version; // Format version
+  uint8_t index_bits; // Index bits, the index has (1 << index_bits) buckets
+  uint8_t hdr_len; // Header length in bytes
+  uint32_t nmodules; // Number of modules
+  uint32_t names_size; // Size of the name table
+};
+
+/**
+ * @brief Index entry of a module in a script archive
+ *
+ */
+struct LB_Entry {
+  uint32_t hash; // Hash of the module name
+  uint32_t name_ofs; // Offset of the module name in the name table
+  uint32_t offset; // Offset of the module bundle in the archive
+  uint32_t size; // Size of the module bundle
+};
+
+/**
+ * @brief State of a streaming LZ decoder writing into a ring window
+ *
+ */
+struct LB_Decoder {
+  uint8_t *win; // Ring window, also the output buffer handed to the Lua loader
+  uint32_t win_size; // Window size (power of 2)
+  uint32_t pos; // Write position in the window
+  uint32_t out_left; // Decoded bytes still to be produced
+  uint16_t copy_len; // Bytes left of the pending back-reference
+  uint16_t copy_dist; // Distance of the pending back-reference
+  uint8_t flags; // Token flags of the current group (1 = back-reference)
+  uint8_t nflags; // Tokens left in the current group
+  uint8_t b0; // First byte of a back-reference split across input chunks
+  bool have_b0; // Whether b0 holds a pending byte
+};
+
+/**
+ * @brief Encode and decode script bundles
+ *
+ */
+class LuaBundle {
+  public:
+
+  static bool LB_IsBundle(const uint8_t *buf, size_t len);
+  static bool LB_ReadHeader(const uint8_t *buf, size_t len, LB_Header *hdr);
+  static void LB_WriteHeader(const LB_Header *hdr, uint8_t *buf);
+
+  static void LB_DecoderInit(LB_Decoder *dec, uint8_t *win, uint8_t wbits, uint32_t raw_size);
+  static size_t LB_Decode(LB_Decoder *dec, const uint8_t **in, size_t *in_len, const uint8_t **out);
+
+  static int LB_MapLine(const uint8_t *map, size_t len, int protoid, int pc);
+
+  static bool LB_IsArchive(const uint8_t *buf, size_t len);
+  static bool LB_ReadArchiveHeader(const uint8_t *buf, size_t len, LB_ArchiveHeader *hdr);
+  static void LB_WriteArchiveHeader(const LB_ArchiveHeader *hdr, uint8_t *buf);
+  static uint32_t LB_Hash(const char *name);
+  static void LB_ReadEntry(const uint8_t *buf, LB_Entry *entry);
+  static void LB_WriteEntry(const LB_Entry *entry, uint8_t *buf);
+  static bool LB_FindModule(const uint8_t *index, const LB_ArchiveHeader *hdr, const char *name, LB_Entry *entry);
+
+  static size_t LB_CompressBound(size_t len);
+  static size_t LB_Compress(const uint8_t *src, size_t len, uint8_t wbits, uint8_t *dst);
+};
+
+#endif
@@ -0,0 +1,291 @@
+#include "LuaDSP/LuaDSP.h"
+#include <math.h>
+
+// Window function names for Lua scripts, indexed by LD_*
+static const char *const LD_WindowNames[] = {"hann", "hamming", "blackman", NULL};
+
+static const double LD_PI = 3.14159265358979323846;
+
+/**
+ * @brief Check whether a size is a power of 2
+ *
+ */
+static inline bool LD_IsPow2(uint32_t n) {
+  return n != 0 && (n & (n - 1)) == 0;
+}
+
+/**
+ * @brief cos(2 pi k / n) from the twiddles of a plan, for any k
+ *
+ * @param p Plan of n samples
+ * @param k Index, taken modulo n
+ * @return float Cosine
+ */
+static inline float LD_PlanCos(const LD_Plan *p, uint32_t k) {
+  k &= p->n - 1;
+  if (k > p->n / 2)
+    k = p->n - k;
+  return (k == p->n / 2) ? -1.0f : p->cos_t[k];
+}
+
+/**
+ * @brief Check that a function argument is a float32 array
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param idx Stack index of the argument
+ * @return LA_Array* Array
+ */
+LA_Array *LuaDSP::LD_CheckFloat(lua_State *L, int idx) {
+  LA_Array *a = (LA_Array *) luaL_checkudata(L, idx, LA_METATABLE);
+  luaL_argcheck(L, a->type == LA_FLOAT32, idx, "float32 array expected");
+  return a;
+}
+
+/**
+ * @brief Get the plan of an FFT size from the cache of the library, computing it on first use
+ *
+ * The cache is the first upvalue of the library functions and lives as long as the Lua state.
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param n Number of real samples, a power of 2 from 2 to LD_MAX_FFT
+ * @return LD_Plan* Plan, referenced by the cache
+ */
+LD_Plan *LuaDSP::LD_GetPlan(lua_State *L, uint32_t n) {
+  if (lua_rawgeti(L, lua_upvalueindex(1), (lua_Integer) n) == LUA_TUSERDATA) {
+    LD_Plan *p = (LD_Plan *) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return p;
+  }
+  lua_pop(L, 1);
+
+  uint32_t m = n / 2; // Points of the complex FFT
+  size_t hdr_sz = (sizeof(LD_Plan) + 7) & ~(size_t) 7;
+  LD_Plan *p = (LD_Plan *) lua_newuserdatauv(L, hdr_sz + (size_t) m * (2 * sizeof(float) + sizeof(uint32_t)), 0);
+  p->n = n;
+  p->cos_t = (float *) ((uint8_t *) p + hdr_sz);
+  p->sin_t = p->cos_t + m;
+  p->rev = (uint32_t *) (p->sin_t + m);
+
+  for (uint32_t k = 0; k < m; k++) {
+    p->cos_t[k] = (float) cos(2 * LD_PI * k / n);
+    p->sin_t[k] = (float) sin(2 * LD_PI * k / n);
+  }
+
+  uint32_t bits = 0;
+  while (((uint32_t) 1 << bits) < m)
+    bits++;
+  for (uint32_t i = 0; i < m; i++) {
+    uint32_t r = 0;
+    for (uint32_t b = 0; b < bits; b++)
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    p->rev[i] = r;
+  }
+
+  lua_rawseti(L, lua_upvalueindex(1), (lua_Integer) n);
+  return p;
+}
+
+/**
+ * @brief In-place radix-2 complex FFT of the n / 2 points of a plan, stored as interleaved real and imaginary parts
+ *
+ * @param p Plan
+ * @param x Points
+ */
+void LuaDSP::LD_ComplexFFT(const LD_Plan *p, float *x) {
+  uint32_t m = p->n / 2;
+
+  for (uint32_t i = 0; i < m; i++) {
+    uint32_t j = p->rev[i];
+    if (i < j) {
+      float re = x[2 * i], im = x[2 * i + 1];
+      x[2 * i] = x[2 * j];
+      x[2 * i + 1] = x[2 * j + 1];
+      x[2 * j] = re;
+      x[2 * j + 1] = im;
+    }
+  }
+
+  for (uint32_t size = 2; size <= m; size <<= 1) {
+    uint32_t half = size / 2;
+    uint32_t step = p->n / size; // Stride of the stage twiddles in the tables of n
+    for (uint32_t start = 0; start < m; start += size) {
+      float *a = x + 2 * start;
+      float *b = a + 2 * half;
+      for (uint32_t j = 0; j < half; j++) {
+        float wr = p->cos_t[j * step], wi = -p->sin_t[j * step];
+        float tr = wr * b[2 * j] - wi * b[2 * j + 1];
+        float ti = wr * b[2 * j + 1] + wi * b[2 * j];
+        b[2 * j] = a[2 * j] - tr;
+        b[2 * j + 1] = a[2 * j + 1] - ti;
+        a[2 * j] += tr;
+        a[2 * j + 1] += ti;
+      }
+    }
+  }
+}
+
+/**
+ * @brief dsp.window(a [, kind]): multiply a float32 array in place by a periodic window, "hann" (default),
+ * "hamming" or "blackman"
+ *
+ * Power of 2 sizes up to LD_MAX_FFT read the cosines from the cached FFT plan.
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the array
+ */
+int LuaDSP::LD_Window(lua_State *L) {
+  LA_Array *a = LD_CheckFloat(L, 1);
+  int kind = luaL_checkoption(L, 2, "hann", LD_WindowNames);
+  uint32_t n = a->len;
+  float *x = (float *) a->data;
+  const LD_Plan *p = (n >= 2 && n <= LD_MAX_FFT && LD_IsPow2(n)) ? LD_GetPlan(L, n) : NULL;
+
+  for (uint32_t i = 0; i < n; i++) {
+    float c1 = p ? LD_PlanCos(p, i) : (float) cos(2 * LD_PI * i / n);
+    float w;
+    if (kind == LD_HANN)
+      w = 0.5f - 0.5f * c1;
+    else if (kind == LD_HAMMING)
+      w = 0.54f - 0.46f * c1;
+    else {
+      float c2 = p ? LD_PlanCos(p, 2 * i) : (float) cos(4 * LD_PI * i / n);
+      w = 0.42f - 0.5f * c1 + 0.08f * c2;
+    }
+    x[i] *= w;
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+/**
+ * @brief dsp.fft(a): in-place real FFT of a float32 array of a power of 2 size from 2 to LD_MAX_FFT
+ *
+ * The spectrum is packed in the n samples: a[1] holds bin 0 and a[2] bin n / 2, both real, then
+ * a[2k + 1] and a[2k + 2] hold the real and imaginary parts of bin k, for 0 < k < n / 2. Bins are
+ * not normalised: a sine of amplitude A on bin k gives a magnitude of A * n / 2.
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the array
+ */
+int LuaDSP::LD_FFT(lua_State *L) {
+  LA_Array *a = LD_CheckFloat(L, 1);
+  uint32_t n = a->len;
+  if (n < 2 || n > LD_MAX_FFT || !LD_IsPow2(n))
+    return luaL_argerror(L, 1, lua_pushfstring(L, "size must be a power of 2 from 2 to %d", LD_MAX_FFT));
+  const LD_Plan *p = LD_GetPlan(L, n);
+  float *x = (float *) a->data;
+  uint32_t m = n / 2;
+
+  LD_ComplexFFT(p, x);
+
+  // Split the spectrum of the even and odd samples into the spectrum of the real signal
+  float z0r = x[0], z0i = x[1];
+  x[0] = z0r + z0i;
+  x[1] = z0r - z0i;
+  for (uint32_t k = 1; k <= m / 2; k++) {
+    uint32_t mk = m - k;
+    float er = 0.5f * (x[2 * k] + x[2 * mk]), ei = 0.5f * (x[2 * k + 1] - x[2 * mk + 1]);
+    float or_ = 0.5f * (x[2 * k] - x[2 * mk]), oi = 0.5f * (x[2 * k + 1] + x[2 * mk + 1]);
+    float wr = p->cos_t[k], wi = -p->sin_t[k];
+    float tr = wr * or_ - wi * oi, ti = wr * oi + wi * or_;
+    x[2 * k] = er + ti;
+    x[2 * k + 1] = ei - tr;
+    x[2 * mk] = er - ti;
+    x[2 * mk + 1] = -ei - tr;
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+/**
+ * @brief dsp.magnitude(a [, out]): magnitudes of the n / 2 + 1 bins of a packed spectrum from dsp.fft, written to
+ * the float32 array out from its first element, or in place over the first elements of a
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the array holding the magnitudes
+ */
+int LuaDSP::LD_Magnitude(lua_State *L) {
+  LA_Array *a = LD_CheckFloat(L, 1);
+  uint32_t m = a->len / 2;
+  luaL_argcheck(L, a->len >= 2 && a->len % 2 == 0, 1, "packed spectrum expected");
+  LA_Array *out = a;
+  if (!lua_isnoneornil(L, 2)) {
+    out = LD_CheckFloat(L, 2);
+    luaL_argcheck(L, out->len >= m + 1, 2, "array too short");
+  }
+  const float *x = (const float *) a->data;
+  float *y = (float *) out->data;
+
+  // In place, bin k is written over the parts of bin k / 2, already read
+  float dc = fabsf(x[0]), nyquist = fabsf(x[1]);
+  for (uint32_t k = 1; k < m; k++)
+    y[k] = sqrtf(x[2 * k] * x[2 * k] + x[2 * k + 1] * x[2 * k + 1]);
+  y[0] = dc;
+  y[m] = nyquist;
+
+  lua_settop(L, lua_isnoneornil(L, 2) ? 1 : 2);
+  return 1;
+}
+
+/**
+ * @brief dsp.goertzel(a, freq, rate): magnitude of the spectrum of a float32 array at one frequency
+ *
+ * The frequency needs not fall on an FFT bin. On bin k (freq = k * rate / n) the result equals the
+ * magnitude dsp.fft gives for that bin. The recurrence runs in Reinsch's form, on the difference (or
+ * sum) of the successive states, which stays accurate in float near 0 and the Nyquist frequency.
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the magnitude
+ */
+int LuaDSP::LD_Goertzel(lua_State *L) {
+  LA_Array *a = LD_CheckFloat(L, 1);
+  lua_Number freq = luaL_checknumber(L, 2);
+  lua_Number rate = luaL_checknumber(L, 3);
+  luaL_argcheck(L, rate > 0, 3, "sample rate must be positive");
+  const float *x = (const float *) a->data;
+  double w = 2 * LD_PI * freq / rate;
+
+  // Goertzel: s[i] = x[i] + 2 cos(w) s[i - 1] - s[i - 2], with d[i] = s[i] -/+ s[i - 1]
+  bool low = cos(w) >= 0;
+  float lambda = low ? (float) (-4 * sin(w / 2) * sin(w / 2)) : (float) (4 * cos(w / 2) * cos(w / 2));
+  float s = 0, d = 0;
+  if (low) {
+    for (uint32_t i = 0; i < a->len; i++) {
+      d = x[i] + lambda * s + d;
+      s = s + d;
+    }
+  }
+  else {
+    for (uint32_t i = 0; i < a->len; i++) {
+      d = x[i] + lambda * s - d;
+      s = d - s;
+    }
+  }
+  float power = d * d - lambda * s * (low ? s - d : d - s); // s1^2 + s2^2 - 2 cos(w) s1 s2
+
+  lua_pushnumber(L, (lua_Number) sqrtf(power > 0 ? power : 0));
+  return 1;
+}
+
+/**
+ * @brief Open the library of signal processing kernels, for luaL_requiref
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the library table
+ */
+int LuaDSP::LD_Open(lua_State *L) {
+  static const luaL_Reg lib[] = {
+    {"window", LD_Window},
+    {"fft", LD_FFT},
+    {"magnitude", LD_Magnitude},
+    {"goertzel", LD_Goertzel},
+    {NULL, NULL}
+  };
+
+  luaL_newlibtable(L, lib);
+  lua_newtable(L); // Cache of the FFT plans, by size
+  luaL_setfuncs(L, lib, 1);
+  return 1;
+}
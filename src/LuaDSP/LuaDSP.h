@@ -0,0 +1,55 @@
+#ifndef LUA_DSP_H
+#define LUA_DSP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "LuaArray/LuaArray.h"
+
+// Signal processing kernels for Lua scripts, working in place on the float32
+// arrays of the array library: windowing, real FFT, magnitude spectrum and
+// Goertzel single-bin detection
+
+// Largest FFT size, a power of 2
+#ifndef LD_MAX_FFT
+#define LD_MAX_FFT 4096
+#endif
+
+// Window functions, in the order of LD_WindowNames
+#define LD_HANN 0
+#define LD_HAMMING 1
+#define LD_BLACKMAN 2
+
+/**
+ * @brief FFT plan of one size, cached by the library: twiddles and bit-reversal permutation
+ *
+ * The real FFT of n samples runs as a complex FFT of n / 2 points followed by a split step.
+ */
+struct LD_Plan {
+  uint32_t n; // Number of real samples
+  float *cos_t; // cos(2 pi k / n), k < n / 2
+  float *sin_t; // sin(2 pi k / n), k < n / 2
+  uint32_t *rev; // Bit-reversed index of each of the n / 2 complex points
+};
+
+/**
+ * @brief Lua library of signal processing kernels
+ *
+ */
+class LuaDSP {
+  private:
+
+  static LA_Array *LD_CheckFloat(lua_State *L, int idx);
+  static LD_Plan *LD_GetPlan(lua_State *L, uint32_t n);
+  static void LD_ComplexFFT(const LD_Plan *p, float *x);
+
+  static int LD_Window(lua_State *L);
+  static int LD_FFT(lua_State *L);
+  static int LD_Magnitude(lua_State *L);
+  static int LD_Goertzel(lua_State *L);
+
+  public:
+
+  static int LD_Open(lua_State *L);
+};
+
+#endif
@@ -3,7 +3,7 @@
 // Initialize static data members
 //Inp_Out *LuaEngine::IO;
 uint16_t LuaEngine::maxBuffSize;
-//std::atomic<uint16_t> LuaEngine::LuaBuffID;
+std::atomic<uint16_t> LuaEngine::LuaBuffID;
 std::atomic<float> *LuaEngine::LuaBuffVar;
 std::atomic<bool> LuaEngine::LuaNotifyWriteWait;
 std::atomic<bool> LuaEngine::LuaScriptRestart;
@@ -12,6 +12,9 @@ std::atomic<uint8_t> LuaEngine::Lua_Shed_Stat;
 //std::atomic<float> LuaEngine::Action_CmdVAL;
 //std::atomic<int8_t> LuaEngine::ARS_Stat;
 std::atomic<bool> LuaEngine::LuaNotifyReadWait;
+std::atomic<bool> LuaEngine::LuaSimClock;
+std::atomic<uint32_t> LuaEngine::LuaSimMillis;
+std::atomic<uint32_t> LuaEngine::LuaSimEnd;
 
 
 /**
@@ -20,23 +23,71 @@ std::atomic<bool> LuaEngine::LuaNotifyReadWait;
  * @param lua_state Pointer to Lua interpreter state
  * @return int Status for Lua interpreter
  */
-uint8_t LuaEngine::LuaFunc_Millis(lua_State *lua_state) {
-  lua_pushinteger(lua_state, millis());
+int LuaEngine::LuaFunc_Millis(lua_State *lua_state) {
+  if (LuaSimClock)
+    lua_pushinteger(lua_state, LuaSimMillis.load());
+  else
+    lua_pushinteger(lua_state, millis());
   return 1;
 }
 
+#if LUA_FAST_BINDINGS
+/**
+ * @brief Fast variant of millis(), signature ">i"
+ * 
+ * @param v Results of the call
+ * @return int 0, the call is never declined
+ */
+int LuaEngine::LuaFast_Millis(lua_FastValue *v) {
+  v[0].i = LuaSimClock ? LuaSimMillis.load() : millis();
+  return 0;
+}
+#endif
+
 /**
- * @brief Block Lua task for a specified duration
+ * @brief Block Lua task for a specified duration, or advance the simulated clock to the wakeup time
  * 
  * @param lua_state Pointer to Lua interpreter state
  * @return int Status for Lua interpreter
  */
-uint8_t LuaEngine::LuaFunc_Delay(lua_State *lua_state) {
+int LuaEngine::LuaFunc_Delay(lua_State *lua_state) {
   int delay_ms = luaL_checkinteger(lua_state, 1);
-  delay(delay_ms);
+  if (!LuaSimClock) {
+    delay(delay_ms);
+    return 0;
+  }
+
+  uint32_t wakeup = LuaSimMillis + (delay_ms > 0 ? delay_ms : 0);
+  if (LuaSimEnd != 0 && wakeup >= LuaSimEnd) {
+    LuaSimMillis = LuaSimEnd.load();
+    return luaL_error(lua_state, LUA_SIM_END_MSG " at %I ms", (LUAI_UACINT) LuaSimEnd);
+  }
+  LuaSimMillis = wakeup;
   return 0;
 }
 
+#if LUA_FAST_BINDINGS
+/**
+ * @brief Fast variant of delay(), signature "i>"
+ * 
+ * @param v Arguments of the call
+ * @return int 1 to decline the call when it ends the simulation, which raises the error in LuaFunc_Delay
+ */
+int LuaEngine::LuaFast_Delay(lua_FastValue *v) {
+  int delay_ms = v[0].i;
+  if (!LuaSimClock) {
+    delay(delay_ms);
+    return 0;
+  }
+
+  uint32_t wakeup = LuaSimMillis + (delay_ms > 0 ? delay_ms : 0);
+  if (LuaSimEnd != 0 && wakeup >= LuaSimEnd)
+    return 1;
+  LuaSimMillis = wakeup;
+  return 0;
+}
+#endif
+
 int LuaEngine::LuaFunc_Print(lua_State *L) {
   int n = lua_gettop(L); // Number of arguments
   int i;
@@ -65,7 +116,7 @@ int LuaEngine::LuaFunc_Print(lua_State *L) {
  * @param lua_state Pointer to Lua interpreter state
  * @return int Status for Lua interpreter
  */
-uint8_t LuaEngine::LunFunc_ScriptRestart(lua_State *lua_state) {
+int LuaEngine::LunFunc_ScriptRestart(lua_State *lua_state) {
   if (LuaScriptRestart == 1)
     lua_pushboolean(lua_state, 1);
   else
@@ -74,13 +125,26 @@ uint8_t LuaEngine::LunFunc_ScriptRestart(lua_State *lua_state) {
   return 1;
 }
 
+#if LUA_FAST_BINDINGS
+/**
+ * @brief Fast variant of Script_Restart(), signature ">b"
+ * 
+ * @param v Results of the call
+ * @return int 0, the call is never declined
+ */
+int LuaEngine::LuaFast_ScriptRestart(lua_FastValue *v) {
+  v[0].i = LuaScriptRestart == 1;
+  return 0;
+}
+#endif
+
 /**
  * @brief Update the int value in NVS
  * 
  * @param lua_state Pointer to Lua interpreter state
- * @return uint8_t value to update
+ * @return int Number of results for Lua interpreter
  */
-uint8_t LuaEngine::LuaFunc_NVS_WriteInt(lua_State *lua_state){
+int LuaEngine::LuaFunc_NVS_WriteInt(lua_State *lua_state){
   const char *nvs_key = luaL_checkstring(lua_state, 1); // Key in NVS to increment
   int val = luaL_checkinteger(lua_state, 2); // Value to Write
   
@@ -104,15 +168,34 @@ uint8_t LuaEngine::LuaFunc_NVS_WriteInt(lua_State *lua_state){
  * @param luaWrap Object to Lua wrapper
  */
 void LuaEngine::Lua_TaskMapFunc(LuaWrapper &LW) {
+#if LUA_FAST_BINDINGS
+  LW.LW_RegisterFastFunc(Lua_Millis_FuncName, (const lua_CFunction) &LuaFunc_Millis, &LuaFast_Millis, ">i");
+  LW.LW_RegisterFastFunc(Lua_Delay_FuncName, (const lua_CFunction) &LuaFunc_Delay, &LuaFast_Delay, "i>");
+#else
   LW.LW_RegisterFunc(Lua_Millis_FuncName, (const lua_CFunction) &LuaFunc_Millis);
   LW.LW_RegisterFunc(Lua_Delay_FuncName, (const lua_CFunction) &LuaFunc_Delay);
+#endif
   LW.LW_RegisterFunc(Lua_Print_FuncName, (const lua_CFunction) &LuaFunc_Print);
-//  LW.LW_RegisterFunc(Lua_BuffRead_FuncName, (const lua_CFunction) &LuaFunc_Read);
-//  LW.LW_RegisterFunc(Lua_BuffWriteWait_FuncName, (const lua_CFunction) &LuaFunc_WriteWait);
-//  LW.LW_RegisterFunc(Lua_BuffWriteNoWait_FuncName, (const lua_CFunction) &LuaFunc_WriteNoWait);
+#if LUA_FAST_BINDINGS
+  LW.LW_RegisterFastFunc(Lua_BuffRead_FuncName, (const lua_CFunction) &LuaFunc_Read, &LuaFast_Read, "i>n");
+#else
+  LW.LW_RegisterFunc(Lua_BuffRead_FuncName, (const lua_CFunction) &LuaFunc_Read);
+#endif
+  LW.LW_RegisterFunc(Lua_BuffWriteWait_FuncName, (const lua_CFunction) &LuaFunc_WriteWait);
+#if LUA_FAST_BINDINGS
+  LW.LW_RegisterFastFunc(Lua_BuffWriteNoWait_FuncName, (const lua_CFunction) &LuaFunc_WriteNoWait, &LuaFast_WriteNoWait,
+                         "in>");
+#else
+  LW.LW_RegisterFunc(Lua_BuffWriteNoWait_FuncName, (const lua_CFunction) &LuaFunc_WriteNoWait);
+#endif
 //  LW.LW_RegisterFunc(Lua_BuffRPC_FuncName, (const lua_CFunction) &LuaFunc_RPCRead);
 //  LW.LW_RegisterFunc(Lua_Time_FuncName, (const lua_CFunction) &LuaFunc_TimeVerify);
+#if LUA_FAST_BINDINGS
+  LW.LW_RegisterFastFunc(Lua_ScriptRestart_FuncName, (const lua_CFunction) &LunFunc_ScriptRestart,
+                         &LuaFast_ScriptRestart, ">b");
+#else
   LW.LW_RegisterFunc(Lua_ScriptRestart_FuncName, (const lua_CFunction) &LunFunc_ScriptRestart);
+#endif
 //  LW.LW_RegisterFunc(Lua_NVSIncrm_FuncName, (const lua_CFunction) &LuaFunc_NVS_Incrm);
 //  LW.LW_RegisterFunc(Lua_NVSGetMin_FuncName, (const lua_CFunction) &LuaFunc_NVS_GetMin);
   LW.LW_RegisterFunc(Lua_NVSGetVal_FuncNAme, (const lua_CFunction) &LuaFunc_NVS_GetVal);
@@ -123,25 +206,30 @@ void LuaEngine::Lua_TaskMapFunc(LuaWrapper &LW) {
 //  LW.LW_RegisterFunc(Lua_ActCMDReset, (const lua_CFunction) &LuaFunc_ActcmdReset);
   LW.LW_RegisterFunc(Lua_GC_full, (const lua_CFunction) &LuaFunc_GC_full);
 //  LW.LW_RegisterFunc(Lua_ARSStat, (const lua_CFunction) &LuaFunc_ARS_Stat);
-//  LW.LW_RegisterFunc(Lua_BuffReadWait_FuncName, (const lua_CFunction) &LuaFunc_ReadWait);
+  LW.LW_RegisterFunc(Lua_BuffReadWait_FuncName, (const lua_CFunction) &LuaFunc_ReadWait);
+#if LUA_ARRAY_LIB
+  LW.LW_OpenLib(Lua_Array_LibName, &LuaArray::LA_Open);
+#endif
+#if LUA_DSP_LIB
+  LW.LW_OpenLib(Lua_DSP_LibName, &LuaDSP::LD_Open);
+#endif
 }
 
 /**
- * @brief Allocate the shared buffer for Lua variables and create the Lua task
+ * @brief Allocate the shared buffer for Lua variables
  * 
  * @param LB_sz Number of elements to allocate
+ * @return true Buffer allocated
+ * @return false Allocation failed, LE_ERC is set to BUFF_FAIL
  */
-void LuaEngine::Lua_TaskAndBuffInit(uint16_t LB_sz) {
-  if (LE_ERC != NO_ERROR)
-    return;
-
+bool LuaEngine::Lua_BuffInit(uint16_t LB_sz) {
   LuaBuffVar = (std::atomic<float> *) calloc(LB_sz, sizeof(float));
     
   if (LuaBuffVar == NULL) {
     Serial.printf("Failed in dynamic allocation of Lua shared buffer\n");
     LE_ERC = BUFF_FAIL;
     maxBuffSize = 0;
-    return;
+    return false;
   }
 
   maxBuffSize = LB_sz;
@@ -150,6 +238,18 @@ void LuaEngine::Lua_TaskAndBuffInit(uint16_t LB_sz) {
   for (int i = 0; i < maxBuffSize; i++)
     LuaBuffVar[i] = -1;
 
+  return true;
+}
+
+/**
+ * @brief Allocate the shared buffer for Lua variables and create the Lua task
+ * 
+ * @param LB_sz Number of elements to allocate
+ */
+void LuaEngine::Lua_TaskAndBuffInit(uint16_t LB_sz) {
+  if (LE_ERC != NO_ERROR || !Lua_BuffInit(LB_sz))
+    return;
+
   BaseType_t xTaskStatus = xTaskCreate(&Lua_Task, "lua_task", LUA_STACK_SIZE, this, LUA_TASK_PRIORITY, &Lua_TaskHandle);
   if (xTaskStatus != pdPASS) {
     Serial.printf("Failed in creation of Lua task\n");
@@ -158,6 +258,29 @@ void LuaEngine::Lua_TaskAndBuffInit(uint16_t LB_sz) {
   }
 }
 
+/**
+ * @brief Run the scripts on a simulated clock, which delay() advances straight to the wakeup time
+ * 
+ * @param enable Use the simulated clock, or the system clock when false
+ * @param start_ms Simulated time at start
+ * @param end_ms Simulated time at which delay() stops the script with an error, 0 to run without end
+ */
+void LuaEngine::Lua_SimClock(bool enable, uint32_t start_ms, uint32_t end_ms) {
+  LuaSimMillis = start_ms;
+  LuaSimEnd = end_ms;
+  LuaSimClock = enable;
+}
+
+/**
+ * @brief Check whether the simulated clock reached its end
+ * 
+ * @return true Simulation ended
+ * @return false Simulated clock is off, has no end or is still running
+ */
+bool LuaEngine::Lua_SimEnded() {
+  return LuaSimClock && LuaSimEnd != 0 && LuaSimMillis >= LuaSimEnd;
+}
+
 /**
  * @brief Lua task to handle the scripts
  * 
@@ -171,8 +294,24 @@ void LuaEngine::Lua_Task(void *pvParameters) {
   while (1) {
     LW.LW_ResetLVM();
     LE->Lua_TaskMapFunc(LW);
-    LW.LW_ExecuteFile(LF_Files_Path);
-    LW.LW_ExecuteFile(LM_Files_Path, 1);
+
+    // Reopen the archive on every start, so that an updated archive is picked up
+    if (LW.LW_OpenArchive(LE_Archive_Filename)) {
+      #if LUA_LINK_FUNC_SCRIPT
+      LW.LW_LinkModule(LF_ModuleName);
+      #else
+      LW.LW_ExecuteModule(LF_ModuleName);
+      #endif
+      LW.LW_ExecuteModule(LM_ModuleName, 1);
+    }
+    else {
+      #if LUA_LINK_FUNC_SCRIPT
+      LW.LW_LinkFile(LF_Filename);
+      #else
+      LW.LW_ExecuteFile(LF_Filename);
+      #endif
+      LW.LW_ExecuteFile(LM_Filename, 1);
+    }
 
     #if LUA_CHECK_HIGH_WATER_MARK
     Serial.printf("Lua task stack free: %u\n", uxTaskGetStackHighWaterMark(NULL));
@@ -181,8 +320,17 @@ void LuaEngine::Lua_Task(void *pvParameters) {
     // Reset RPC trigger
     if (LE->LuaScriptRestart == 1)
       LE->LuaScriptRestart = 0;
+
+    if (Lua_SimEnded()) {
+      Serial.printf("Lua task stopped, " LUA_SIM_END_MSG " at %u ms\n", (unsigned) LuaSimEnd);
+      LW.LW_CloseArchive(); // The task is deleted without leaving its scope
+      vTaskDelete(NULL);
+    }
     
-    delay(5000);
+    if (LuaSimClock)
+      LuaSimMillis += 5000;
+    else
+      delay(5000);
   }
 }
 
@@ -192,7 +340,7 @@ void LuaEngine::Lua_Task(void *pvParameters) {
  * @param lua_state Pointer to Lua interpreter state
  * @return int Status for Lua interpreter
  */
-uint8_t LuaEngine::LuaFunc_NVS_GetVal(lua_State *lua_state) {
+int LuaEngine::LuaFunc_NVS_GetVal(lua_State *lua_state) {
   const char *nvs_key = luaL_checkstring(lua_state, 1); // Key in NVS to get value of
 
   // Read from NVS
@@ -229,36 +377,67 @@ void LuaEngine::Lua_IO_Sync(LuaEngine &LE, Inp_Out &_Io){
 }
 */
 
+/**
+ * @brief Check a shared Lua buffer variable ID given by a script, before it is narrowed to LuaBuffID
+ * 
+ * @param id ID from 1 to maxBuffSize
+ * @return true ID in range
+ * @return false ID out of range
+ */
+bool LuaEngine::Lua_BuffIDValid(lua_Integer id) {
+  return id > 0 && id <= maxBuffSize;
+}
+
 /**
  * @brief Read from the shared Lua buffer variables
  * 
  * @param lua_state Pointer to Lua interpreter state
  * @return int Status for Lua interpreter
-
-uint8_t LuaEngine::LuaFunc_Read(lua_State *lua_state) {
-  LuaBuffID = luaL_checkinteger(lua_state, 1);
-  if (LuaBuffID > 0 && LuaBuffID <= maxBuffSize) {
-    lua_pushnumber(lua_state, LuaBuffVar[LuaBuffID - 1]);
+ */
+int LuaEngine::LuaFunc_Read(lua_State *lua_state) {
+  lua_Integer id = luaL_checkinteger(lua_state, 1);
+  if (Lua_BuffIDValid(id)) {
+    LuaBuffID = id;
+    lua_pushnumber(lua_state, LuaBuffVar[id - 1]);
     return 1;
   }
   else
     return 0;
 }
 
+#if LUA_FAST_BINDINGS
+/**
+ * @brief Fast variant of Buff_Read(), signature "i>n"
+ * 
+ * @param v Arguments and results of the call
+ * @return int 1 to decline the call for an ID out of range, which returns no value
+ */
+int LuaEngine::LuaFast_Read(lua_FastValue *v) {
+  if (Lua_BuffIDValid(v[0].i)) {
+    LuaBuffID = v[0].i;
+    v[0].n = LuaBuffVar[v[0].i - 1];
+    return 0;
+  }
+  else
+    return 1;
+}
+#endif
+
 /**
  * @brief Write to the shared Lua buffer variables, and wait until notified by another task
  * 
  * @param lua_state Pointer to Lua interpreter state
  * @return int Status for Lua interpreter
-
-uint8_t LuaEngine::LuaFunc_WriteWait(lua_State *lua_state) {
-  LuaBuffID = luaL_checkinteger(lua_state, 1);
-  if (LuaBuffID < 0 || LuaBuffID > maxBuffSize) {
+ */
+int LuaEngine::LuaFunc_WriteWait(lua_State *lua_state) {
+  lua_Integer id = luaL_checkinteger(lua_state, 1);
+  if (!Lua_BuffIDValid(id)) {
     lua_pushinteger(lua_state, LUA_WRITE_WRONG_ID);
     return 1;
   }
 
-  LuaBuffVar[LuaBuffID - 1] = luaL_checknumber(lua_state, 2);
+  LuaBuffID = id;
+  LuaBuffVar[id - 1] = luaL_checknumber(lua_state, 2);
   LuaNotifyWriteWait = 1; // Notify tasks that Lua task is waiting
 
   uint32_t notifyResp;
@@ -277,14 +456,33 @@ uint8_t LuaEngine::LuaFunc_WriteWait(lua_State *lua_state) {
  * 
  * @param lua_state Pointer to Lua interpreter state
  * @return int Status for Lua interpreter
+ */
+int LuaEngine::LuaFunc_WriteNoWait(lua_State *lua_state) {
+  lua_Integer id = luaL_checkinteger(lua_state, 1);
+  if (Lua_BuffIDValid(id)) {
+    LuaBuffID = id;
+    LuaBuffVar[id - 1] = luaL_checknumber(lua_state, 2);
+  }
 
-uint8_t LuaEngine::LuaFunc_WriteNoWait(lua_State *lua_state) {
-  LuaBuffID = luaL_checkinteger(lua_state, 1);
-  if (LuaBuffID > 0 && LuaBuffID <= maxBuffSize)
-    LuaBuffVar[LuaBuffID - 1] = luaL_checknumber(lua_state, 2);
+  return 0;
+}
+
+#if LUA_FAST_BINDINGS
+/**
+ * @brief Fast variant of Buff_Write_NoWait(), signature "in>"
+ * 
+ * @param v Arguments of the call
+ * @return int 0, the call is never declined
+ */
+int LuaEngine::LuaFast_WriteNoWait(lua_FastValue *v) {
+  if (Lua_BuffIDValid(v[0].i)) {
+    LuaBuffID = v[0].i;
+    LuaBuffVar[v[0].i - 1] = v[1].n;
+  }
 
   return 0;
 }
+#endif
 
 /**
  * @brief Check RPC command values in shared Lua buffer
@@ -526,9 +724,9 @@ uint8_t LuaEngine::LuaFunc_ActcmdReset(lua_State *lua_state){
  * @brief Garbage Collection full 
  * 
  * @param lua_state Pointer to Lua interpreter state
- * @return uint8_t Status for Lua interpreter
+ * @return int Status for Lua interpreter
  */
-uint8_t LuaEngine::LuaFunc_GC_full(lua_State *lua_state){
+int LuaEngine::LuaFunc_GC_full(lua_State *lua_state){
   LuaC_gcfull(lua_state);
   return 1;
 }
@@ -543,6 +741,7 @@ uint8_t LuaEngine::LuaFunc_ARS_Stat(lua_State *lua_state){
   ARS_Stat = luaL_checknumber(lua_state, 1);
   return 1;
 }
+*/
 
 
 /**
@@ -550,11 +749,11 @@ uint8_t LuaEngine::LuaFunc_ARS_Stat(lua_State *lua_state){
  * 
  * @param lua_state Pointer to Lua interpreter state
  * @return int int Status for Lua interpreter
-
+ */
 int LuaEngine::LuaFunc_ReadWait(lua_State *lua_state) {
-  LuaBuffID = luaL_checkinteger(lua_state, 1);
+  lua_Integer id = luaL_checkinteger(lua_state, 1);
 
-  if (LuaBuffID < 0 || LuaBuffID > maxBuffSize) {
+  if (!Lua_BuffIDValid(id)) {
     Serial.print("\n Wrong Lua BufID1");
     lua_pushinteger(lua_state, LUA_WRITE_WRONG_ID);
     lua_pushinteger(lua_state, NO_DAT);
@@ -562,12 +761,13 @@ int LuaEngine::LuaFunc_ReadWait(lua_State *lua_state) {
   }
 
   else {
+    LuaBuffID = id;
     LuaNotifyReadWait = 1;
     uint32_t notifyResp;
 
     if (xTaskNotifyWait(0, 0, &notifyResp, portMAX_DELAY) == pdTRUE){ // Received notification
       lua_pushinteger(lua_state, notifyResp);
-      lua_pushinteger(lua_state, LuaBuffVar[LuaBuffID - 1]);
+      lua_pushinteger(lua_state, LuaBuffVar[id - 1]);
     }
 
     else{
@@ -580,6 +780,7 @@ int LuaEngine::LuaFunc_ReadWait(lua_State *lua_state) {
   }
 }
 
+/*
 /**
  * @brief Input Cmd variables
  * 
@@ -2,12 +2,12 @@
 #define LuaEngine_Lib_h
 
 
-#include <Arduino.h>
+#include "LE_Port/LE_Port.h"
 #include <atomic>
 #include "LuaWrapper/LuaWrapper.h"
+#include "LuaArray/LuaArray.h"
+#include "LuaDSP/LuaDSP.h"
 #include <ArduinoJson.h>
-#include <Preferences.h>
-#include "SPIFFS.h"
 
 // Lua script functions mapping names
 
@@ -21,12 +21,15 @@
 #define Lua_GC_full "Grb_collect" 
 #define Lua_NVSGetVal_FuncNAme "NVS_GetVal"
 #define Lua_NVSWriteInt_FuncNAme "NVS_WriteInt"
-
-/*
-#define Lua_Time_FuncName "Time_Trig"
 #define Lua_BuffRead_FuncName "Buff_Read"
 #define Lua_BuffWriteWait_FuncName "Buff_Write_Wait"
 #define Lua_BuffWriteNoWait_FuncName "Buff_Write_NoWait"
+#define Lua_BuffReadWait_FuncName "Buff_Read_Wait"
+#define Lua_Array_LibName "array"
+#define Lua_DSP_LibName "dsp"
+
+/*
+#define Lua_Time_FuncName "Time_Trig"
 #define Lua_BuffRPC_FuncName "RPC_Cmd"
 #define Lua_NVSIncrm_FuncName "NVS_Incrm"
 #define Lua_NVSGetMin_FuncName "NVS_MinSel" 
@@ -35,7 +38,6 @@
 #define Lua_ReadActCmdVal "Read_ActCmdVal"
 #define Lua_ActCMDReset "ActCMD_Reset"
 #define Lua_ARSStat "ARS_Stat"
-#define Lua_BuffReadWait_FuncName "Buff_Read_Wait"
 */
 
 //Lua Function names
@@ -45,6 +47,11 @@
 #define LF_Files_Path "/spiffs" LF_Filename
 #define LM_Files_Path "/spiffs" LM_Filename
 
+// Script archive holding the Lua scripts as modules, used instead of the script files when present
+#define LE_Archive_Filename "/scripts.lba"
+#define LF_ModuleName "FuncScript"
+#define LM_ModuleName "MainScript"
+
 
 // Lua engine error codes
 #define NO_ERROR 0 // No error
@@ -57,6 +64,38 @@
 #define LUA_WRITE_NO_NOTIFY -1 // Timeout without notfication from any task
 #define LUA_WRITE_WRONG_ID -2 // Given Lua buffer ID is out of range
 
+// Error raised by delay() once the simulated clock reaches its end
+#define LUA_SIM_END_MSG "simulation ended"
+
+// Run FuncScript as a linked script: MainScript calls its functions directly, which requires FuncScript not to
+// assign other functions to the names of its functions once it has run
+#ifndef LUA_LINK_FUNC_SCRIPT
+#define LUA_LINK_FUNC_SCRIPT 0
+#endif
+
+// Register fast variants of the numeric bindings (millis, delay, Buff_Read, Buff_Write_NoWait, Script_Restart),
+// called by the interpreter without a call frame; needs LUA_USE_FASTCALL in luaconf.h, and follows it by default
+#ifndef LUA_FAST_BINDINGS
+#if defined(LUA_USE_FASTCALL)
+#define LUA_FAST_BINDINGS 1
+#else
+#define LUA_FAST_BINDINGS 0
+#endif
+#endif
+#if LUA_FAST_BINDINGS && !defined(LUA_USE_FASTCALL)
+#error "LUA_FAST_BINDINGS needs LUA_USE_FASTCALL"
+#endif
+
+// Open the library of typed numeric arrays (float32, int32, int16, uint8) with C kernels for their reductions
+#ifndef LUA_ARRAY_LIB
+#define LUA_ARRAY_LIB 1
+#endif
+
+// Open the library of signal processing kernels (window, FFT, magnitude spectrum, Goertzel) on float32 arrays
+#ifndef LUA_DSP_LIB
+#define LUA_DSP_LIB LUA_ARRAY_LIB
+#endif
+
 // Lua script NVS parameters
 #define LUA_NVS_HEADER "LUA_NVS"
 
@@ -73,22 +112,31 @@ class LuaEngine {
   private:
 
 // Internal Arduino functions
-  static uint8_t LuaFunc_Millis(lua_State *lua_state);
-  static uint8_t LuaFunc_Delay(lua_State *lua_state);
+  static int LuaFunc_Millis(lua_State *lua_state);
+  static int LuaFunc_Delay(lua_State *lua_state);
   static int LuaFunc_Print(lua_State *lua_state);
   
 // Additional functions
-  static uint8_t LunFunc_ScriptRestart(lua_State *lua_state);
-  static uint8_t LuaFunc_GC_full(lua_State *lua_state);
-  static uint8_t LuaFunc_NVS_WriteInt(lua_State *lua_state);
-  static uint8_t LuaFunc_NVS_GetVal(lua_State *lua_state);
+  static int LunFunc_ScriptRestart(lua_State *lua_state);
+  static int LuaFunc_GC_full(lua_State *lua_state);
+  static int LuaFunc_NVS_WriteInt(lua_State *lua_state);
+  static int LuaFunc_NVS_GetVal(lua_State *lua_state);
+  static int LuaFunc_Read(lua_State *lua_state);
+  static int LuaFunc_WriteWait(lua_State *lua_state);
+  static int LuaFunc_WriteNoWait(lua_State *lua_state);
+  static int LuaFunc_ReadWait(lua_State *lua_state);
+  static bool Lua_BuffIDValid(lua_Integer id);
 
-  void Lua_TaskMapFunc(LuaWrapper &LW);
+#if LUA_FAST_BINDINGS
+// Fast variants of the numeric functions
+  static int LuaFast_Millis(lua_FastValue *v);
+  static int LuaFast_Delay(lua_FastValue *v);
+  static int LuaFast_ScriptRestart(lua_FastValue *v);
+  static int LuaFast_Read(lua_FastValue *v);
+  static int LuaFast_WriteNoWait(lua_FastValue *v);
+#endif
 
 /*
-  static uint8_t LuaFunc_Read(lua_State *lua_state);
-  static uint8_t LuaFunc_WriteWait(lua_State *lua_state);
-  static uint8_t LuaFunc_WriteNoWait(lua_State *lua_state);
   static uint8_t LuaFunc_RPCRead(lua_State *lua_state);
   static uint8_t LuaFunc_TimeVerify(lua_State *lua_state);
   static uint8_t LuaFunc_NVS_Incrm(lua_State *lua_state);
@@ -99,7 +147,6 @@ class LuaEngine {
   static uint8_t LuaFunc_ReadActCmdVal(lua_State *lua_state);
   static uint8_t LuaFunc_ActcmdReset(lua_State *lua_state);
   static uint8_t LuaFunc_ARS_Stat(lua_State *lua_state);
-  static int LuaFunc_ReadWait(lua_State *lua_state);
 */
 
   public:
@@ -109,7 +156,7 @@ class LuaEngine {
   uint8_t LE_ERC; // Lua engine error code
 
   static uint16_t maxBuffSize; // Maximum number of elements in Lua buffer
-//  static std::atomic<uint16_t> LuaBuffID; // Shared Lua buffer variable ID
+  static std::atomic<uint16_t> LuaBuffID; // Shared Lua buffer variable ID
   static std::atomic<float> *LuaBuffVar; // Pointer to shared Lua buffer variables
   static std::atomic<bool> LuaNotifyWriteWait; // Boolean to notify other tasks that Lua task is blocked till write request is completed
 
@@ -121,6 +168,10 @@ class LuaEngine {
 //  static std::atomic<int8_t> ARS_Stat; // ARS Command
 
   static std::atomic<bool> LuaNotifyReadWait; // Boolean to notify other tasks that Lua task is blocked till Read request is completed
+
+  static std::atomic<bool> LuaSimClock; // Scripts run on the simulated clock instead of the system clock
+  static std::atomic<uint32_t> LuaSimMillis; // Simulated time in milliseconds
+  static std::atomic<uint32_t> LuaSimEnd; // Simulated time at which scripts are stopped, 0 to run without end
   
   /**
    * @brief Construct a new Lua Engine object
@@ -133,11 +184,16 @@ class LuaEngine {
 //    Action_CmdID = 0;
 //    Action_CmdVAL = -1;
     LuaNotifyReadWait = 0;
+    LuaSimClock = 0;
 //    ARS_Stat = -1;
   }
 
+  bool Lua_BuffInit(uint16_t LB_sz);
   void Lua_TaskAndBuffInit(uint16_t LB_sz);
+  void Lua_TaskMapFunc(LuaWrapper &LW);
   static void Lua_Task(void *pvParameters);
+  static void Lua_SimClock(bool enable, uint32_t start_ms = 0, uint32_t end_ms = 0);
+  static bool Lua_SimEnded();
   
   //void Lua_IO_Sync(LuaEngine &LE, Inp_Out &_Io);
   void Lua_IO_Sync(LuaEngine &LE);
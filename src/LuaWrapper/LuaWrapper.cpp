@@ -1,11 +1,75 @@
 #include "LuaWrapper/LuaWrapper.h"
 
 /**
- * @brief Start a new Lua virtual machine
+ * @brief Growable buffer receiving the line map of a text script
+ *
+ */
+struct LW_MapBuff {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+};
+
+/**
+ * @brief Lua allocator counting the blocks and bytes of the Lua heap
+ *
+ * @param ud Lua wrapper owning the state
+ * @param ptr Block to resize or free, NULL for a new block
+ * @param osize Current size of the block (object type when ptr is NULL)
+ * @param nsize Requested size, 0 to free the block
+ * @return void* Allocated block, NULL when freed or out of memory
+ */
+void *LuaWrapper::LW_Alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  LW_AllocStats *st = &((LuaWrapper *) ud)->_alloc_stats;
+  if (ptr == NULL)
+    osize = 0;
+
+  if (nsize == 0) {
+    if (ptr != NULL) {
+      st->frees++;
+      st->in_use -= osize;
+    }
+    free(ptr);
+    return NULL;
+  }
+
+  void *block = realloc(ptr, nsize);
+  if (block == NULL)
+    return NULL;
+
+  if (ptr == NULL)
+    st->allocs++;
+  else
+    st->reallocs++;
+  if (nsize > osize)
+    st->allocated += nsize - osize;
+  st->in_use += nsize - osize;
+  if (st->in_use > st->peak)
+    st->peak = st->in_use;
+  return block;
+}
+
+/**
+ * @brief Report an error raised outside of a protected call
+ *
+ * @param L Lua state
+ * @return int 0, letting Lua abort
+ */
+int LuaWrapper::LW_Panic(lua_State *L) {
+  const char *msg = lua_tostring(L, -1);
+  Serial.printf("# lua panic: unprotected error in call to Lua API (%s)\n", msg != NULL ? msg : "error object is not a string");
+  return 0;
+}
+
+/**
+ * @brief Start a new Lua virtual machine, closing the one already open
  * 
  */
 void LuaWrapper::LW_ResetLVM() {
-  _state = luaL_newstate();
+  LW_CloseLVM();
+  _state = lua_newstate(LW_Alloc, this);
+  lua_atpanic(_state, LW_Panic);
+  lua_setlinemap(_state, LW_MapLine, this);
 
   // Uncomment required libraries
   static const luaL_Reg loadedlibs[] = {
@@ -29,6 +93,11 @@ void LuaWrapper::LW_ResetLVM() {
     luaL_requiref(_state, lib->name, lib->func, 1);
     lua_pop(_state, 1);  /* remove lib */
   }
+
+  // Resolve "require" from the script archive
+  lua_pushlightuserdata(_state, this);
+  lua_pushcclosure(_state, LW_Require, 1);
+  lua_setglobal(_state, "require");
 }
 
 /**
@@ -41,20 +110,662 @@ void LuaWrapper::LW_RegisterFunc(const char *name, const lua_CFunction function)
   lua_register(_state, name, function);
 }
 
+/**
+ * @brief Open a C library in the Lua interpreter, as the standard libraries are
+ *
+ * @param name Global name of the library table
+ * @param open Function opening the library and returning its table
+ */
+void LuaWrapper::LW_OpenLib(const char *name, const lua_CFunction open) {
+  luaL_requiref(_state, name, open, 1);
+  lua_pop(_state, 1); // Remove library table
+}
+
+#if defined(LUA_USE_FASTCALL)
+/**
+ * @brief Register a C function handler together with a fast variant for plain numeric calls
+ *
+ * Calls from Lua with enough numeric arguments run the fast variant straight on the caller's registers, without
+ * a call frame; any other call, and any call the fast variant declines by returning nonzero, runs the handler.
+ * The signature lists the arguments, then '>' and the results: 'i' integer, 'n' float, 'b' boolean (results only).
+ *
+ * @param name Function name in Lua script
+ * @param function C function handler
+ * @param fast Fast variant of the handler, reading its arguments from and writing its results to the value array
+ * @param sig Signature of the fast variant, e.g. "i>n"
+ */
+void LuaWrapper::LW_RegisterFastFunc(const char *name, const lua_CFunction function, const lua_FastCFunction fast,
+                                     const char *sig) {
+  if (!lua_pushfastcfunction(_state, function, fast, sig))
+    Serial.printf("Invalid fast signature '%s' of '%s', registered as a plain C function\n", sig, name);
+  lua_setglobal(_state, name);
+}
+#endif
+
+/**
+ * @brief Declare the value on the top of the stack as a compile-time constant of the scripts loaded afterwards
+ *
+ * @param name Constant name in Lua scripts
+ */
+void LuaWrapper::LW_SetConst(const char *name) {
+  bool valid = (isalpha((unsigned char) name[0]) || name[0] == '_') && strcmp(name, "_ENV") != 0;
+  for (const char *c = name; valid && *c != '\0'; c++)
+    valid = isalnum((unsigned char) *c) || *c == '_';
+  if (!valid) {
+    Serial.printf("Invalid Lua constant name '%s'\n", name);
+    lua_pop(_state, 1);
+    return;
+  }
+
+  luaL_getsubtable(_state, LUA_REGISTRYINDEX, LUA_HOSTCONST_TABLE);
+  lua_insert(_state, -2);
+  lua_setfield(_state, -2, name);
+  lua_pop(_state, 1);
+}
+
+/**
+ * @brief Declare an integer constant of the scripts loaded afterwards
+ *
+ * Scripts read the constant like a `<const>` local of their main chunk: the value is built into the instructions
+ * and folded with other constants, and branches it disables are left out of the bytecode. Constants count against
+ * the limit of 200 locals of the main chunk.
+ *
+ * @param name Constant name in Lua scripts
+ * @param value Value of the constant
+ */
+void LuaWrapper::LW_DefineConst(const char *name, lua_Integer value) {
+  lua_pushinteger(_state, value);
+  LW_SetConst(name);
+}
+
+/**
+ * @brief Declare a float constant of the scripts loaded afterwards
+ *
+ * @param name Constant name in Lua scripts
+ * @param value Value of the constant
+ */
+void LuaWrapper::LW_DefineConst(const char *name, double value) {
+  lua_pushnumber(_state, (lua_Number) value);
+  LW_SetConst(name);
+}
+
+/**
+ * @brief Declare a boolean constant of the scripts loaded afterwards
+ *
+ * @param name Constant name in Lua scripts
+ * @param value Value of the constant
+ */
+void LuaWrapper::LW_DefineConst(const char *name, bool value) {
+  lua_pushboolean(_state, value);
+  LW_SetConst(name);
+}
+
+/**
+ * @brief Declare a string constant of the scripts loaded afterwards
+ *
+ * @param name Constant name in Lua scripts
+ * @param value Value of the constant
+ */
+void LuaWrapper::LW_DefineConst(const char *name, const char *value) {
+  lua_pushstring(_state, value);
+  LW_SetConst(name);
+}
+
+/**
+ * @brief Lua writer collecting the line map of a script in a heap buffer
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param p Pointer to the bytes to write
+ * @param sz Number of bytes to write
+ * @param ud Pointer to the line map buffer
+ * @return int 0 on success, 1 when out of memory
+ */
+int LuaWrapper::LW_WriteMap(lua_State *L, const void *p, size_t sz, void *ud) {
+  LW_MapBuff *b = (LW_MapBuff *) ud;
+  (void) L;
+
+  if (b->len + sz > b->cap) {
+    size_t cap = (b->cap == 0) ? 64 : b->cap;
+    while (cap < b->len + sz)
+      cap *= 2;
+    uint8_t *data = (uint8_t *) realloc(b->data, cap);
+    if (data == NULL)
+      return 1;
+    b->data = data;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, p, sz);
+  b->len += sz;
+
+  return 0;
+}
+
+/**
+ * @brief Line map hook finding the source line of a script whose debug information was dropped
+ *
+ * Called by the Lua core only while it formats an error or traceback. Bundle line maps
+ * are read from the filesystem at that time, so they take no RAM in between.
+ *
+ * @param ud Pointer to the Lua wrapper
+ * @param source Chunk name of the script
+ * @param protoid Index of the function prototype in the script
+ * @param pc Instruction index in the prototype
+ * @return int Source line, -1 if unknown
+ */
+int LuaWrapper::LW_MapLine(void *ud, const char *source, int protoid, int pc) {
+  LuaWrapper *lw = (LuaWrapper *) ud;
+  LW_LineMap *m = lw->_linemaps;
+
+  while (m != NULL && strcmp(m->source, source) != 0)
+    m = m->next;
+  if (m == NULL)
+    return -1;
+
+  if (m->data != NULL)
+    return LuaBundle::LB_MapLine(m->data, m->size, protoid, pc);
+
+  int line = -1;
+  File file = m->archived ? lw->_archive.file : lw->_fs->open(source + 1, FILE_READ); // Skip the '@' of the chunk name
+  uint8_t *data = (uint8_t *) malloc(m->size);
+  if (file && data != NULL && file.seek(m->offset) && file.read(data, m->size) == m->size)
+    line = LuaBundle::LB_MapLine(data, m->size, protoid, pc);
+  free(data);
+  if (file && !m->archived)
+    file.close();
+
+  return line;
+}
+
+/**
+ * @brief Register the line map of a loaded script, replacing the map of a previous load
+ *
+ * @param source Chunk name of the script
+ * @param data Line map in RAM, owned by the wrapper, or NULL to read it from the bundle file
+ * @param offset Offset of the line map in the bundle file
+ * @param size Size of the line map
+ * @param archived Line map is in the script archive
+ */
+void LuaWrapper::LW_AddLineMap(const char *source, uint8_t *data, uint32_t offset, uint32_t size, bool archived) {
+  LW_LineMap *m = _linemaps;
+  while (m != NULL && strcmp(m->source, source) != 0)
+    m = m->next;
+
+  if (m == NULL) {
+    m = (LW_LineMap *) malloc(sizeof(LW_LineMap));
+    char *name = (char *) malloc(strlen(source) + 1);
+    if (m == NULL || name == NULL) { // Errors will show unknown lines
+      free(m);
+      free(name);
+      free(data);
+      return;
+    }
+    strcpy(name, source);
+    m->source = name;
+    m->next = _linemaps;
+    _linemaps = m;
+  }
+  else
+    free(m->data);
+
+  m->data = data;
+  m->offset = offset;
+  m->size = size;
+  m->archived = archived;
+}
+
+/**
+ * @brief Free the line maps of the loaded scripts
+ *
+ */
+void LuaWrapper::LW_FreeLineMaps() {
+  while (_linemaps != NULL) {
+    LW_LineMap *m = _linemaps;
+    _linemaps = m->next;
+    free(m->source);
+    free(m->data);
+    free(m);
+  }
+}
+
+/**
+ * @brief Read the next block of the script file into the read-ahead buffer
+ *
+ * @param fr Pointer to the file reader state
+ * @return size_t Number of bytes read
+ */
+size_t LuaWrapper::LW_FillBuff(LW_FileReader *fr) {
+  size_t n = (fr->in_left < fr->buff_sz) ? fr->in_left : fr->buff_sz;
+  n = (n > 0) ? fr->file.read((uint8_t *) fr->buff, n) : 0;
+
+  fr->pre_ofs = 0;
+  fr->pre_len = n;
+  fr->in_left = (n > 0) ? fr->in_left - n : 0; // Stop at a short file
+
+  return n;
+}
+
+/**
+ * @brief Lua reader handing chunks of the script file to the loader
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param ud Pointer to the file reader state
+ * @param size Number of bytes returned
+ * @return const char* Pointer to the chunk, NULL at end of file
+ */
+const char *LuaWrapper::LW_ReadChunk(lua_State *L, void *ud, size_t *size) {
+  LW_FileReader *fr = (LW_FileReader *) ud;
+  (void) L;
+
+  if (!fr->compressed) {
+    if (fr->pre_len == 0)
+      LW_FillBuff(fr);
+    *size = fr->pre_len;
+    fr->pre_len = 0;
+    return (*size > 0) ? fr->buff + fr->pre_ofs : NULL;
+  }
+
+  // Compressed bundle: decode into the ring window, refilling the input as needed
+  while (1) {
+    if (fr->pre_len == 0 && fr->in_left > 0)
+      LW_FillBuff(fr);
+
+    const uint8_t *in = (const uint8_t *) fr->buff + fr->pre_ofs;
+    size_t in_len = fr->pre_len;
+    const uint8_t *out;
+
+    *size = LuaBundle::LB_Decode(&fr->dec, &in, &in_len, &out);
+    fr->pre_ofs += fr->pre_len - in_len;
+    fr->pre_len = in_len;
+
+    if (*size > 0)
+      return (const char *) out;
+    if (fr->dec.out_left == 0 || (fr->pre_len == 0 && fr->in_left == 0))
+      return NULL;
+  }
+}
+
+/**
+ * @brief Load a Lua script or script bundle from an open file and push it as a function on the stack
+ *
+ * The chunk name must be on top of the stack; it is replaced by the function or the error message.
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param file File positioned at the start of the script
+ * @param size Number of bytes of the script, UINT32_MAX to read until the end of the file
+ * @param archived Script is a module of the script archive
+ * @return int Lua status code, with the error message pushed on failure
+ */
+int LuaWrapper::LW_LoadStream(lua_State *L, File &file, uint32_t size, bool archived) {
+  LW_FileReader fr;
+  uint8_t *win = NULL; // Decoder window of a compressed bundle
+  const char *mode = NULL; // Accept text and binary chunks
+  const char *name = lua_tostring(L, -1) + 1; // Script name for messages, without the '@'
+  uint32_t base = file.position(); // Offset of the script in the file
+  uint32_t map_offset = 0; // Line map section of a stripped bundle
+  uint32_t map_size = 0;
+  int status = LUA_OK;
+
+  fr.file = file;
+  fr.buff_sz = LW_READ_BUFF_SIZE;
+  fr.buff = (char *) malloc(fr.buff_sz);
+  if (fr.buff == NULL) {
+    lua_pushfstring(L, "cannot allocate read buffer for %s", name);
+    lua_remove(L, -2);
+    return LUA_ERRMEM;
+  }
+
+  // Pre-read the first block to check the file header
+  fr.in_left = size;
+  fr.compressed = false;
+  LW_FillBuff(&fr);
+
+  if (LuaBundle::LB_IsBundle((const uint8_t *) fr.buff, fr.pre_len)) {
+    LB_Header hdr;
+
+    if (!LuaBundle::LB_ReadHeader((const uint8_t *) fr.buff, fr.pre_len, &hdr)) {
+      lua_pushfstring(L, "bad bundle header in %s", name);
+      status = LUA_ERRSYNTAX;
+    }
+    else {
+      // The payload follows the header, later sections are not handed to the loader
+      fr.pre_ofs = hdr.hdr_len;
+      fr.pre_len -= hdr.hdr_len;
+      if (fr.pre_len > hdr.payload_size)
+        fr.pre_len = hdr.payload_size;
+      fr.in_left = hdr.payload_size - fr.pre_len;
+      mode = "b";
+      map_offset = base + hdr.hdr_len + hdr.payload_size;
+      map_size = hdr.map_size;
+
+      if (hdr.flags & LB_FLAG_COMPRESSED) {
+        win = (uint8_t *) malloc((size_t) 1 << hdr.wbits);
+        if (win == NULL) {
+          lua_pushfstring(L, "cannot allocate decoder window for %s", name);
+          status = LUA_ERRMEM;
+        }
+        else {
+          LuaBundle::LB_DecoderInit(&fr.dec, win, hdr.wbits, hdr.raw_size);
+          fr.compressed = true;
+        }
+      }
+    }
+  }
+  else {
+    // Skip an optional UTF-8 BOM and '#' first line
+    if (fr.pre_len >= 3 && memcmp(fr.buff, "\xEF\xBB\xBF", 3) == 0) {
+      fr.pre_ofs = 3;
+      fr.pre_len -= 3;
+    }
+    if (fr.pre_len > 0 && fr.buff[fr.pre_ofs] == '#') {
+      // Keep the newline so that line numbers stay correct
+      while (fr.pre_len > 0 && fr.buff[fr.pre_ofs] != '\n') {
+        fr.pre_ofs++;
+        if (--fr.pre_len == 0)
+          LW_FillBuff(&fr);
+      }
+    }
+  }
+
+  if (status == LUA_OK)
+    status = lua_load(L, LW_ReadChunk, &fr, lua_tostring(L, -1), mode);
+
+  free(win);
+  free(fr.buff);
+
+  if (status == LUA_OK && map_size > 0) {
+    // Number the functions of the stripped chunk for its line map, left in the bundle file
+    lua_dropdebug(L, NULL, NULL);
+    LW_AddLineMap(lua_tostring(L, -2), NULL, map_offset, map_size, archived);
+  }
+#if LW_DROP_DEBUG
+  else if (status == LUA_OK && mode == NULL) {
+    // Replace the debug information of the text script with a compact line map
+    LW_MapBuff map = { NULL, 0, 0 };
+    if (lua_dropdebug(L, LW_WriteMap, &map) == 0) {
+      uint8_t *data = (map.len > 0) ? (uint8_t *) realloc(map.data, map.len) : NULL; // Trim the spare capacity
+      if (data != NULL)
+        map.data = data;
+      LW_AddLineMap(lua_tostring(L, -2), map.data, 0, map.len, archived);
+    }
+    else
+      free(map.data);
+  }
+#endif
+
+  if (status == LUA_OK) {
+    // Bind the calls to functions exported by linked scripts
+    if (lua_getfield(L, LUA_REGISTRYINDEX, LW_LINK_TABLE) == LUA_TTABLE) {
+      lua_pushvalue(L, -2);
+      lua_linkglobals(L, -2);
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1); // Remove export table
+  }
+
+  lua_remove(L, -2); // Remove chunk name
+
+  return status;
+}
+
+/**
+ * @brief Load a Lua script or script bundle from filesystem and push it as a function on the stack
+ *
+ * @param filename Filename on filesystem of the Lua script
+ * @return int Lua status code, with the error message pushed on failure
+ */
+int LuaWrapper::LW_LoadFile(const char *filename) {
+  File file = _fs->open(filename, FILE_READ);
+  if (!file || file.isDirectory()) {
+    lua_pushfstring(_state, "cannot open %s", filename);
+    return LUA_ERRFILE;
+  }
+
+  lua_pushfstring(_state, "@%s", filename); // Chunk name
+  int status = LW_LoadStream(_state, file, UINT32_MAX, false);
+  file.close();
+
+  return status;
+}
+
 /**
  * @brief Execute a Lua script from filesystem, and optionally close the session
- * 
+ *
  * @param filename Filename on filesystem to execute Lua script
  * @param close_LVM Bool to close the LVM session (default: false)
  */
 void LuaWrapper::LW_ExecuteFile(const char *filename, bool close_LVM) {
-  if (luaL_dofile(_state, filename)) {
+  if (LW_LoadFile(filename) != LUA_OK || lua_pcall(_state, 0, LUA_MULTRET, 0) != LUA_OK) {
     Serial.printf("# lua error: %s\n", lua_tostring(_state, -1));
     lua_pop(_state, 1);
   }
-  
+
   if (close_LVM == 1)
-    lua_close(_state);
+    LW_CloseLVM();
+}
+
+/**
+ * @brief Open a script archive and keep its index in RAM, so that modules are found without filesystem lookups
+ *
+ * @param filename Filename on filesystem of the script archive
+ * @return true The archive is open
+ */
+bool LuaWrapper::LW_OpenArchive(const char *filename) {
+  uint8_t buf[LB_ARC_HEADER_LEN];
+  LB_ArchiveHeader hdr;
+
+  LW_CloseArchive();
+
+  File file = _fs->open(filename, FILE_READ);
+  if (!file || file.isDirectory())
+    return false;
+
+  if (file.read(buf, sizeof(buf)) != sizeof(buf) || !LuaBundle::LB_ReadArchiveHeader(buf, sizeof(buf), &hdr)) {
+    Serial.printf("Bad script archive header in %s\n", filename);
+    file.close();
+    return false;
+  }
+
+  size_t index_sz = ((size_t) LB_ENTRY_LEN << hdr.index_bits) + hdr.names_size;
+  uint8_t *index = (uint8_t *) malloc(index_sz);
+  if (index == NULL) {
+    Serial.printf("Failed in dynamic allocation of script archive index\n");
+    file.close();
+    return false;
+  }
+
+  if (!file.seek(hdr.hdr_len) || file.read(index, index_sz) != index_sz ||
+      (hdr.names_size > 0 && index[index_sz - 1] != '\0')) { // Names must be terminated
+    Serial.printf("Bad script archive index in %s\n", filename);
+    free(index);
+    file.close();
+    return false;
+  }
+
+  _archive.file = file;
+  _archive.hdr = hdr;
+  _archive.index = index;
+
+  return true;
+}
+
+/**
+ * @brief Close the script archive
+ *
+ */
+void LuaWrapper::LW_CloseArchive() {
+  if (_archive.index == NULL)
+    return;
+
+  free(_archive.index);
+  _archive.index = NULL;
+  _archive.file.close();
+}
+
+/**
+ * @brief Load a module from the script archive and push it as a function on the stack
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param name Module name
+ * @return int Lua status code, with the error message pushed on failure
+ */
+int LuaWrapper::LW_LoadModule(lua_State *L, const char *name) {
+  LB_Entry entry;
+
+  if (_archive.index == NULL) {
+    lua_pushfstring(L, "no script archive to load module '%s' from", name);
+    return LUA_ERRFILE;
+  }
+  if (!LuaBundle::LB_FindModule(_archive.index, &_archive.hdr, name, &entry)) {
+    lua_pushfstring(L, "module '%s' not found in script archive", name);
+    return LUA_ERRFILE;
+  }
+  if (!_archive.file.seek(entry.offset)) {
+    lua_pushfstring(L, "cannot read module '%s' from script archive", name);
+    return LUA_ERRFILE;
+  }
+
+  lua_pushfstring(L, "@%s", name); // Chunk name
+  return LW_LoadStream(L, _archive.file, entry.size, true);
+}
+
+/**
+ * @brief Load a module from the script archive and push it as a function on the stack
+ *
+ * @param name Module name
+ * @return int Lua status code, with the error message pushed on failure
+ */
+int LuaWrapper::LW_LoadModule(const char *name) {
+  return LW_LoadModule(_state, name);
+}
+
+/**
+ * @brief Execute a module from the script archive, and optionally close the session
+ *
+ * @param name Module name
+ * @param close_LVM Bool to close the LVM session (default: false)
+ */
+void LuaWrapper::LW_ExecuteModule(const char *name, bool close_LVM) {
+  if (LW_LoadModule(_state, name) != LUA_OK || lua_pcall(_state, 0, LUA_MULTRET, 0) != LUA_OK) {
+    Serial.printf("# lua error: %s\n", lua_tostring(_state, -1));
+    lua_pop(_state, 1);
+  }
+
+  if (close_LVM == 1)
+    LW_CloseLVM();
+}
+
+/**
+ * @brief Run the loaded script on the top of the stack as a linked script, exporting the global functions it defines
+ *
+ * Scripts loaded afterwards call the exported functions directly instead of looking them up in the global table,
+ * so a linked script must not assign other functions to the names it exports once it has run.
+ *
+ * @return int Lua status code, with the error message pushed on failure
+ */
+int LuaWrapper::LW_LinkChunk() {
+  lua_State *L = _state;
+
+  // Snapshot the global functions defined before the script runs
+  lua_newtable(L);
+  lua_insert(L, -2);
+  lua_pushglobaltable(L);
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    if (lua_isfunction(L, -1)) {
+      lua_pushvalue(L, -2);
+      lua_insert(L, -2);
+      lua_rawset(L, -6);
+    }
+    else
+      lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+
+  int status = lua_pcall(L, 0, 0, 0);
+  if (status != LUA_OK) {
+    lua_remove(L, -2);
+    return status;
+  }
+
+  // Export the global functions the script defined or replaced
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LW_LINK_TABLE);
+  lua_pushglobaltable(L);
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    if (lua_type(L, -2) == LUA_TSTRING && lua_isfunction(L, -1)) {
+      lua_pushvalue(L, -2);
+      lua_rawget(L, -6);
+      if (!lua_rawequal(L, -1, -2)) {
+        lua_pushvalue(L, -3);
+        lua_pushvalue(L, -3);
+        lua_rawset(L, -7);
+      }
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 3);
+
+  return LUA_OK;
+}
+
+/**
+ * @brief Execute a Lua script from filesystem as a linked script, whose global functions are then called directly by
+ * the scripts loaded afterwards
+ *
+ * @param filename Filename on filesystem of the Lua script
+ */
+void LuaWrapper::LW_LinkFile(const char *filename) {
+  if (LW_LoadFile(filename) != LUA_OK || LW_LinkChunk() != LUA_OK) {
+    Serial.printf("# lua error: %s\n", lua_tostring(_state, -1));
+    lua_pop(_state, 1);
+  }
+}
+
+/**
+ * @brief Execute a module from the script archive as a linked script, whose global functions are then called directly
+ * by the scripts loaded afterwards
+ *
+ * @param name Module name
+ */
+void LuaWrapper::LW_LinkModule(const char *name) {
+  if (LW_LoadModule(_state, name) != LUA_OK || LW_LinkChunk() != LUA_OK) {
+    Serial.printf("# lua error: %s\n", lua_tostring(_state, -1));
+    lua_pop(_state, 1);
+  }
+}
+
+/**
+ * @brief Lua "require" loading modules from the script archive
+ *
+ * Loaded modules are kept in the registry table of loaded libraries, as the standard package library does.
+ *
+ * @param L Pointer to Lua interpreter state
+ * @return int Number of results: the module value
+ */
+int LuaWrapper::LW_Require(lua_State *L) {
+  LuaWrapper *lw = (LuaWrapper *) lua_touserdata(L, lua_upvalueindex(1));
+  const char *name = luaL_checkstring(L, 1);
+
+  lua_settop(L, 1);
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+  if (lua_getfield(L, 2, name) != LUA_TNIL) // Already loaded
+    return 1;
+  lua_pop(L, 1);
+
+  if (lw->LW_LoadModule(L, name) != LUA_OK)
+    return lua_error(L);
+
+  lua_pushvalue(L, 1); // Module name as argument
+  lua_call(L, 1, 1);
+  if (lua_isnil(L, -1)) { // Module returned no value
+    lua_pop(L, 1);
+    lua_pushboolean(L, 1);
+  }
+  lua_pushvalue(L, -1);
+  lua_setfield(L, 2, name);
+
+  return 1;
 }
 
 /**
@@ -63,4 +774,26 @@ void LuaWrapper::LW_ExecuteFile(const char *filename, bool close_LVM) {
  */
 void LuaWrapper::LW_GarbCollectFull(){
   LuaC_gcfull(_state);
+}
+
+/**
+ * @brief Close the Lua virtual machine and free the line maps of its scripts
+ *
+ */
+void LuaWrapper::LW_CloseLVM() {
+  if (_state == NULL)
+    return;
+  lua_close(_state);
+  _state = NULL;
+  LW_FreeLineMaps();
+}
+
+/**
+ * @brief Restart the allocation counters, keeping the bytes currently in use
+ *
+ */
+void LuaWrapper::LW_ResetAllocStats() {
+  size_t in_use = _alloc_stats.in_use;
+  memset(&_alloc_stats, 0, sizeof(_alloc_stats));
+  _alloc_stats.in_use = _alloc_stats.peak = in_use;
 }
\ No newline at end of file
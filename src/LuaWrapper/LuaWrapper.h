@@ -1,26 +1,152 @@
 #ifndef LUA_WRAPPER_H
 #define LUA_WRAPPER_H
 
-#include <Arduino.h>
+#include "LE_Port/LE_Port.h"
+#include "LuaBundle/LuaBundle.h"
 
 // #define LUA_USE_C89
-#include "LuaWrapper\lua\src\lua.hpp"
+#include "LuaWrapper/lua/src/lua.hpp"
+
+// Size of the heap read-ahead buffer used while loading scripts from the filesystem
+#ifndef LW_READ_BUFF_SIZE
+#define LW_READ_BUFF_SIZE 1024
+#endif
+
+// Drop the debug information of text scripts after loading, keeping a compact line map in RAM
+#ifndef LW_DROP_DEBUG
+#define LW_DROP_DEBUG 0
+#endif
+
+// Registry table of the functions exported by linked scripts
+#define LW_LINK_TABLE "_LW_EXPORTS"
+
+/**
+ * @brief State of a script being streamed from the filesystem to the Lua loader
+ *
+ */
+struct LW_FileReader {
+  File file; // Script file being read
+  char *buff; // Heap read-ahead buffer
+  size_t buff_sz; // Size of the read-ahead buffer
+  size_t pre_ofs; // Offset of pre-read bytes in the buffer
+  size_t pre_len; // Number of pre-read bytes still to be handed to the loader
+  uint32_t in_left; // Bytes still to be read from the file
+  bool compressed; // Script is a compressed bundle
+  LB_Decoder dec; // Decoder state of a compressed bundle
+};
+
+/**
+ * @brief Line map of a loaded script whose debug information was dropped
+ *
+ */
+struct LW_LineMap {
+  char *source; // Chunk name of the script
+  uint8_t *data; // Line map in RAM, or NULL when it is read from the bundle file
+  uint32_t offset; // Offset of the line map in the bundle file
+  uint32_t size; // Size of the line map
+  bool archived; // Line map is in the script archive instead of a bundle file
+  LW_LineMap *next;
+};
+
+/**
+ * @brief Script archive kept open while the wrapper runs scripts
+ *
+ */
+struct LW_Archive {
+  File file; // Archive file, opened once
+  LB_ArchiveHeader hdr; // Archive header
+  uint8_t *index; // Index buckets followed by the name table, NULL when no archive is open
+};
+
+/**
+ * @brief Allocation counters of the Lua heap, kept across LVM resets
+ *
+ */
+struct LW_AllocStats {
+  uint32_t allocs; // Blocks allocated
+  uint32_t reallocs; // Blocks resized
+  uint32_t frees; // Blocks freed
+  size_t allocated; // Bytes requested by allocations and by resizes growing a block
+  size_t in_use; // Bytes currently allocated
+  size_t peak; // Highest value of in_use since the last reset of the counters
+};
 
 /**
  * @brief Wrap Lua library for executing scripts
- * 
+ *
  */
 class LuaWrapper {
   private:
-  
+
   lua_State *_state;
+  fs::FS *_fs; // Filesystem holding the Lua scripts
+  LW_LineMap *_linemaps; // Line maps of the loaded scripts
+  LW_Archive _archive; // Script archive holding the modules
+  LW_AllocStats _alloc_stats; // Allocation counters of the Lua heap
+
+  static void *LW_Alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+  static int LW_Panic(lua_State *L);
+  static size_t LW_FillBuff(LW_FileReader *fr);
+  static const char *LW_ReadChunk(lua_State *L, void *ud, size_t *size);
+  static int LW_WriteMap(lua_State *L, const void *p, size_t sz, void *ud);
+  static int LW_MapLine(void *ud, const char *source, int protoid, int pc);
+  static int LW_Require(lua_State *L);
+  void LW_SetConst(const char *name);
+  int LW_LoadStream(lua_State *L, File &file, uint32_t size, bool archived);
+  int LW_LoadModule(lua_State *L, const char *name);
+  void LW_AddLineMap(const char *source, uint8_t *data, uint32_t offset, uint32_t size, bool archived);
+  void LW_FreeLineMaps();
 
   public:
 
+  /**
+   * @brief Construct a new Lua Wrapper object
+   *
+   * @param fs Filesystem to load Lua scripts from (default: SPIFFS)
+   */
+  LuaWrapper(fs::FS &fs = SPIFFS) {
+    _state = NULL;
+    _fs = &fs;
+    _linemaps = NULL;
+    _archive.index = NULL;
+    memset(&_alloc_stats, 0, sizeof(_alloc_stats));
+  }
+
+  /**
+   * @brief Destroy the Lua Wrapper object, closing its Lua virtual machine and script archive
+   *
+   */
+  ~LuaWrapper() {
+    LW_CloseLVM();
+    LW_FreeLineMaps();
+    LW_CloseArchive();
+  }
+
   void LW_ResetLVM();
+  void LW_CloseLVM();
   void LW_RegisterFunc(const char *name, const lua_CFunction function);
+  void LW_OpenLib(const char *name, const lua_CFunction open);
+#if defined(LUA_USE_FASTCALL)
+  void LW_RegisterFastFunc(const char *name, const lua_CFunction function, const lua_FastCFunction fast,
+                           const char *sig);
+#endif
+  void LW_DefineConst(const char *name, lua_Integer value);
+  void LW_DefineConst(const char *name, double value);
+  void LW_DefineConst(const char *name, bool value);
+  void LW_DefineConst(const char *name, const char *value);
+  int LW_LoadFile(const char *filename);
   void LW_ExecuteFile(const char *filename, bool close_LVM = 0);
+  bool LW_OpenArchive(const char *filename);
+  void LW_CloseArchive();
+  int LW_LoadModule(const char *name);
+  void LW_ExecuteModule(const char *name, bool close_LVM = 0);
+  int LW_LinkChunk();
+  void LW_LinkFile(const char *filename);
+  void LW_LinkModule(const char *name);
   void LW_GarbCollectFull();
+  lua_State *LW_GetState() { return _state; }
+  const LW_AllocStats &LW_GetAllocStats() { return _alloc_stats; }
+  void LW_ResetAllocStats();
 };
 
-#endif
\ No newline at end of file
+#endif
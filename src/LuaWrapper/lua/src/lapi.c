@@ -606,6 +606,54 @@ LUA_API void lua_pushcclosure (lua_State *L, lua_CFunction fn, int n) {
 }
 
 
+#if defined(LUA_USE_FASTCALL)
+/*
+** Push C function 'fn' with a fast variant 'fast', which the VM calls
+** instead of 'fn' for calls with the arguments described by 'sig': one
+** letter per argument, 'i' for an integer and 'n' for a number, then '>'
+** and one letter per result, 'i', 'n' or 'b' for a boolean (nonzero
+** 'i'). 'fast' returns 0 when done, or else the VM calls 'fn'. Returns 0
+** if 'sig' is not valid, in which case 'fn' has no fast variant.
+*/
+LUA_API int lua_pushfastcfunction (lua_State *L, lua_CFunction fn,
+                                   lua_FastCFunction fast, const char *sig) {
+  CClosure *cl;
+  int nargs = 0, nres = 0;
+  int intargs = 0, intres = 0, boolres = 0;
+  lua_lock(L);
+  for (; (*sig == 'i' || *sig == 'n') && nargs <= LUA_FASTMAX;
+         sig++, nargs++) {
+    if (*sig == 'i')
+      intargs |= 1 << nargs;
+  }
+  if (*sig == '>') {
+    for (sig++; (*sig == 'i' || *sig == 'n' || *sig == 'b') &&
+                nres <= LUA_FASTMAX; sig++, nres++) {
+      if (*sig == 'i')
+        intres |= 1 << nres;
+      else if (*sig == 'b')
+        boolres |= 1 << nres;
+    }
+  }
+  cl = luaF_newCclosure(L, 0);
+  cl->f = fn;
+  if (*sig == '\0' && nargs <= LUA_FASTMAX && nres <= LUA_FASTMAX) {
+    cl->fast = fast;
+    cl->nfargs = cast_byte(nargs);
+    cl->nfres = cast_byte(nres);
+    cl->fintargs = cast_byte(intargs);
+    cl->fintres = cast_byte(intres);
+    cl->fboolres = cast_byte(boolres);
+  }
+  setclCvalue(L, s2v(L->top), cl);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return (cl->fast != NULL);
+}
+#endif
+
+
 LUA_API void lua_pushboolean (lua_State *L, int b) {
   lua_lock(L);
   if (b)
@@ -766,7 +814,7 @@ LUA_API int lua_rawgetp (lua_State *L, int idx, const void *p) {
 LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
   Table *t;
   lua_lock(L);
-  t = luaH_new(L);
+  t = luaH_newrecord(L, nrec > 0 ? nrec : 0);
   sethvalue2s(L, L->top, t);
   api_incr_top(L);
   if (narray > 0 || nrec > 0)
@@ -1125,6 +1173,52 @@ LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data, int strip) {
 }
 
 
+/*
+** Drop the debug information of the function on the top of the stack,
+** passing its line map to 'writer' when given
+*/
+LUA_API int lua_dropdebug (lua_State *L, lua_Writer writer, void *data) {
+  int status;
+  TValue *o;
+  lua_lock(L);
+  api_checknelems(L, 1);
+  o = s2v(L->top - 1);
+  if (isLfunction(o))
+    status = luaG_dropdebug(L, getproto(o), writer, data);
+  else
+    status = 1;
+  lua_unlock(L);
+  return status;
+}
+
+
+/*
+** Bind the global reads of the main chunk on the top of the stack to the
+** functions of the table at index 'idx', turning them into constants.
+** Returns the number of reads bound, or -1 if the top is not a Lua
+** function.
+*/
+LUA_API int lua_linkglobals (lua_State *L, int idx) {
+  int n = -1;
+  TValue *o;
+  const TValue *t;
+  lua_lock(L);
+  api_checknelems(L, 1);
+  t = index2value(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  o = s2v(L->top - 1);
+  if (isLfunction(o)) {
+    Table *sets = luaH_new(L);
+    sethvalue2s(L, L->top, sets);  /* anchor it */
+    api_incr_top(L);
+    n = luaF_link(L, getproto(o), hvalue(t), sets);
+    L->top--;
+  }
+  lua_unlock(L);
+  return n;
+}
+
+
 LUA_API int lua_status (lua_State *L) {
   return L->status;
 }
@@ -1285,6 +1379,20 @@ LUA_API void lua_toclose (lua_State *L, int idx) {
 }
 
 
+/*
+** Number of instructions the interpreter dispatched in all threads of
+** the state, or 0 without LUA_USE_DISPATCHCOUNT
+*/
+LUA_API lua_Unsigned lua_dispatchcount (lua_State *L) {
+#if defined(LUA_USE_DISPATCHCOUNT)
+  return G(L)->ndispatch;
+#else
+  UNUSED(L);
+  return 0;
+#endif
+}
+
+
 LUA_API void lua_concat (lua_State *L, int n) {
   lua_lock(L);
   api_checknelems(L, n);
@@ -1335,6 +1443,14 @@ void lua_setwarnf (lua_State *L, lua_WarnFunction f, void *ud) {
 }
 
 
+void lua_setlinemap (lua_State *L, lua_LineMap f, void *ud) {
+  lua_lock(L);
+  G(L)->ud_linemap = ud;
+  G(L)->linemap = f;
+  lua_unlock(L);
+}
+
+
 void lua_warning (lua_State *L, const char *msg, int tocont) {
   lua_lock(L);
   luaE_warning(L, msg, tocont);
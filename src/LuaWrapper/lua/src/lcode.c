@@ -31,6 +31,9 @@
 #include "lvm.h"
 
 
+#if !defined(LUA_NO_PARSER)  /* { */
+
+
 /* Maximum number of registers in a Lua function (must fit in 8 bits) */
 #define MAXREGS		255
 
@@ -375,6 +378,19 @@ static void removelastinstruction (FuncState *fs) {
 }
 
 
+/*
+** Remove the instructions from 'pc' on, which never run. The line
+** information of the next instruction is absolute, as 'previousline'
+** does not follow removals of absolute entries.
+*/
+void luaK_truncate (FuncState *fs, int pc) {
+  while (fs->pc > pc)
+    removelastinstruction(fs);
+  fs->iwthabs = MAXIWTHABS + 1;
+  fs->lasttarget = pc;  /* no optimizations across the removed code */
+}
+
+
 /*
 ** Emit instruction 'i', checking for array sizes and saving also its
 ** line information. Return 'i' position.
@@ -1351,6 +1367,47 @@ static int constfolding (FuncState *fs, int op, expdesc *e1,
 }
 
 
+#if defined(LUA_USE_DEADBRANCH)
+
+/*
+** Try to "constant-fold" a comparison: numerals are compared by value,
+** strings only for equality (their order depends on the locale). The
+** first string of an equality is already a constant in 'k' (see
+** 'luaK_infix'). Returns 1 if successful, in which case 'e1' has the
+** result.
+*/
+static int comparefolding (FuncState *fs, BinOpr opr, expdesc *e1,
+                                          const expdesc *e2) {
+  lua_State *L = fs->ls->L;
+  TValue v1, v2;
+  int res;
+  if (tonumeral(e1, &v1) && tonumeral(e2, &v2)) {
+    switch (opr) {
+      case OPR_EQ: case OPR_NE: res = luaV_rawequalobj(&v1, &v2); break;
+      case OPR_LT: res = luaV_lessthan(L, &v1, &v2); break;
+      case OPR_LE: res = luaV_lessequal(L, &v1, &v2); break;
+      case OPR_GT: res = luaV_lessthan(L, &v2, &v1); break;
+      default: res = luaV_lessequal(L, &v2, &v1); break;  /* OPR_GE */
+    }
+  }
+  else if ((opr == OPR_EQ || opr == OPR_NE) && e1->k == VK &&
+           e2->k == VKSTR && !hasjumps(e2) &&
+           ttisstring(&fs->f->k[e1->u.info])) {
+    setsvalue(L, &v2, e2->u.strval);
+    res = luaV_rawequalobj(&fs->f->k[e1->u.info], &v2);
+  }
+  else
+    return 0;
+  if (opr == OPR_NE)
+    res = !res;
+  e1->k = res ? VTRUE : VFALSE;
+  e1->t = e1->f = NO_JUMP;
+  return 1;
+}
+
+#endif
+
+
 /*
 ** Emit code for unary expressions that "produce values"
 ** (everything but 'not').
@@ -1622,10 +1679,16 @@ void luaK_infix (FuncState *fs, BinOpr op, expdesc *v) {
     }
     case OPR_LT: case OPR_LE:
     case OPR_GT: case OPR_GE: {
+#if defined(LUA_USE_DEADBRANCH)
+      if (!tonumeral(v, NULL))
+        luaK_exp2anyreg(fs, v);
+      /* else keep numeral, which may be folded or an immediate operand */
+#else
       int dummy, dummy2;
       if (!isSCnumber(v, &dummy, &dummy2))
         luaK_exp2anyreg(fs, v);
       /* else keep numeral, which may be an immediate operand */
+#endif
       break;
     }
     default: lua_assert(0);
@@ -1662,6 +1725,10 @@ void luaK_posfix (FuncState *fs, BinOpr opr,
   luaK_dischargevars(fs, e2);
   if (foldbinop(opr) && constfolding(fs, opr + LUA_OPADD, e1, e2))
     return;  /* done by folding */
+#if defined(LUA_USE_DEADBRANCH)
+  if (opr >= OPR_EQ && opr <= OPR_GE && comparefolding(fs, opr, e1, e2))
+    return;  /* done by folding */
+#endif
   switch (opr) {
     case OPR_AND: {
       lua_assert(e1->t == NO_JUMP);  /* list closed by 'luaK_infix' */
@@ -1829,4 +1896,10 @@ void luaK_finish (FuncState *fs) {
       default: break;
     }
   }
+#if defined(LUA_USE_SUPERINSTR)
+  luaP_fusecode(p->code, fs->pc);
+#endif
 }
+
+#endif  /* } */
+
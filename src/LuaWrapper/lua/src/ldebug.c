@@ -21,6 +21,7 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lmem.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -95,8 +96,17 @@ int luaG_getfuncline (const Proto *f, int pc) {
 }
 
 
-static int getcurrentline (CallInfo *ci) {
-  return luaG_getfuncline(ci_func(ci)->p, currentpc(ci));
+/*
+** Get the current line of a Lua function; when its debug information
+** was dropped, ask the line map of the host, if any.
+*/
+static int getcurrentline (lua_State *L, CallInfo *ci) {
+  const Proto *p = ci_func(ci)->p;
+  if (p->lineinfo == NULL && p->mapid >= 0 && p->source != NULL &&
+      G(L)->linemap != NULL)
+    return (*G(L)->linemap)(G(L)->ud_linemap, getstr(p->source),
+                            p->mapid, currentpc(ci));
+  return luaG_getfuncline(p, currentpc(ci));
 }
 
 
@@ -334,7 +344,7 @@ static int auxgetinfo (lua_State *L, const char *what, lua_Debug *ar,
         break;
       }
       case 'l': {
-        ar->currentline = (ci && isLua(ci)) ? getcurrentline(ci) : -1;
+        ar->currentline = (ci && isLua(ci)) ? getcurrentline(L, ci) : -1;
         break;
       }
       case 'u': {
@@ -470,7 +480,7 @@ static int findsetreg (const Proto *p, int lastpc, int reg) {
     lastpc--;  /* previous instruction was not actually executed */
   for (pc = 0; pc < lastpc; pc++) {
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = luaP_baseop(GET_OPCODE(i));
     int a = GETARG_A(i);
     int change;  /* true if current instruction changed 'reg' */
     switch (op) {
@@ -533,7 +543,7 @@ static const char *getobjname (const Proto *p, int lastpc, int reg,
   pc = findsetreg(p, lastpc, reg);
   if (pc != -1) {  /* could find instruction? */
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = luaP_baseop(GET_OPCODE(i));
     switch (op) {
       case OP_MOVE: {
         int b = GETARG_B(i);  /* move from 'b' to 'a' */
@@ -595,7 +605,7 @@ static const char *funcnamefromcode (lua_State *L, const Proto *p,
                                      int pc, const char **name) {
   TMS tm = (TMS)0;  /* (initial value avoids warnings) */
   Instruction i = p->code[pc];  /* calling instruction */
-  switch (GET_OPCODE(i)) {
+  switch (luaP_baseop(GET_OPCODE(i))) {
     case OP_CALL:
     case OP_TAILCALL:
       return getobjname(p, pc, GETARG_A(i), name);  /* get function name */
@@ -825,7 +835,7 @@ l_noret luaG_runerror (lua_State *L, const char *fmt, ...) {
   msg = luaO_pushvfstring(L, fmt, argp);  /* format message */
   va_end(argp);
   if (isLua(ci))  /* if Lua function, add source:line information */
-    luaG_addinfo(L, msg, ci_func(ci)->p->source, getcurrentline(ci));
+    luaG_addinfo(L, msg, ci_func(ci)->p->source, getcurrentline(L, ci));
   luaG_errormsg(L);
 }
 
@@ -916,3 +926,109 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
   return 1;  /* keep 'trap' on */
 }
 
+
+
+/*
+** {======================================================
+** Dropping debug information
+** =======================================================
+*/
+
+/*
+** The line map of a chunk has one record per prototype, in pre-order
+** (the order of 'mapid'). A record is the number of entries followed
+** by the entries, each one a pc delta and a zigzag-encoded line delta
+** for an instruction where the line changes. Pcs and lines start at 0
+** and all numbers are unsigned LEB128 varints.
+*/
+
+static int writevarint (lua_State *L, unsigned int x, lua_Writer w,
+                                      void *data) {
+  lu_byte buff[(sizeof(unsigned int) * CHAR_BIT + 6) / 7];
+  int n = 0;
+  int status;
+  do {
+    buff[n++] = cast_byte((x & 0x7f) | ((x > 0x7f) ? 0x80 : 0));
+    x >>= 7;
+  } while (x != 0);
+  lua_unlock(L);
+  status = (*w)(L, buff, n, data);
+  lua_lock(L);
+  return status;
+}
+
+
+static int writelinemap (lua_State *L, const Proto *f, lua_Writer w,
+                                       void *data) {
+  int pass;
+  int i;
+  int status = 0;
+  for (pass = 0; pass < 2 && status == 0; pass++) {
+    int n = 0;  /* number of entries */
+    int lastpc = 0;
+    int lastline = 0;
+    int currentline = f->linedefined;
+    for (i = 0; i < f->sizelineinfo && status == 0; i++) {
+      currentline = (f->lineinfo[i] != ABSLINEINFO)
+                  ? currentline + f->lineinfo[i]
+                  : luaG_getfuncline(f, i);
+      if (currentline != lastline) {
+        if (pass == 1) {  /* write the entry */
+          int delta = currentline - lastline;
+          unsigned int zz = (delta < 0) ? (cast_uint(-delta) << 1) - 1
+                                        : cast_uint(delta) << 1;
+          status = writevarint(L, cast_uint(i - lastpc), w, data);
+          if (status == 0)
+            status = writevarint(L, zz, w, data);
+        }
+        lastpc = i;
+        lastline = currentline;
+        n++;
+      }
+    }
+    if (pass == 0)  /* first pass only counts the entries */
+      status = writevarint(L, cast_uint(n), w, data);
+  }
+  if (status == 0) {
+    for (i = 0; i < f->sizep && status == 0; i++)
+      status = writelinemap(L, f->p[i], w, data);
+  }
+  return status;
+}
+
+
+static void dropdebug (lua_State *L, Proto *f, int *id) {
+  int i;
+  f->mapid = (*id)++;
+  luaM_freearray(L, f->lineinfo, f->sizelineinfo);
+  f->lineinfo = NULL;
+  f->sizelineinfo = 0;
+  luaM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
+  f->abslineinfo = NULL;
+  f->sizeabslineinfo = 0;
+  luaM_freearray(L, f->locvars, f->sizelocvars);
+  f->locvars = NULL;
+  f->sizelocvars = 0;
+  for (i = 0; i < f->sizep; i++)
+    dropdebug(L, f->p[i], id);
+}
+
+
+/*
+** Free the line and local-variable information of 'f' and of its
+** nested functions, numbering them for the line map of the host. If
+** 'w' is given, it first receives the line map of the chunk; nothing
+** is dropped if it fails.
+*/
+int luaG_dropdebug (lua_State *L, Proto *f, lua_Writer w, void *data) {
+  int id = 0;
+  if (w != NULL) {
+    int status = writelinemap(L, f, w, data);
+    if (status != 0)
+      return status;
+  }
+  dropdebug(L, f, &id);
+  return 0;
+}
+
+/* }====================================================== */
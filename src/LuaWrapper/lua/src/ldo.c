@@ -968,7 +968,14 @@ static void f_parser (lua_State *L, void *ud) {
   }
   else {
     checkmode(L, p->mode, "text");
+#if defined(LUA_NO_PARSER)
+    luaO_pushfstring(L,
+       "attempt to load a text chunk (no parser in this build, "
+       "precompile it with luac)");
+    luaD_throw(L, LUA_ERRSYNTAX);
+#else
     cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
+#endif
   }
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luaF_initupvals(L, cl);
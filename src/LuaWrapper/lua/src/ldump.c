@@ -15,6 +15,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -99,7 +100,19 @@ static void dumpString (DumpState *D, const TString *s) {
 
 static void dumpCode (DumpState *D, const Proto *f) {
   dumpInt(D, f->sizecode);
+#if defined(LUA_USE_SUPERINSTR) || defined(LUA_USE_QUICKEN)
+  {  /* dump the standard opcodes; the loader fuses superinstructions again,
+        and quickened instructions are generic until they run */
+    int i;
+    for (i = 0; i < f->sizecode; i++) {
+      Instruction inst = f->code[i];
+      SET_OPCODE(inst, luaP_baseop(GET_OPCODE(inst)));
+      dumpVar(D, inst);
+    }
+  }
+#else
   dumpVector(D, f->code, f->sizecode);
+#endif
 }
 
 
@@ -124,6 +137,11 @@ static void dumpConstants (DumpState *D, const Proto *f) {
       case LUA_VLNGSTR:
         dumpString(D, tsvalue(o));
         break;
+      case LUA_VLCL:
+      case LUA_VLCF:
+      case LUA_VCCL:  /* bound by 'lua_linkglobals' */
+        D->status = 1;  /* cannot be dumped */
+        break;
       default:
         lua_assert(tt == LUA_VNIL || tt == LUA_VFALSE || tt == LUA_VTRUE);
     }
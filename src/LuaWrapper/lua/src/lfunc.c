@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <limits.h>
 #include <stddef.h>
 
 #include "lua.h"
@@ -20,7 +21,10 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
+#include "ltable.h"
+#include "lvm.h"
 
 
 
@@ -28,6 +32,9 @@ CClosure *luaF_newCclosure (lua_State *L, int nupvals) {
   GCObject *o = luaC_newobj(L, LUA_VCCL, sizeCclosure(nupvals));
   CClosure *c = gco2ccl(o);
   c->nupvalues = cast_byte(nupvals);
+#if defined(LUA_USE_FASTCALL)
+  c->fast = NULL;
+#endif
   return c;
 }
 
@@ -255,10 +262,23 @@ Proto *luaF_newproto (lua_State *L) {
   f->numparams = 0;
   f->is_vararg = 0;
   f->maxstacksize = 0;
+#if defined(LUA_USE_QUICKEN)
+  f->qbudget = LUAI_QUICKENBUDGET;
+#endif
   f->locvars = NULL;
   f->sizelocvars = 0;
   f->linedefined = 0;
   f->lastlinedefined = 0;
+  f->mapid = -1;
+#if defined(LUA_USE_INLINECACHE)
+  f->icache = NULL;
+  f->sizeicache = 0;
+  f->icindex = NULL;
+#endif
+#if defined(LUA_USE_TABLESITE)
+  f->tsite = NULL;
+  f->sizetsite = 0;
+#endif
   f->source = NULL;
   return f;
 }
@@ -272,10 +292,114 @@ void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
+#if defined(LUA_USE_INLINECACHE)
+  luaM_freearray(L, f->icache, f->sizeicache);
+  if (f->icindex != NULL)
+    luaM_freearray(L, f->icindex, f->sizecode);
+#endif
+#if defined(LUA_USE_TABLESITE)
+  luaM_freearray(L, f->tsite, f->sizetsite);
+#endif
   luaM_free(L, f);
 }
 
 
+#if defined(LUA_USE_INLINECACHE)
+
+/* instructions with an inline cache */
+#define hasicache(op)  \
+	((op) == OP_GETTABUP || (op) == OP_GETFIELD || (op) == OP_SETFIELD)
+
+/* maximum number of inline caches of a function */
+#define MAXICACHE	USHRT_MAX
+
+
+/*
+** Give each cached instruction of a function with complete code its own
+** inline cache. Entry 0 of 'icache' is never filled, so that it always
+** misses; it stands for the instructions beyond MAXICACHE.
+*/
+void luaF_initcache (lua_State *L, Proto *f) {
+  int pc;
+  int n = 0;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (hasicache(luaP_baseop(GET_OPCODE(f->code[pc]))))
+      n++;
+  }
+  if (n == 0)
+    return;  /* nothing to cache */
+  if (n > MAXICACHE)
+    n = MAXICACHE;
+  f->icache = luaM_newvector(L, n + 1, ICache);
+  f->sizeicache = n + 1;
+  for (n = 0; n < f->sizeicache; n++) {
+    f->icache[n].slot = NULL;
+    f->icache[n].layout = 0;
+  }
+  f->icindex = luaM_newvector(L, f->sizecode, unsigned short);
+  n = 0;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (hasicache(luaP_baseop(GET_OPCODE(f->code[pc]))) && n < MAXICACHE)
+      f->icindex[pc] = cast(unsigned short, ++n);
+    else
+      f->icindex[pc] = 0;
+  }
+}
+
+#endif
+
+
+#if defined(LUA_USE_TABLESITE)
+
+/*
+** Give each table constructor of a function with complete code its
+** entry in 'tsite', with no sizes to give yet.
+*/
+void luaF_initsites (lua_State *L, Proto *f) {
+  int pc;
+  int n = 0;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (GET_OPCODE(f->code[pc]) == OP_NEWTABLE)
+      n++;
+  }
+  if (n == 0)
+    return;  /* no constructors */
+  f->tsite = luaM_newvector(L, n, TableSite);
+  f->sizetsite = n;
+  n = 0;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (GET_OPCODE(f->code[pc]) == OP_NEWTABLE) {
+      TableSite *ts = &f->tsite[n++];
+      ts->pc = pc;
+      ts->asize = ts->hsize = 0;
+      ts->last = NULL;
+    }
+  }
+}
+
+
+/*
+** Entry of the table constructor at position 'pc' of the code of 'f'
+** (binary search, as entries are in the order of the code).
+*/
+TableSite *luaF_tablesite (Proto *f, int pc) {
+  int lo = 0;
+  int hi = f->sizetsite - 1;
+  while (lo <= hi) {
+    int m = (lo + hi) / 2;
+    if (f->tsite[m].pc < pc)
+      lo = m + 1;
+    else if (f->tsite[m].pc > pc)
+      hi = m - 1;
+    else
+      return &f->tsite[m];
+  }
+  return NULL;  /* not a constructor */
+}
+
+#endif
+
+
 /*
 ** Look for n-th local variable at line 'line' in function 'func'.
 ** Returns NULL if not found.
@@ -292,3 +416,107 @@ const char *luaF_getlocalname (const Proto *f, int local_number, int pc) {
   return NULL;  /* not found */
 }
 
+
+
+/*
+** {======================================================
+** Linking: reads of globals holding functions exported by other chunks
+** become constants of the reading chunk
+** =======================================================
+*/
+
+/* mark in 'env' the upvalues of 'f' holding the _ENV of its parent */
+static void envupvals (const Proto *f, const lu_byte *penv, lu_byte *env) {
+  int i;
+  for (i = 0; i < f->sizeupvalues; i++)
+    env[i] = !f->upvalues[i].instack && penv[f->upvalues[i].idx];
+}
+
+
+/*
+** Collect in 'sets' the names that 'f' and its nested functions assign
+** through _ENV ('env' marks the upvalues of 'f' holding _ENV).
+*/
+static void linksets (lua_State *L, const Proto *f, const lu_byte *env,
+                      Table *sets) {
+  lu_byte penv[MAXUPVAL + 1];
+  TValue yes;
+  int i;
+  setbtvalue(&yes);
+  for (i = 0; i < f->sizecode; i++) {
+    Instruction inst = f->code[i];
+    if (GET_OPCODE(inst) == OP_SETTABUP && env[GETARG_A(inst)])
+      luaH_set(L, sets, &f->k[GETARG_B(inst)], &yes);
+  }
+  for (i = 0; i < f->sizep; i++) {
+    envupvals(f->p[i], env, penv);
+    linksets(L, f->p[i], penv, sets);
+  }
+}
+
+
+/*
+** Index of function 'v' in the constants of 'f', added if missing, or
+** -1 if a LOADK cannot reach it.
+*/
+static int linkconstant (lua_State *L, Proto *f, const TValue *v) {
+  int k;
+  for (k = 0; k < f->sizek; k++) {
+    if (ttisfunction(&f->k[k]) && luaV_rawequalobj(&f->k[k], v))
+      return k;  /* bound already */
+  }
+  if (k > MAXARG_Bx)
+    return -1;
+  f->k = cast(TValue *, luaM_saferealloc_(L, f->k, k * sizeof(TValue),
+                                             (k + 1) * sizeof(TValue)));
+  f->sizek = k + 1;
+  setobj(L, &f->k[k], v);
+  luaC_barrier(L, f, v);
+  return k;
+}
+
+
+static int linkproto (lua_State *L, Proto *f, const lu_byte *env,
+                      Table *exports, Table *sets) {
+  lu_byte penv[MAXUPVAL + 1];
+  int n = 0;
+  int i;
+  for (i = 0; i < f->sizecode; i++) {
+    Instruction inst = f->code[i];
+    if (luaP_baseop(GET_OPCODE(inst)) == OP_GETTABUP && env[GETARG_B(inst)]) {
+      TString *name = tsvalue(&f->k[GETARG_C(inst)]);
+      const TValue *v = luaH_getshortstr(exports, name);
+      if (ttisfunction(v) && isempty(luaH_getshortstr(sets, name))) {
+        int k = linkconstant(L, f, v);
+        if (k >= 0) {
+          f->code[i] = CREATE_ABx(OP_LOADK, GETARG_A(inst), k);
+          n++;
+        }
+      }
+    }
+  }
+  for (i = 0; i < f->sizep; i++) {
+    envupvals(f->p[i], env, penv);
+    n += linkproto(L, f->p[i], penv, exports, sets);
+  }
+  return n;
+}
+
+
+/*
+** Bind the global reads of main function 'f' (as loaded, with _ENV as
+** upvalue 0) and of its nested functions to the functions in 'exports':
+** each read of such a name through _ENV becomes a LOADK of the function.
+** Names the chunk assigns through _ENV are left as global reads. 'sets'
+** is an empty table for these names. Returns the number of reads bound.
+*/
+int luaF_link (lua_State *L, Proto *f, Table *exports, Table *sets) {
+  lu_byte env[MAXUPVAL + 1];
+  int i;
+  for (i = 0; i < f->sizeupvalues; i++)
+    env[i] = (i == 0);
+  linksets(L, f, env, sets);
+  return linkproto(L, f, env, exports, sets);
+}
+
+/* }====================================================== */
@@ -57,6 +57,14 @@ LUAI_FUNC void luaF_closeupval (lua_State *L, StkId level);
 LUAI_FUNC void luaF_close (lua_State *L, StkId level, int status, int yy);
 LUAI_FUNC void luaF_unlinkupval (UpVal *uv);
 LUAI_FUNC void luaF_freeproto (lua_State *L, Proto *f);
+#if defined(LUA_USE_INLINECACHE)
+LUAI_FUNC void luaF_initcache (lua_State *L, Proto *f);
+#endif
+#if defined(LUA_USE_TABLESITE)
+LUAI_FUNC void luaF_initsites (lua_State *L, Proto *f);
+LUAI_FUNC TableSite *luaF_tablesite (Proto *f, int pc);
+#endif
+LUAI_FUNC int luaF_link (lua_State *L, Proto *f, Table *exports, Table *sets);
 LUAI_FUNC const char *luaF_getlocalname (const Proto *func, int local_number,
                                          int pc);
 
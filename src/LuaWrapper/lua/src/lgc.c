@@ -116,12 +116,6 @@ static void entersweep (lua_State *L);
 */
 
 
-/*
-** one after last element in a hash array
-*/
-#define gnodelast(h)	gnode(h, cast_sizet(sizenode(h)))
-
-
 static GCObject **getgclist (GCObject *o) {
   switch (o->tt) {
     case LUA_VTABLE: return &gco2t(o)->gclist;
@@ -438,11 +432,13 @@ static void genlink (global_State *g, GCObject *o) {
 ** put it in 'weak' list, to be cleared.
 */
 static void traverseweakvalue (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
+  unsigned int i;
+  unsigned int nsize = allsizenode(h);
   /* if there is array part, assume it may have white values (it is not
      worth traversing it now just to check) */
   int hasclears = (h->alimit > 0);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+  for (i = 0; i < nsize; i++) {  /* traverse hash part */
+    Node *n = anynode(h, i);
     if (isempty(gval(n)))  /* entry is empty? */
       clearkey(n);  /* clear its key */
     else {
@@ -477,7 +473,7 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
   int hasww = 0;  /* true if table has entry "white-key -> white-value" */
   unsigned int i;
   unsigned int asize = luaH_realasize(h);
-  unsigned int nsize = sizenode(h);
+  unsigned int nsize = allsizenode(h);
   /* traverse array part */
   for (i = 0; i < asize; i++) {
     if (valiswhite(&h->array[i])) {
@@ -488,7 +484,7 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
   /* traverse hash part; if 'inv', traverse descending
      (see 'convergeephemerons') */
   for (i = 0; i < nsize; i++) {
-    Node *n = inv ? gnode(h, nsize - 1 - i) : gnode(h, i);
+    Node *n = inv ? anynode(h, nsize - 1 - i) : anynode(h, i);
     if (isempty(gval(n)))  /* entry is empty? */
       clearkey(n);  /* clear its key */
     else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
@@ -515,12 +511,13 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
 
 
 static void traversestrongtable (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
   unsigned int i;
   unsigned int asize = luaH_realasize(h);
+  unsigned int nsize = allsizenode(h);
   for (i = 0; i < asize; i++)  /* traverse array part */
     markvalue(g, &h->array[i]);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+  for (i = 0; i < nsize; i++) {  /* traverse hash part */
+    Node *n = anynode(h, i);
     if (isempty(gval(n)))  /* entry is empty? */
       clearkey(n);  /* clear its key */
     else {
@@ -717,9 +714,10 @@ static void convergeephemerons (global_State *g) {
 static void clearbykeys (global_State *g, GCObject *l) {
   for (; l; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *limit = gnodelast(h);
-    Node *n;
-    for (n = gnode(h, 0); n < limit; n++) {
+    unsigned int i;
+    unsigned int nsize = allsizenode(h);
+    for (i = 0; i < nsize; i++) {
+      Node *n = anynode(h, i);
       if (iscleared(g, gckeyN(n)))  /* unmarked key? */
         setempty(gval(n));  /* remove entry */
       if (isempty(gval(n)))  /* is entry empty? */
@@ -736,15 +734,16 @@ static void clearbykeys (global_State *g, GCObject *l) {
 static void clearbyvalues (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
     unsigned int i;
     unsigned int asize = luaH_realasize(h);
+    unsigned int nsize = allsizenode(h);
     for (i = 0; i < asize; i++) {
       TValue *o = &h->array[i];
       if (iscleared(g, gcvalueN(o)))  /* value was collected? */
         setempty(o);  /* remove entry */
     }
-    for (n = gnode(h, 0); n < limit; n++) {
+    for (i = 0; i < nsize; i++) {
+      Node *n = anynode(h, i);
       if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
         setempty(gval(n));  /* remove entry */
       if (isempty(gval(n)))  /* is entry empty? */
@@ -108,5 +108,23 @@ static const void *const disptab[NUM_OPCODES] = {
 &&L_OP_VARARG,
 &&L_OP_VARARGPREP,
 &&L_OP_EXTRAARG
+#if defined(LUA_USE_SUPERINSTR)
+,&&L_OP_GETTABUPCALL
+,&&L_OP_GETTABUPFIELD
+,&&L_OP_GETFIELDFIELD
+#endif
+#if defined(LUA_USE_QUICKEN)
+,&&L_OP_ADDINT
+,&&L_OP_ADDFLT
+,&&L_OP_SUBINT
+,&&L_OP_SUBFLT
+,&&L_OP_MULINT
+,&&L_OP_MULFLT
+,&&L_OP_DIVFLT
+,&&L_OP_LTINT
+,&&L_OP_LTFLT
+,&&L_OP_LEINT
+,&&L_OP_LEFLT
+#endif
 
 };
@@ -28,6 +28,8 @@
 #include "lzio.h"
 
 
+#if !defined(LUA_NO_PARSER)  /* { */
+
 
 #define next(ls)	(ls->current = zgetc(ls->z))
 
@@ -579,3 +581,5 @@ int luaX_lookahead (LexState *ls) {
   return ls->lookahead.token;
 }
 
+#endif  /* } */
+
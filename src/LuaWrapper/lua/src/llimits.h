@@ -243,6 +243,71 @@ typedef l_uint32 Instruction;
 #endif
 
 
+/*
+** Guard misses of quickened instructions a function takes before it
+** stops quickening. (Value must fit in an unsigned char.)
+*/
+#if !defined(LUAI_QUICKENBUDGET)
+#define LUAI_QUICKENBUDGET	16
+#endif
+
+
+/*
+** Largest hash part kept in the allocation of a small table (see
+** LUA_USE_SMALLTABLE). (Value must be a power of 2.)
+*/
+#if !defined(LUAI_SMALLNODES)
+#define LUAI_SMALLNODES		4
+#endif
+
+
+/*
+** Smallest hash part whose growth is done incrementally, and number of
+** its nodes moved at each new key (see LUA_USE_INCREHASH). The step
+** must be at least 2, so that all nodes are moved before the new hash
+** part fills up.
+*/
+#if !defined(LUAI_INCREHASH)
+#define LUAI_INCREHASH		256
+#endif
+
+#if !defined(LUAI_REHASHSTEP)
+#define LUAI_REHASHSTEP		8
+#endif
+
+
+/*
+** Largest array or hash size a table constructor gives to its next
+** tables (see LUA_USE_TABLESITE), so that one large table does not
+** make every later table of its constructor large too.
+*/
+#if !defined(LUAI_MAXSITESIZE)
+#define LUAI_MAXSITESIZE	1024
+#endif
+
+
+/*
+** Number of traversal hints kept by a state (see LUA_USE_NEXTHINT).
+** Tables share them by address, so this is about how many tables can
+** be traversed at once (nested loops) without disturbing each other.
+** (Value must be a power of 2.)
+*/
+#if !defined(LUAI_NEXTHINTS)
+#define LUAI_NEXTHINTS		4
+#endif
+
+
+/*
+** Free CallInfo structures a thread keeps when the collector shrinks
+** its CallInfo list, so that recursion up to that depth beyond the
+** current call does not allocate them again after every cycle. (Value
+** must fit in a 16-bit unsigned integer.)
+*/
+#if !defined(LUAI_CIRETAIN)
+#define LUAI_CIRETAIN		32
+#endif
+
+
 /*
 ** macros that are executed whenever program enters the Lua core
 ** ('lua_lock') and leaves the core ('lua_unlock')
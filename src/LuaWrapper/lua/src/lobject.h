@@ -533,6 +533,29 @@ typedef struct AbsLineInfo {
   int line;
 } AbsLineInfo;
 
+/*
+** Inline cache of a field access: the node where the key was found and the
+** layout stamp of the table at that time (0 if the cache is empty)
+*/
+typedef struct ICache {
+  union Node *slot;
+  unsigned int layout;
+} ICache;
+
+
+/*
+** Table constructor of a function (a 'NEWTABLE' instruction) and the
+** sizes it gives to its tables. 'last' is only compared with the table
+** found in the register of the constructor, and is not a reference.
+*/
+typedef struct TableSite {
+  int pc;  /* position of the constructor in the code */
+  unsigned int asize;  /* array size of the next table */
+  unsigned int hsize;  /* hash size of the next table */
+  struct Table *last;  /* last table created by the constructor */
+} TableSite;
+
+
 /*
 ** Function Prototypes
 */
@@ -541,6 +564,9 @@ typedef struct Proto {
   lu_byte numparams;  /* number of fixed (named) parameters */
   lu_byte is_vararg;
   lu_byte maxstacksize;  /* number of registers needed by this function */
+#if defined(LUA_USE_QUICKEN)
+  lu_byte qbudget;  /* guard misses left before quickening stops */
+#endif
   int sizeupvalues;  /* size of 'upvalues' */
   int sizek;  /* size of 'k' */
   int sizecode;
@@ -550,6 +576,13 @@ typedef struct Proto {
   int sizeabslineinfo;  /* size of 'abslineinfo' */
   int linedefined;  /* debug information  */
   int lastlinedefined;  /* debug information  */
+  int mapid;  /* index in the line map of dropped debug information (-1 if none) */
+#if defined(LUA_USE_INLINECACHE)
+  int sizeicache;  /* size of 'icache' */
+#endif
+#if defined(LUA_USE_TABLESITE)
+  int sizetsite;  /* size of 'tsite' */
+#endif
   TValue *k;  /* constants used by the function */
   Instruction *code;  /* opcodes */
   struct Proto **p;  /* functions defined inside the function */
@@ -557,6 +590,13 @@ typedef struct Proto {
   ls_byte *lineinfo;  /* information about source lines (debug information) */
   AbsLineInfo *abslineinfo;  /* idem */
   LocVar *locvars;  /* information about local variables (debug information) */
+#if defined(LUA_USE_INLINECACHE)
+  ICache *icache;  /* inline caches of the global and field accesses */
+  unsigned short *icindex;  /* cache of each instruction in 'icache' */
+#endif
+#if defined(LUA_USE_TABLESITE)
+  TableSite *tsite;  /* table constructors, in the order of the code */
+#endif
   TString  *source;  /* used for debug information */
   GCObject *gclist;
 } Proto;
@@ -634,6 +674,14 @@ typedef struct UpVal {
 typedef struct CClosure {
   ClosureHeader;
   lua_CFunction f;
+#if defined(LUA_USE_FASTCALL)
+  lua_FastCFunction fast;  /* fast variant of 'f', or NULL */
+  lu_byte nfargs;  /* number of arguments of 'fast' */
+  lu_byte nfres;  /* number of results of 'fast' */
+  lu_byte fintargs;  /* bit mask of the integer arguments */
+  lu_byte fintres;  /* bit mask of the integer results */
+  lu_byte fboolres;  /* bit mask of the boolean results */
+#endif
   TValue upvalue[1];  /* list of upvalues */
 } CClosure;
 
@@ -720,6 +768,10 @@ typedef union Node {
 #define setrealasize(t)		((t)->flags &= cast_byte(~BITRAS))
 #define setnorealasize(t)	((t)->flags |= BITRAS)
 
+/* table allocated with inline nodes for a small hash part (LUA_USE_SMALLTABLE) */
+#define BITINL		(1 << 6)
+#define hasinline(t)		((t)->flags & BITINL)
+
 
 typedef struct Table {
   CommonHeader;
@@ -731,6 +783,13 @@ typedef struct Table {
   Node *lastfree;  /* any free position is before this position */
   struct Table *metatable;
   GCObject *gclist;
+#if defined(LUA_USE_INLINECACHE)
+  unsigned int layout;  /* stamp of the current layout of the hash part */
+#endif
+#if defined(LUA_USE_INCREHASH)
+  Node *oldnode;  /* old hash part, while it is moved into 'node' */
+  unsigned int oldpos;  /* nodes of 'oldnode' not moved yet */
+#endif
 } Table;
 
 
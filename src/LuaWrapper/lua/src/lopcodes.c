@@ -100,5 +100,82 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, 0, 0, 1, iABC)		/* OP_VARARG */
  ,opmode(0, 0, 1, 0, 1, iABC)		/* OP_VARARGPREP */
  ,opmode(0, 0, 0, 0, 0, iAx)		/* OP_EXTRAARG */
+#if defined(LUA_USE_SUPERINSTR)
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETTABUPCALL */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETTABUPFIELD */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETFIELDFIELD */
+#endif
+#if defined(LUA_USE_QUICKEN)
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_ADDFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_SUBFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULINT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_MULFLT */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_DIVFLT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LTINT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LTFLT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LEINT */
+ ,opmode(0, 0, 0, 1, 0, iABC)		/* OP_LEFLT */
+#endif
 };
 
+
+#if defined(LUA_USE_SUPERINSTR) || defined(LUA_USE_QUICKEN)
+
+LUAI_DDEF const lu_byte luaP_baseops[NUM_OPCODES - OP_EXTRAARG - 1] = {
+#if defined(LUA_USE_SUPERINSTR)
+  OP_GETTABUP,		/* OP_GETTABUPCALL */
+  OP_GETTABUP,		/* OP_GETTABUPFIELD */
+  OP_GETFIELD,		/* OP_GETFIELDFIELD */
+#endif
+#if defined(LUA_USE_QUICKEN)
+  OP_ADD,		/* OP_ADDINT */
+  OP_ADD,		/* OP_ADDFLT */
+  OP_SUB,		/* OP_SUBINT */
+  OP_SUB,		/* OP_SUBFLT */
+  OP_MUL,		/* OP_MULINT */
+  OP_MUL,		/* OP_MULFLT */
+  OP_DIV,		/* OP_DIVFLT */
+  OP_LT,		/* OP_LTINT */
+  OP_LT,		/* OP_LTFLT */
+  OP_LE,		/* OP_LEINT */
+  OP_LE,		/* OP_LEFLT */
+#endif
+};
+
+#endif
+
+
+#if defined(LUA_USE_SUPERINSTR)
+
+
+/*
+** Turn the first instruction of each common pair into the superinstruction
+** running both. The second instruction stays in place, as it may be a jump
+** target, and is skipped when the pair runs as a whole.
+*/
+void luaP_fusecode (Instruction *code, int n) {
+  int pc;
+  for (pc = 0; pc + 1 < n; pc++) {
+    OpCode next = luaP_baseop(GET_OPCODE(code[pc + 1]));
+    switch (GET_OPCODE(code[pc])) {
+      case OP_GETTABUP: {
+        if (next == OP_CALL)
+          SET_OPCODE(code[pc], OP_GETTABUPCALL);
+        else if (next == OP_GETFIELD)
+          SET_OPCODE(code[pc], OP_GETTABUPFIELD);
+        break;
+      }
+      case OP_GETFIELD: {
+        if (next == OP_GETFIELD)
+          SET_OPCODE(code[pc], OP_GETFIELDFIELD);
+        break;
+      }
+      default: break;
+    }
+  }
+}
+
+#endif
+
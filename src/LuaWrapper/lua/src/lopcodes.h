@@ -307,10 +307,38 @@ OP_VARARG,/*	A C	R[A], R[A+1], ..., R[A+C-2] = vararg		*/
 OP_VARARGPREP,/*A	(adjust vararg parameters)			*/
 
 OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+
+#if defined(LUA_USE_SUPERINSTR)
+/* superinstructions: first opcode of a pair, running the next one too */
+,OP_GETTABUPCALL/*	A B C	R[A] := UpValue[B][K[C]:string]; then CALL	*/
+,OP_GETTABUPFIELD/*	A B C	R[A] := UpValue[B][K[C]:string]; then GETFIELD	*/
+,OP_GETFIELDFIELD/*	A B C	R[A] := R[B][K[C]:string]; then GETFIELD	*/
+#endif
+
+#if defined(LUA_USE_QUICKEN)
+/* quickened opcodes: type-specialised variants installed at run time */
+,OP_ADDINT/*	A B C	R[A] := R[B] + R[C] (integers)	*/
+,OP_ADDFLT/*	A B C	R[A] := R[B] + R[C] (floats)	*/
+,OP_SUBINT/*	A B C	R[A] := R[B] - R[C] (integers)	*/
+,OP_SUBFLT/*	A B C	R[A] := R[B] - R[C] (floats)	*/
+,OP_MULINT/*	A B C	R[A] := R[B] * R[C] (integers)	*/
+,OP_MULFLT/*	A B C	R[A] := R[B] * R[C] (floats)	*/
+,OP_DIVFLT/*	A B C	R[A] := R[B] / R[C] (floats)	*/
+,OP_LTINT/*	A B k	if ((R[A] <  R[B]) ~= k) then pc++ (integers)	*/
+,OP_LTFLT/*	A B k	if ((R[A] <  R[B]) ~= k) then pc++ (floats)	*/
+,OP_LEINT/*	A B k	if ((R[A] <= R[B]) ~= k) then pc++ (integers)	*/
+,OP_LEFLT/*	A B k	if ((R[A] <= R[B]) ~= k) then pc++ (floats)	*/
+#endif
 } OpCode;
 
 
+#if defined(LUA_USE_QUICKEN)
+#define NUM_OPCODES	((int)(OP_LEFLT) + 1)
+#elif defined(LUA_USE_SUPERINSTR)
+#define NUM_OPCODES	((int)(OP_GETFIELDFIELD) + 1)
+#else
 #define NUM_OPCODES	((int)(OP_EXTRAARG) + 1)
+#endif
 
 
 
@@ -399,6 +427,29 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
     (((mm) << 7) | ((ot) << 6) | ((it) << 5) | ((t) << 4) | ((a) << 3) | (m))
 
 
+/*
+** 'luaP_baseop' gives the standard opcode of an instruction, which is
+** the opcode of the first instruction of a superinstruction pair, or
+** the generic opcode of a quickened instruction.
+*/
+#if defined(LUA_USE_SUPERINSTR) || defined(LUA_USE_QUICKEN)
+
+LUAI_DDEC(const lu_byte luaP_baseops[NUM_OPCODES - OP_EXTRAARG - 1];)
+
+#define luaP_baseop(o)  \
+	((o) <= OP_EXTRAARG ? (o) : cast(OpCode, luaP_baseops[(o) - OP_EXTRAARG - 1]))
+
+#if defined(LUA_USE_SUPERINSTR)
+LUAI_FUNC void luaP_fusecode (Instruction *code, int n);
+#endif
+
+#else
+
+#define luaP_baseop(o)	(o)
+
+#endif
+
+
 /* number of list items to accumulate before a SETLIST instruction */
 #define LFIELDS_PER_FLUSH	50
 
@@ -96,6 +96,24 @@ static const char *const opnames[] = {
   "VARARG",
   "VARARGPREP",
   "EXTRAARG",
+#if defined(LUA_USE_SUPERINSTR)
+  "GETTABUPCALL",
+  "GETTABUPFIELD",
+  "GETFIELDFIELD",
+#endif
+#if defined(LUA_USE_QUICKEN)
+  "ADDINT",
+  "ADDFLT",
+  "SUBINT",
+  "SUBFLT",
+  "MULINT",
+  "MULFLT",
+  "DIVFLT",
+  "LTINT",
+  "LTFLT",
+  "LEINT",
+  "LEFLT",
+#endif
   NULL
 };
 
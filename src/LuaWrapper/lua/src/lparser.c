@@ -29,6 +29,9 @@
 #include "ltable.h"
 
 
+#if !defined(LUA_NO_PARSER)  /* { */
+
+
 
 /* maximum number of local variables per function (must be smaller
    than 250, due to the bytecode format) */
@@ -768,6 +771,12 @@ static void close_func (LexState *ls) {
   luaM_shrinkvector(L, f->p, f->sizep, fs->np, Proto *);
   luaM_shrinkvector(L, f->locvars, f->sizelocvars, fs->ndebugvars, LocVar);
   luaM_shrinkvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
+#if defined(LUA_USE_INLINECACHE)
+  luaF_initcache(L, f);
+#endif
+#if defined(LUA_USE_TABLESITE)
+  luaF_initsites(L, f);
+#endif
   ls->fs = fs->prev;
   luaC_checkGC(L);
 }
@@ -1634,12 +1643,82 @@ static void forstat (LexState *ls, int line) {
 }
 
 
-static void test_then_block (LexState *ls, int *escapelist) {
+/*
+** Position of the code generated for a part of a statement, to drop that
+** code when the part never runs. Code with nested functions or pending
+** gotos is kept.
+*/
+typedef struct CodeMark {
+  int pc;  /* first instruction of the part */
+  int np;  /* number of nested functions before the part */
+  int ngt;  /* number of pending gotos before the part */
+  int nactvar;  /* number of active variables before the part */
+  short ndebugvars;  /* number of debug variables before the part */
+} CodeMark;
+
+
+static void markcode (LexState *ls, CodeMark *m) {
+  m->pc = ls->fs->pc;
+  m->np = ls->fs->np;
+  m->ngt = ls->dyd->gt.n;
+  m->nactvar = ls->dyd->actvar.n;
+  m->ndebugvars = ls->fs->ndebugvars;
+}
+
+
+/*
+** Drop the code of a part, with the debug information of the locals it
+** declared, whose ranges would otherwise cover the code that follows.
+** The part is a closed block, so its locals are no longer active.
+*/
+static int dropcode (LexState *ls, const CodeMark *m) {
+  FuncState *fs = ls->fs;
+  if (fs->np != m->np || ls->dyd->gt.n != m->ngt)
+    return 0;  /* cannot drop it */
+  lua_assert(ls->dyd->actvar.n == m->nactvar);
+  luaK_truncate(fs, m->pc);
+  fs->ndebugvars = m->ndebugvars;
+  return 1;
+}
+
+
+#if defined(LUA_USE_DEADBRANCH)
+
+/*
+** Check whether a condition is a constant: returns 1 if it is always
+** true, -1 if it is always false and 0 otherwise.
+*/
+static int constcond (expdesc *e) {
+  if (e->t != e->f)  /* has jumps? (both are NO_JUMP otherwise) */
+    return 0;
+  switch (e->k) {
+    case VNIL: case VFALSE: return -1;
+    case VTRUE: case VK: case VKFLT: case VKINT: case VKSTR: return 1;
+    default: return 0;
+  }
+}
+
+#else
+
+#define constcond(e)	0  /* parts are never dropped */
+
+#endif
+
+
+/*
+** Parse a part of an 'if' statement. When an earlier condition is always
+** true, 'skip' is the jump over the remaining parts, whose code is dropped.
+** A part whose condition is always false is dropped as well.
+*/
+static void test_then_block (LexState *ls, int *escapelist, int *skip) {
   /* test_then_block -> [IF | ELSEIF] cond THEN block */
   BlockCnt bl;
   FuncState *fs = ls->fs;
   expdesc v;
   int jf;  /* instruction to skip 'then' code (if condition is false) */
+  int cond = 0;  /* condition is a constant */
+  CodeMark m;
+  markcode(ls, &m);
   luaX_next(ls);  /* skip IF or ELSEIF */
   expr(ls, &v);  /* read condition */
   checknext(ls, TK_THEN);
@@ -1658,15 +1737,23 @@ static void test_then_block (LexState *ls, int *escapelist) {
       jf = luaK_jump(fs);
   }
   else {  /* regular case (not a break) */
+    luaK_dischargevars(fs, &v);  /* a '<const>' gives its value */
+    cond = constcond(&v);
     luaK_goiftrue(ls->fs, &v);  /* skip over block if condition is false */
     enterblock(fs, &bl, 0);
     jf = v.f;
   }
   statlist(ls);  /* 'then' part */
   leaveblock(fs);
+  if ((*skip != NO_JUMP || cond < 0) && dropcode(ls, &m))
+    return;  /* part never runs and was dropped */
   if (ls->t.token == TK_ELSE ||
-      ls->t.token == TK_ELSEIF)  /* followed by 'else'/'elseif'? */
-    luaK_concat(fs, escapelist, luaK_jump(fs));  /* must jump over it */
+      ls->t.token == TK_ELSEIF) {  /* followed by 'else'/'elseif'? */
+    if (cond > 0 && *skip == NO_JUMP)  /* remaining parts never run? */
+      *skip = luaK_jump(fs);
+    else
+      luaK_concat(fs, escapelist, luaK_jump(fs));  /* must jump over it */
+  }
   luaK_patchtohere(fs, jf);
 }
 
@@ -1675,12 +1762,24 @@ static void ifstat (LexState *ls, int line) {
   /* ifstat -> IF cond THEN block {ELSEIF cond THEN block} [ELSE block] END */
   FuncState *fs = ls->fs;
   int escapelist = NO_JUMP;  /* exit list for finished parts */
-  test_then_block(ls, &escapelist);  /* IF cond THEN block */
+  int skip = NO_JUMP;  /* jump over the parts after an always true one */
+  test_then_block(ls, &escapelist, &skip);  /* IF cond THEN block */
   while (ls->t.token == TK_ELSEIF)
-    test_then_block(ls, &escapelist);  /* ELSEIF cond THEN block */
-  if (testnext(ls, TK_ELSE))
+    test_then_block(ls, &escapelist, &skip);  /* ELSEIF cond THEN block */
+  if (testnext(ls, TK_ELSE)) {
+    CodeMark m;
+    markcode(ls, &m);
     block(ls);  /* 'else' part */
+    if (skip != NO_JUMP)
+      dropcode(ls, &m);  /* never runs */
+  }
   check_match(ls, TK_END, TK_IF, line);
+  if (skip != NO_JUMP) {
+    if (skip == fs->pc - 1)  /* all remaining parts dropped? */
+      luaK_truncate(fs, skip);  /* no need to jump over them */
+    else
+      luaK_concat(fs, &escapelist, skip);
+  }
   luaK_patchtohere(fs, escapelist);  /* patch escape list to 'if' end */
 }
 
@@ -1920,6 +2019,40 @@ static void statement (LexState *ls) {
 ** compiles the main function, which is a regular vararg function with an
 ** upvalue named LUA_ENV
 */
+/*
+** Declare the constants of the host table LUA_HOSTCONST_TABLE of the
+** registry as compile-time constants of the main function, like
+** '<const>' locals: the scripts read them without any lookup, and they
+** take part in constant folding.
+*/
+static void hostconsts (LexState *ls) {
+  lua_State *L = ls->L;
+  FuncState *fs = ls->fs;
+  Table *reg = hvalue(&G(L)->l_registry);
+  const TValue *t = luaH_getstr(reg, luaS_new(L, LUA_HOSTCONST_TABLE));
+  int i;
+  if (!ttistable(t))
+    return;  /* no constants declared */
+  for (i = 0; i < allsizenode(hvalue(t)); i++) {
+    Node *n = anynode(hvalue(t), i);
+    TString *name;
+    Vardesc *var;
+    if (!keyisshrstr(n) || eqstr(keystrval(n), ls->envn))
+      continue;  /* not a usable name */
+    switch (ttypetag(gval(n))) {
+      case LUA_VNUMINT: case LUA_VNUMFLT: case LUA_VFALSE: case LUA_VTRUE:
+      case LUA_VSHRSTR: case LUA_VLNGSTR: break;
+      default: continue;  /* not a constant */
+    }
+    name = luaX_newstring(ls, getstr(keystrval(n)), tsslen(keystrval(n)));
+    var = getlocalvardesc(fs, new_localvar(ls, name));
+    var->vd.kind = RDKCTC;
+    setobj(L, &var->k, gval(n));
+    fs->nactvar++;
+  }
+}
+
+
 static void mainfunc (LexState *ls, FuncState *fs) {
   BlockCnt bl;
   Upvaldesc *env;
@@ -1931,6 +2064,7 @@ static void mainfunc (LexState *ls, FuncState *fs) {
   env->kind = VDKREG;
   env->name = ls->envn;
   luaC_objbarrier(ls->L, fs->f, env->name);
+  hostconsts(ls);
   luaX_next(ls);  /* read first token */
   statlist(ls);  /* parse main body */
   check(ls, TK_EOS);
@@ -1964,3 +2098,5 @@ LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
   return cl;  /* closure is on the stack, too */
 }
 
+#endif  /* } */
+
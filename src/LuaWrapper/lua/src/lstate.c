@@ -132,12 +132,15 @@ void luaE_freeCI (lua_State *L) {
 
 
 /*
-** free half of the CallInfo structures not in use by a thread,
-** keeping the first one.
+** free half of the CallInfo structures not in use by a thread beyond
+** the first LUAI_CIRETAIN ones, keeping the first one after those.
 */
 void luaE_shrinkCI (lua_State *L) {
   CallInfo *ci = L->ci->next;  /* first free CallInfo */
   CallInfo *next;
+  int n;
+  for (n = 0; n < LUAI_CIRETAIN && ci != NULL; n++)
+    ci = ci->next;  /* skip retained elements */
   if (ci == NULL)
     return;  /* no extra elements */
   while ((next = ci->next) != NULL) {  /* two extra elements? */
@@ -235,7 +238,9 @@ static void f_luaopen (lua_State *L, void *ud) {
   init_registry(L, g);
   luaS_init(L);
   luaT_init(L);
+#if !defined(LUA_NO_PARSER)
   luaX_init(L);
+#endif
   g->gcstp = 0;  /* allow gc */
   setnilvalue(&g->nilvalue);  /* now state is complete */
   luai_userstateopen(L);
@@ -371,8 +376,20 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->ud = ud;
   g->warnf = NULL;
   g->ud_warn = NULL;
+  g->linemap = NULL;
+  g->ud_linemap = NULL;
   g->mainthread = L;
   g->seed = luai_makeseed(L);
+#if defined(LUA_USE_DISPATCHCOUNT)
+  g->ndispatch = 0;
+#endif
+#if defined(LUA_USE_INLINECACHE)
+  g->layoutgen = 0;
+#endif
+#if defined(LUA_USE_NEXTHINT)
+  for (i = 0; i < LUAI_NEXTHINTS; i++)
+    g->nexthint[i] = 0;
+#endif
   g->gcstp = GCSTPGC;  /* no GC while building state */
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
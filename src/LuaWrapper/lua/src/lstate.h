@@ -295,6 +295,17 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
   lua_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+  lua_LineMap linemap;  /* line lookup for dropped debug information */
+  void *ud_linemap;     /* auxiliary data to 'linemap' */
+#if defined(LUA_USE_DISPATCHCOUNT)
+  lua_Unsigned ndispatch;  /* instructions dispatched by the interpreter */
+#endif
+#if defined(LUA_USE_INLINECACHE)
+  unsigned int layoutgen;  /* last table layout stamp given */
+#endif
+#if defined(LUA_USE_NEXTHINT)
+  unsigned int nexthint[LUAI_NEXTHINTS];  /* last nodes returned by 'next' */
+#endif
 } global_State;
 
 
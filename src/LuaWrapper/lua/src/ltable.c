@@ -25,6 +25,7 @@
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -289,6 +290,44 @@ static unsigned int setlimittosize (Table *t) {
 
 
 
+#if defined(LUA_USE_INCREHASH)
+
+/*
+** Make 'ot' a table with no array part whose hash part is the old hash
+** part of 't', to search it.
+*/
+static Table *oldhashpart (const Table *t, Table *ot) {
+  ot->flags = 0;
+  ot->alimit = 0;
+  ot->node = t->oldnode;
+  ot->lsizenode = t->lsizenode - 1;
+  ot->oldnode = NULL;
+  return ot;
+}
+
+
+/*
+** Index of node 'n' of 't' in the numbering of 'anynode'. The two hash
+** parts are separate blocks, so the part holding 'n' is found by range
+** checks and never by a difference across them.
+*/
+static unsigned int nodeindex (const Table *t, const Node *n) {
+  if (n >= gnode(t, 0) && n < gnode(t, 0) + sizenode(t))
+    return cast_uint(n - gnode(t, 0));
+  else {  /* 'n' is in the old hash part */
+    lua_assert(inrehash(t) && n >= t->oldnode &&
+               n < t->oldnode + sizenode(t) / 2);
+    return cast_uint(n - t->oldnode) + sizenode(t);
+  }
+}
+
+#else
+
+#define nodeindex(t,n)	cast_uint((n) - gnode(t, 0))
+
+#endif
+
+
 /*
 ** "Generic" get version. (Not that generic: not valid for integers,
 ** which may be in array part, nor for floats with integral values.)
@@ -302,10 +341,17 @@ static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
     else {
       int nx = gnext(n);
       if (nx == 0)
-        return &absentkey;  /* not found */
+        break;
       n += nx;
     }
   }
+#if defined(LUA_USE_INCREHASH)
+  if (inrehash(t)) {  /* still may be in the old hash part */
+    Table ot;
+    return getgeneric(oldhashpart(t, &ot), key, deadok);
+  }
+#endif
+  return &absentkey;  /* not found */
 }
 
 
@@ -321,6 +367,19 @@ static unsigned int arrayindex (lua_Integer k) {
 }
 
 
+#if defined(LUA_USE_NEXTHINT)
+
+/*
+** Hint of the traversals of 't': the index of the hash node 'next'
+** returned last for it, or for another table using the same entry.
+** It is only a guess, checked against the key before being used.
+*/
+#define nexthint(L,t)  \
+	(G(L)->nexthint[(point2uint(t) >> 3) & (LUAI_NEXTHINTS - 1)])
+
+#endif
+
+
 /*
 ** returns the index of a 'key' for table traversals. First goes all
 ** elements in the array part, then elements in the hash part. The
@@ -334,10 +393,16 @@ static unsigned int findindex (lua_State *L, Table *t, TValue *key,
   if (i - 1u < asize)  /* is 'key' inside array part? */
     return i;  /* yes; that's the index */
   else {
-    const TValue *n = getgeneric(t, key, 1);
+    const TValue *n;
+#if defined(LUA_USE_NEXTHINT)
+    i = nexthint(L, t);
+    if (i < cast_uint(allsizenode(t)) && equalkey(key, anynode(t, i), 1))
+      return (i + 1) + asize;  /* key is where the last traversal stopped */
+#endif
+    n = getgeneric(t, key, 1);
     if (l_unlikely(isabstkey(n)))
       luaG_runerror(L, "invalid key to 'next'");  /* key not found */
-    i = cast_int(nodefromval(n) - gnode(t, 0));  /* key index in hash table */
+    i = nodeindex(t, nodefromval(n));  /* key index in hash table */
     /* hash elements are numbered after array ones */
     return (i + 1) + asize;
   }
@@ -354,9 +419,12 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
       return 1;
     }
   }
-  for (i -= asize; cast_int(i) < sizenode(t); i++) {  /* hash part */
-    if (!isempty(gval(gnode(t, i)))) {  /* a non-empty entry? */
-      Node *n = gnode(t, i);
+  for (i -= asize; cast_int(i) < allsizenode(t); i++) {  /* hash part */
+    if (!isempty(gval(anynode(t, i)))) {  /* a non-empty entry? */
+      Node *n = anynode(t, i);
+#if defined(LUA_USE_NEXTHINT)
+      nexthint(L, t) = i;
+#endif
       getnodekey(L, s2v(key), n);
       setobj2s(L, key + 1, gval(n));
       return 1;
@@ -454,9 +522,9 @@ static unsigned int numusearray (const Table *t, unsigned int *nums) {
 static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
   int totaluse = 0;  /* total number of elements */
   int ause = 0;  /* elements added to 'nums' (can go to array part) */
-  int i = sizenode(t);
+  int i = allsizenode(t);
   while (i--) {
-    Node *n = &t->node[i];
+    Node *n = anynode(t, i);
     if (!isempty(gval(n))) {
       if (keyisinteger(n))
         ause += countint(keyival(n), nums);
@@ -468,6 +536,24 @@ static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
 }
 
 
+/*
+** Set 'node', an array of 2^lsize free nodes, as the hash part of 't'.
+*/
+static void initnodes (Table *t, Node *node, int lsize) {
+  int size = twoto(lsize);
+  int i;
+  t->node = node;
+  for (i = 0; i < size; i++) {
+    Node *n = gnode(t, i);
+    gnext(n) = 0;
+    setnilkey(n);
+    setempty(gval(n));
+  }
+  t->lsizenode = cast_byte(lsize);
+  t->lastfree = gnode(t, size);  /* all positions are free */
+}
+
+
 /*
 ** Creates an array for the hash part of a table with the given
 ** size, or reuses the dummy node if size is zero.
@@ -482,24 +568,69 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
     t->lastfree = NULL;  /* signal that it is using dummy node */
   }
   else {
-    int i;
     int lsize = luaO_ceillog2(size);
     if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
-    t->node = luaM_newvector(L, size, Node);
-    for (i = 0; i < (int)size; i++) {
-      Node *n = gnode(t, i);
-      gnext(n) = 0;
-      setnilkey(n);
-      setempty(gval(n));
-    }
-    t->lsizenode = cast_byte(lsize);
-    t->lastfree = gnode(t, size);  /* all positions are free */
+    initnodes(t, luaM_newvector(L, size, Node), lsize);
   }
 }
 
 
+#if defined(LUA_USE_SMALLTABLE)
+
+/*
+** A table made by 'luaH_newrecord' has a few nodes right after its
+** header, in the same allocation. Its hash part uses them, rounded up
+** to all of them, whenever it fits there. While the hash part is
+** elsewhere, the 'next' field of the first of them keeps their number.
+*/
+#define inlinenodes(t)	cast(Node *, (t) + 1)
+
+#define inlinesize(t)  \
+	((t)->node == inlinenodes(t) ? sizenode(t) : gnext(inlinenodes(t)))
+
+/* hash part of 'size' elements of 't' fits in its inline nodes */
+#define fitsinline(t,size)  \
+	(hasinline(t) && (size) > 0 && (size) <= cast_uint(inlinesize(t)))
+
+
+/*
+** Move the hash part of 't' to 'node', which has room for it.
+*/
+static void movehashpart (Table *t, Node *node) {
+  int size = sizenode(t);
+  ptrdiff_t lastfree = t->lastfree - t->node;
+  memcpy(node, t->node, size * sizeof(Node));
+  t->node = node;
+  t->lastfree = node + lastfree;
+}
+
+#endif
+
+
+#if defined(LUA_USE_INLINECACHE)
+
+/*
+** Give 't' a new layout stamp, invalidating the inline caches holding
+** its nodes. Stamps come from a counter of the state, so that no two
+** tables, or two layouts of one table, share a stamp; 0 is left for
+** empty caches.
+*/
+static void newlayout (lua_State *L, Table *t) {
+  global_State *g = G(L);
+  if (++g->layoutgen == 0)  /* wrapped around? */
+    g->layoutgen = 1;
+  t->layout = g->layoutgen;
+}
+
+#else
+
+#define newlayout(L,t)	((void)0)
+
+#endif
+
+
 /*
 ** (Re)insert all elements from the hash part of 'ot' into table 't'.
 */
@@ -535,6 +666,60 @@ static void exchangehashpart (Table *t1, Table *t2) {
 }
 
 
+#if defined(LUA_USE_INCREHASH)
+
+static int insertkey (lua_State *L, Table *t, const TValue *key,
+                                              TValue *value);
+
+
+/*
+** Grow the hash part of 't' to twice its size. The new part takes the
+** place of the old one, which stays in 'oldnode' until 'rehashstep'
+** has moved all its nodes.
+*/
+static void startrehash (lua_State *L, Table *t) {
+  Table newt;
+  lua_assert(!inrehash(t) && sizenode(t) > LUAI_SMALLNODES);
+  setnodevector(L, &newt, 2 * sizenode(t));
+  t->oldnode = t->node;
+  t->oldpos = sizenode(t);
+  exchangehashpart(t, &newt);
+  newlayout(L, t);
+}
+
+
+/*
+** Move up to LUAI_REHASHSTEP nodes of the old hash part of 't', from
+** its end, into the current one. The old part has at most half as many
+** keys as the new one has nodes, and the step is large enough to move
+** all of them before the new keys fill the other half, so there is
+** always room for them. Each node passed loses its key, so that
+** searches in the old part do not find it anymore. The old part is
+** freed after its first node.
+*/
+static void rehashstep (lua_State *L, Table *t) {
+  int n = LUAI_REHASHSTEP;
+  while (n-- > 0 && t->oldpos > 0) {
+    Node *old = &t->oldnode[--t->oldpos];
+    if (!isempty(gval(old))) {
+      /* doesn't need barrier, as entry was already present in the table */
+      TValue k;
+      getnodekey(L, &k, old);
+      insertkey(L, t, &k, gval(old));
+      setempty(gval(old));
+    }
+    setnilkey(old);
+  }
+  if (t->oldpos == 0) {  /* moved the whole old part? */
+    luaM_freearray(L, t->oldnode, cast_sizet(sizenode(t) / 2));
+    t->oldnode = NULL;
+    newlayout(L, t);  /* inline caches may hold old nodes */
+  }
+}
+
+#endif
+
+
 /*
 ** Resize table 't' for the new given sizes. Both allocations (for
 ** the hash part and for the array part) can fail, which creates some
@@ -552,8 +737,27 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
                                           unsigned int nhsize) {
   unsigned int i;
   Table newt;  /* to keep the new hash part */
-  unsigned int oldasize = setlimittosize(t);
+  unsigned int oldasize;
   TValue *newarray;
+#if defined(LUA_USE_SMALLTABLE)
+  Node saved[LUAI_SMALLNODES];  /* old hash part, out of the inline nodes */
+  int inl;
+#endif
+#if defined(LUA_USE_INCREHASH)
+  while (inrehash(t))  /* finish moving the old hash part first */
+    rehashstep(L, t);
+#endif
+  oldasize = setlimittosize(t);
+#if defined(LUA_USE_SMALLTABLE)
+  inl = fitsinline(t, nhsize);  /* new hash part in the inline nodes? */
+  if (inl) {
+    int lsize = luaO_ceillog2(inlinesize(t));
+    if (t->node == inlinenodes(t))  /* old hash part there too? */
+      movehashpart(t, saved);
+    initnodes(&newt, inlinenodes(t), lsize);
+  }
+  else
+#endif
   /* create new hash part with appropriate size into 'newt' */
   setnodevector(L, &newt, nhsize);
   if (newasize < oldasize) {  /* will array shrink? */
@@ -570,6 +774,15 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
   /* allocate new array */
   newarray = luaM_reallocvector(L, t->array, oldasize, newasize, TValue);
   if (l_unlikely(newarray == NULL && newasize > 0)) {  /* allocation failed? */
+#if defined(LUA_USE_SMALLTABLE)
+    if (inl) {  /* new hash part in the inline nodes? */
+      if (t->node == saved)  /* bring the old one back */
+        movehashpart(t, inlinenodes(t));
+      else  /* keep their number again */
+        gnext(inlinenodes(t)) = sizenode(&newt);
+    }
+    else
+#endif
     freehash(L, &newt);  /* release new hash part */
     luaM_error(L);  /* raise error (with array unchanged) */
   }
@@ -581,7 +794,13 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
      setempty(&t->array[i]);
   /* re-insert elements from old hash part into new parts */
   reinsert(L, &newt, t);  /* 'newt' now has the old hash */
+#if defined(LUA_USE_SMALLTABLE)
+  if (hasinline(t) && newt.node == inlinenodes(t))  /* left inline nodes? */
+    gnext(inlinenodes(t)) = sizenode(&newt);  /* keep their number */
+  else if (!inl || newt.node != saved)
+#endif
   freehash(L, &newt);  /* free old hash part */
+  newlayout(L, t);  /* nodes were moved */
 }
 
 
@@ -610,6 +829,13 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   totaluse++;
   /* compute new size for array part */
   asize = computesizes(nums, &na);
+#if defined(LUA_USE_INCREHASH)
+  if (asize == t->alimit && sizenode(t) >= LUAI_INCREHASH &&
+      !inrehash(t) && luaO_ceillog2(totaluse - na) == t->lsizenode + 1) {
+    startrehash(L, t);  /* only the hash part doubles: do it gradually */
+    return;
+  }
+#endif
   /* resize the table to new computed sizes */
   luaH_resize(L, t, asize, totaluse - na);
 }
@@ -621,22 +847,64 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
 */
 
 
-Table *luaH_new (lua_State *L) {
-  GCObject *o = luaC_newobj(L, LUA_VTABLE, sizeof(Table));
+static Table *newtable (lua_State *L, size_t size) {
+  GCObject *o = luaC_newobj(L, LUA_VTABLE, size);
   Table *t = gco2t(o);
   t->metatable = NULL;
   t->flags = cast_byte(maskflags);  /* table has no metamethod fields */
   t->array = NULL;
   t->alimit = 0;
   setnodevector(L, t, 0);
+  newlayout(L, t);
+#if defined(LUA_USE_INCREHASH)
+  t->oldnode = NULL;
+#endif
   return t;
 }
 
 
+Table *luaH_new (lua_State *L) {
+  return newtable(L, sizeof(Table));
+}
+
+
+#if defined(LUA_USE_SMALLTABLE)
+
+/*
+** New table for 'nhsize' fields: up to LUAI_SMALLNODES of them, it gets
+** inline nodes for them (see 'luaH_resize' to use them).
+*/
+Table *luaH_newrecord (lua_State *L, unsigned int nhsize) {
+  if (nhsize == 0 || nhsize > LUAI_SMALLNODES)
+    return luaH_new(L);
+  else {
+    int size = twoto(luaO_ceillog2(nhsize));
+    Table *t = newtable(L, sizeof(Table) + size * sizeof(Node));
+    t->flags |= BITINL;
+    gnext(inlinenodes(t)) = size;
+    return t;
+  }
+}
+
+#endif
+
+
 void luaH_free (lua_State *L, Table *t) {
+  size_t size = sizeof(Table);
+#if defined(LUA_USE_SMALLTABLE)
+  if (hasinline(t)) {
+    size += inlinesize(t) * sizeof(Node);
+    if (t->node == inlinenodes(t))
+      setnodevector(L, t, 0);  /* nothing else to free */
+  }
+#endif
+#if defined(LUA_USE_INCREHASH)
+  if (inrehash(t))
+    luaM_freearray(L, t->oldnode, cast_sizet(sizenode(t) / 2));
+#endif
   freehash(L, t);
   luaM_freearray(L, t->array, luaH_realasize(t));
-  luaM_free(L, t);
+  luaM_freemem(L, t, size);
 }
 
 
@@ -658,35 +926,17 @@ static Node *getfreepos (Table *t) {
 ** position is free. If not, check whether colliding node is in its main
 ** position or not: if it is not, move colliding node to an empty place and
 ** put new key in its main position; otherwise (colliding node is in its main
-** position), new key goes to an empty position.
+** position), new key goes to an empty position. Return 0 when there is
+** no free place.
 */
-void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
-  Node *mp;
-  TValue aux;
-  if (l_unlikely(ttisnil(key)))
-    luaG_runerror(L, "table index is nil");
-  else if (ttisfloat(key)) {
-    lua_Number f = fltvalue(key);
-    lua_Integer k;
-    if (luaV_flttointeger(f, &k, F2Ieq)) {  /* does key fit in an integer? */
-      setivalue(&aux, k);
-      key = &aux;  /* insert it as an integer */
-    }
-    else if (l_unlikely(luai_numisnan(f)))
-      luaG_runerror(L, "table index is NaN");
-  }
-  if (ttisnil(value))
-    return;  /* do not insert nil values */
-  mp = mainpositionTV(t, key);
+static int insertkey (lua_State *L, Table *t, const TValue *key,
+                                              TValue *value) {
+  Node *mp = mainpositionTV(t, key);
   if (!isempty(gval(mp)) || isdummy(t)) {  /* main position is taken? */
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
-    if (f == NULL) {  /* cannot find a free place? */
-      rehash(L, t, key);  /* grow table */
-      /* whatever called 'newkey' takes care of TM cache */
-      luaH_set(L, t, key, value);  /* insert key into grown table */
-      return;
-    }
+    if (f == NULL)  /* cannot find a free place? */
+      return 0;
     lua_assert(!isdummy(t));
     othern = mainpositionfromnode(t, mp);
     if (othern != mp) {  /* is colliding node out of its main position? */
@@ -710,10 +960,45 @@ void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
       mp = f;
     }
   }
+  if (!keyisnil(mp))  /* node held a moved or a removed key? */
+    newlayout(L, t);
   setnodekey(L, mp, key);
   luaC_barrierback(L, obj2gco(t), key);
   lua_assert(isempty(gval(mp)));
   setobj2t(L, gval(mp), value);
+  return 1;
+}
+
+
+/*
+** Put 'key', which is not in 't', into 't' with 'value', growing the
+** table when there is no room for it.
+*/
+void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
+  TValue aux;
+  if (l_unlikely(ttisnil(key)))
+    luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {
+    lua_Number f = fltvalue(key);
+    lua_Integer k;
+    if (luaV_flttointeger(f, &k, F2Ieq)) {  /* does key fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (l_unlikely(luai_numisnan(f)))
+      luaG_runerror(L, "table index is NaN");
+  }
+  if (ttisnil(value))
+    return;  /* do not insert nil values */
+#if defined(LUA_USE_INCREHASH)
+  if (inrehash(t))
+    rehashstep(L, t);
+#endif
+  if (!insertkey(L, t, key, value)) {  /* cannot find a free place? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    luaH_set(L, t, key, value);  /* insert key into grown table */
+  }
 }
 
 
@@ -745,6 +1030,12 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
         n += nx;
       }
     }
+#if defined(LUA_USE_INCREHASH)
+    if (inrehash(t)) {  /* still may be in the old hash part */
+      Table ot;
+      return luaH_getint(oldhashpart(t, &ot), key);
+    }
+#endif
     return &absentkey;
   }
 }
@@ -762,10 +1053,17 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
     else {
       int nx = gnext(n);
       if (nx == 0)
-        return &absentkey;  /* not found */
+        break;
       n += nx;
     }
   }
+#if defined(LUA_USE_INCREHASH)
+  if (inrehash(t)) {  /* still may be in the old hash part */
+    Table ot;
+    return luaH_getshortstr(oldhashpart(t, &ot), key);
+  }
+#endif
+  return &absentkey;  /* not found */
 }
 
 
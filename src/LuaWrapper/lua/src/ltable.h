@@ -35,6 +35,29 @@
 #define nodefromval(v)	cast(Node *, (v))
 
 
+/*
+** Nodes of a table, counting those of an old hash part still being
+** moved into the current one (see LUA_USE_INCREHASH), which has half
+** its size; 'anynode' numbers the old ones after the current ones.
+*/
+#if defined(LUA_USE_INCREHASH)
+
+#define inrehash(t)	((t)->oldnode != NULL)
+
+#define allsizenode(t)	(sizenode(t) + (inrehash(t) ? sizenode(t) / 2 : 0))
+
+#define anynode(t,i)  \
+	(cast_int(i) < sizenode(t) ? gnode(t, i)  \
+	                          : &(t)->oldnode[cast_int(i) - sizenode(t)])
+
+#else
+
+#define allsizenode(t)	sizenode(t)
+#define anynode(t,i)	gnode(t,i)
+
+#endif
+
+
 LUAI_FUNC const TValue *luaH_getint (Table *t, lua_Integer key);
 LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
                                                     TValue *value);
@@ -48,6 +71,11 @@ LUAI_FUNC void luaH_set (lua_State *L, Table *t, const TValue *key,
 LUAI_FUNC void luaH_finishset (lua_State *L, Table *t, const TValue *key,
                                        const TValue *slot, TValue *value);
 LUAI_FUNC Table *luaH_new (lua_State *L);
+#if defined(LUA_USE_SMALLTABLE)
+LUAI_FUNC Table *luaH_newrecord (lua_State *L, unsigned int nhsize);
+#else
+#define luaH_newrecord(L,nhsize)	luaH_new(L)
+#endif
 LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
                                                     unsigned int nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize);
@@ -32,6 +32,17 @@
 #define LUA_INITVARVERSION	LUA_INIT_VAR LUA_VERSUFFIX
 
 
+LUA_API void LuaC_gcfull(lua_State *L){
+  luaC_fullgc(L,1);
+}
+
+
+/*
+** LUA_NO_MAIN leaves the stand-alone interpreter out when this file is
+** linked into a host program (the native build of LuaEngine)
+*/
+#if !defined(LUA_NO_MAIN)	/* { */
+
 static lua_State *globalL = NULL;
 
 static const char *progname = LUA_PROGNAME;
@@ -102,10 +113,6 @@ static void print_usage (const char *badoption) {
   progname);
 }
 
-LUA_API void LuaC_gcfull(lua_State *L){
-  luaC_fullgc(L,1);
-}
-
 
 /*
 ** Prints an error message, adding the program name in front of it
@@ -668,3 +675,5 @@ int main (int argc, char **argv) {
   return (result && status == LUA_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+#endif				/* } */
+
@@ -85,6 +85,9 @@ typedef struct lua_State lua_State;
 #define LUA_RIDX_GLOBALS	2
 #define LUA_RIDX_LAST		LUA_RIDX_GLOBALS
 
+/* registry field with the compile-time constants declared by the host */
+#define LUA_HOSTCONST_TABLE	"_HOSTCONST"
+
 
 /* type of numbers in Lua */
 typedef LUA_NUMBER lua_Number;
@@ -105,6 +108,22 @@ typedef LUA_KCONTEXT lua_KContext;
 */
 typedef int (*lua_CFunction) (lua_State *L);
 
+#if defined(LUA_USE_FASTCALL)
+/*
+** Type for the fast variant of a C function (see 'lua_pushfastcfunction'),
+** which gets its arguments and gives its results in 'v' as C numbers
+*/
+typedef union lua_FastValue {
+  lua_Integer i;
+  lua_Number n;
+} lua_FastValue;
+
+typedef int (*lua_FastCFunction) (lua_FastValue *v);
+
+/* maximum number of arguments and of results of a fast C function */
+#define LUA_FASTMAX	8
+#endif
+
 /*
 ** Type for continuation functions
 */
@@ -131,6 +150,14 @@ typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 typedef void (*lua_WarnFunction) (void *ud, const char *msg, int tocont);
 
 
+/*
+** Type for functions that find the line of an instruction whose debug
+** information was dropped ('protoid' numbers the prototypes of a chunk
+** in pre-order, starting with 0 for the main function)
+*/
+typedef int (*lua_LineMap) (void *ud, const char *source, int protoid, int pc);
+
+
 
 
 /*
@@ -239,6 +266,11 @@ LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
 LUA_API const char *(lua_pushfstring) (lua_State *L, const char *fmt, ...);
 LUA_API void  (lua_pushcclosure) (lua_State *L, lua_CFunction fn, int n);
+#if defined(LUA_USE_FASTCALL)
+LUA_API int   (lua_pushfastcfunction) (lua_State *L, lua_CFunction fn,
+                                       lua_FastCFunction fast,
+                                       const char *sig);
+#endif
 LUA_API void  (lua_pushboolean) (lua_State *L, int b);
 LUA_API void  (lua_pushlightuserdata) (lua_State *L, void *p);
 LUA_API int   (lua_pushthread) (lua_State *L);
@@ -291,6 +323,10 @@ LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
 
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data, int strip);
 
+LUA_API int (lua_dropdebug) (lua_State *L, lua_Writer writer, void *data);
+LUA_API void (lua_setlinemap) (lua_State *L, lua_LineMap f, void *ud);
+LUA_API int (lua_linkglobals) (lua_State *L, int idx);
+
 
 /*
 ** coroutine functions
@@ -350,6 +386,8 @@ LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 LUA_API void (lua_toclose) (lua_State *L, int idx);
 LUA_API void (lua_closeslot) (lua_State *L, int idx);
 
+LUA_API lua_Unsigned (lua_dispatchcount) (lua_State *L);
+
 
 /*
 ** {==============================================================
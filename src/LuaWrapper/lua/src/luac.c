@@ -395,6 +395,10 @@ static void PrintCode(const Proto* f)
 	printf(COMMENT "%s",UPVALNAME(b));
 	break;
    case OP_GETTABUP:
+#if defined(LUA_USE_SUPERINSTR)
+   case OP_GETTABUPCALL:
+   case OP_GETTABUPFIELD:
+#endif
 	printf("%d %d %d",a,b,c);
 	printf(COMMENT "%s",UPVALNAME(b));
 	printf(" "); PrintConstant(f,c);
@@ -406,6 +410,9 @@ static void PrintCode(const Proto* f)
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_GETFIELD:
+#if defined(LUA_USE_SUPERINSTR)
+   case OP_GETFIELDFIELD:
+#endif
 	printf("%d %d %d",a,b,c);
 	printf(COMMENT); PrintConstant(f,c);
 	break;
@@ -486,12 +493,24 @@ static void PrintCode(const Proto* f)
 	printf("%d %d %d",a,b,sc);
 	break;
    case OP_ADD:
+#if defined(LUA_USE_QUICKEN)
+   case OP_ADDINT:
+   case OP_ADDFLT:
+#endif
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_SUB:
+#if defined(LUA_USE_QUICKEN)
+   case OP_SUBINT:
+   case OP_SUBFLT:
+#endif
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_MUL:
+#if defined(LUA_USE_QUICKEN)
+   case OP_MULINT:
+   case OP_MULFLT:
+#endif
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_MOD:
@@ -501,6 +520,9 @@ static void PrintCode(const Proto* f)
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_DIV:
+#if defined(LUA_USE_QUICKEN)
+   case OP_DIVFLT:
+#endif
 	printf("%d %d %d",a,b,c);
 	break;
    case OP_IDIV:
@@ -564,9 +586,17 @@ static void PrintCode(const Proto* f)
 	printf("%d %d %d",a,b,isk);
 	break;
    case OP_LT:
+#if defined(LUA_USE_QUICKEN)
+   case OP_LTINT:
+   case OP_LTFLT:
+#endif
 	printf("%d %d %d",a,b,isk);
 	break;
    case OP_LE:
+#if defined(LUA_USE_QUICKEN)
+   case OP_LEINT:
+   case OP_LEFLT:
+#endif
 	printf("%d %d %d",a,b,isk);
 	break;
    case OP_EQK:
@@ -119,6 +119,114 @@
 #define LUA_32BITS	1
 
 
+/*
+@@ LUA_NO_PARSER removes the compiler (lparser.c, llex.c and lcode.c)
+** from the build, so that only precompiled binary chunks can be loaded.
+** Firmware shipping bytecode built by tools/luac can define it in its
+** build flags to save flash and the heap used by the parser.
+*/
+/* #define LUA_NO_PARSER */
+
+
+/*
+@@ LUA_USE_SUPERINSTR makes the compiler and the loader fuse common
+** instruction pairs (a global read followed by a call or a field read,
+** a field read followed by another one) into superinstructions, so that
+** the pair costs a single dispatch. Binary chunks keep the standard
+** opcodes, and are fused again when loaded.
+*/
+/* #define LUA_USE_SUPERINSTR */
+
+
+/*
+@@ LUA_USE_DISPATCHCOUNT makes the interpreter count the instructions
+** it dispatches, which 'lua_dispatchcount' returns; a superinstruction
+** counts once. It is meant for benchmarks, to see how many dispatches
+** an option such as LUA_USE_SUPERINSTR saves, and costs an increment
+** per dispatch.
+*/
+/* #define LUA_USE_DISPATCHCOUNT */
+
+
+/*
+@@ LUA_USE_INLINECACHE gives each global read and each field access
+** ('t.name') of a function an inline cache, keeping the hash node where
+** the name was last found and the layout stamp its table had then. While
+** the table keeps that layout, and the node is in its hash part and
+** still holds the name, the access goes straight to the node, without
+** hashing the name.
+*/
+/* #define LUA_USE_INLINECACHE */
+
+
+/*
+@@ LUA_USE_QUICKEN lets arithmetic ('+', '-', '*', '/') and order ('<',
+** '<=') instructions rewrite themselves at run time into integer-only
+** or float-only variants once they see operands of one type, and back
+** when that guess fails. Binary chunks keep the standard opcodes.
+*/
+/* #define LUA_USE_QUICKEN */
+
+
+/*
+@@ LUA_USE_DEADBRANCH lets the compiler fold comparisons of constants
+** (numerals, strings for equality, and '<const>' or host constants with
+** such values) and leave out of the code the parts of an 'if' that a
+** constant condition rules out. Without it, constant conditions are
+** tested at run time as in standard Lua.
+*/
+/* #define LUA_USE_DEADBRANCH */
+
+
+/*
+@@ LUA_USE_FASTCALL lets C functions pushed with a fast variant
+** ('lua_pushfastcfunction') be called from 'OP_CALL' without a call
+** frame, converting numeric arguments and results in the caller's
+** registers. It adds a test to every call and the fields of the fast
+** variant to every C closure.
+*/
+/* #define LUA_USE_FASTCALL */
+
+
+/*
+@@ LUA_USE_SMALLTABLE gives tables built for a few fields (a constructor
+** such as '{x = 1, y = 2}', or 'lua_createtable' with a small 'nrec')
+** room for their hash part in their own allocation, so that they take
+** one allocation instead of two while that part fits there (see
+** LUAI_SMALLNODES).
+*/
+/* #define LUA_USE_SMALLTABLE */
+
+
+/*
+@@ LUA_USE_INCREHASH spreads the growth of large hash parts (see
+** LUAI_INCREHASH) over the insertions that follow it: the table keeps
+** its old hash part next to the new one and moves a few of its nodes
+** (LUAI_REHASHSTEP) at each new key, instead of moving all of them at
+** once. Lookups may then search both parts.
+*/
+/* #define LUA_USE_INCREHASH */
+
+
+/*
+@@ LUA_USE_TABLESITE lets each table constructor ('NEWTABLE' site) of
+** a function remember the sizes its last table reached, and give them
+** to the tables it creates next, so that tables filled the same way on
+** every run of a loop are not grown again each time.
+*/
+/* #define LUA_USE_TABLESITE */
+
+
+/*
+@@ LUA_USE_NEXTHINT makes 'next' remember, per table (see
+** LUAI_NEXTHINTS), the hash node it returned last. When it is called
+** with the key of that node, as 'pairs' loops do, it resumes from there
+** instead of searching the key again; any other key is searched as
+** before.
+*/
+/* #define LUA_USE_NEXTHINT */
+
+
 /*
 @@ LUA_C89_NUMBERS ensures that Lua uses the largest types available for
 ** C89 ('long' and 'double'); Windows always has '__int64', so it does
@@ -20,6 +20,7 @@
 #include "lfunc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstring.h"
 #include "lundump.h"
 #include "lzio.h"
@@ -146,6 +147,15 @@ static void loadCode (LoadState *S, Proto *f) {
   f->code = luaM_newvectorchecked(S->L, n, Instruction);
   f->sizecode = n;
   loadVector(S, f->code, n);
+#if defined(LUA_USE_SUPERINSTR)
+  luaP_fusecode(f->code, n);
+#endif
+#if defined(LUA_USE_INLINECACHE)
+  luaF_initcache(S->L, f);
+#endif
+#if defined(LUA_USE_TABLESITE)
+  luaF_initsites(S->L, f);
+#endif
 }
 
 
@@ -311,6 +321,7 @@ static void checkHeader (LoadState *S) {
 LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
   LoadState S;
   LClosure *cl;
+  TString *source = NULL;
   if (*name == '@' || *name == '=')
     S.name = name + 1;
   else if (*name == LUA_SIGNATURE[0])
@@ -325,7 +336,17 @@ LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
   luaD_inctop(L);
   cl->p = luaF_newproto(L);
   luaC_objbarrier(L, cl, cl->p);
-  loadFunction(&S, cl->p, NULL);
+  if (*name == '@' || *name == '=') {  /* stripped chunks keep the name */
+    source = luaS_new(L, name);
+    setsvalue2s(L, L->top, source);  /* anchor it */
+    luaD_inctop(L);
+  }
+  loadFunction(&S, cl->p, source);
+  if (source != NULL) {
+    if (cl->p->source == source)
+      luaC_objbarrier(L, cl->p, source);
+    L->top--;  /* remove source name */
+  }
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luai_verifycode(L, cl->p);
   return cl;
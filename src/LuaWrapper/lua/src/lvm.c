@@ -803,6 +803,70 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
 }
 
 
+#if defined(LUA_USE_FASTCALL)
+
+/*
+** If 'ra' holds a C closure with a fast variant, call that variant with
+** its arguments in the registers after it, leaving 'nresults' results
+** from 'ra' on (all of them if LUA_MULTRET). The call needs no CallInfo,
+** as the fast variant does not use the stack. Returns 0, before any
+** call, if it must go through 'luaD_precall': there is no fast variant,
+** call or return hooks are active, an argument is missing or does not
+** convert, or the fast variant declined.
+*/
+l_sinline int fastcall (lua_State *L, StkId ra, int nresults) {
+  CClosure *cl;
+  lua_FastValue v[LUA_FASTMAX];
+  int nargs, nres, i;
+  if (!ttisCclosure(s2v(ra)) || (cl = clCvalue(s2v(ra)))->fast == NULL)
+    return 0;
+  nargs = cl->nfargs;
+  nres = cl->nfres;
+  if (l_unlikely(L->hookmask & (LUA_MASKCALL | LUA_MASKRET)) ||
+      cast_int(L->top - ra) - 1 < nargs)
+    return 0;
+  for (i = 0; i < nargs; i++) {
+    TValue *o = s2v(ra + 1 + i);
+    if (cl->fintargs & (1 << i)) {
+      if (!tointegerns(o, &v[i].i))
+        return 0;
+    }
+    else if (!tonumberns(o, v[i].n))
+      return 0;
+  }
+  if (nresults < 0) {  /* all results? */
+    if (L->stack_last - ra < nres)
+      return 0;  /* no room for them */
+    nresults = nres;
+  }
+  if ((*cl->fast)(v) != 0)
+    return 0;  /* declined */
+  for (i = 0; i < nresults; i++) {
+    TValue *o = s2v(ra + i);
+    if (i >= nres)
+      setnilvalue(o);  /* complete missing results */
+    else if (cl->fboolres & (1 << i)) {
+      if (v[i].i) setbtvalue(o);
+      else setbfvalue(o);
+    }
+    else if (cl->fintres & (1 << i)) {
+      setivalue(o, v[i].i);
+    }
+    else {
+      setfltvalue(o, v[i].n);
+    }
+  }
+  L->top = ra + nresults;
+  return 1;
+}
+
+#else
+
+#define fastcall(L,ra,nresults)	0
+
+#endif
+
+
 /*
 ** finish execution of an opcode interrupted by a yield
 */
@@ -810,7 +874,7 @@ void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->func + 1;
   Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
-  OpCode op = GET_OPCODE(inst);
+  OpCode op = luaP_baseop(GET_OPCODE(inst));
   switch (op) {  /* finish its execution */
     case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
       setobjs2s(L, base + GETARG_A(*(ci->u.l.savedpc - 2)), --L->top);
@@ -1037,6 +1101,112 @@ void luaV_finishOp (lua_State *L) {
 /* }================================================================== */
 
 
+/*
+** {==================================================================
+** Quickening: a generic arithmetic or order instruction whose operands
+** are both integers or both floats rewrites itself into the variant for
+** that type, which only checks its guard. A guard miss turns it back
+** into the generic instruction, which then runs it. Each miss takes one
+** from the budget of the function, and a function out of budget stops
+** quickening, so that sites mixing types settle on the generic code.
+** ===================================================================
+*/
+
+#if defined(LUA_USE_QUICKEN)
+
+/* entry of a generic handler, reached from a guard miss */
+#define vmgeneric(l)	l:
+
+/* instruction being run, written through the code of its function */
+#define qinst()		(cl->p->code[pcRel(pc, cl->p)])
+
+/* quicken the instruction being run into opcode 'op' */
+#define quicken(op)  \
+  { if (cl->p->qbudget > 0) SET_OPCODE(qinst(), op); }
+
+/* guard miss: back to generic opcode 'op', run through its entry 'l' */
+#define unquicken(op,l)  \
+  { SET_OPCODE(qinst(), op);  \
+    if (cl->p->qbudget > 0) cl->p->qbudget--;  \
+    goto l; }
+
+/*
+** Generic arithmetic with register operands, quickened into 'qi' for
+** integer operands and into 'qf' for float operands.
+*/
+#define op_arithq(L,iop,fop,qi,qf) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (ttisinteger(v1) && ttisinteger(v2)) quicken(qi)  \
+  else if (ttisfloat(v1) && ttisfloat(v2)) quicken(qf)  \
+  op_arith_aux(L, v1, v2, iop, fop); }
+
+/* generic float arithmetic, quickened into 'qf' for float operands */
+#define op_arithfq(L,fop,qf) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (ttisfloat(v1) && ttisfloat(v2)) quicken(qf)  \
+  op_arithf_aux(L, v1, v2, fop); }
+
+/* generic order, quickened into 'qi' or 'qf' */
+#define op_orderq(L,opi,opn,other,qi,qf) {  \
+  TValue *v1 = s2v(ra);  \
+  TValue *v2 = vRB(i);  \
+  if (ttisinteger(v1) && ttisinteger(v2)) quicken(qi)  \
+  else if (ttisfloat(v1) && ttisfloat(v2)) quicken(qf)  \
+  op_order(L, opi, opn, other); }
+
+/* integer arithmetic, generic opcode 'op' with entry 'l' */
+#define op_arithint(L,iop,op,l) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisinteger(v1) && ttisinteger(v2))) {  \
+    lua_Integer i1 = ivalue(v1); lua_Integer i2 = ivalue(v2);  \
+    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
+  }  \
+  else unquicken(op, l); }
+
+/* float arithmetic, generic opcode 'op' with entry 'l' */
+#define op_arithflt(L,fop,op,l) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  if (l_likely(ttisfloat(v1) && ttisfloat(v2))) {  \
+    lua_Number n1 = fltvalue(v1); lua_Number n2 = fltvalue(v2);  \
+    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
+  }  \
+  else unquicken(op, l); }
+
+/* integer order, generic opcode 'op' with entry 'l' */
+#define op_orderint(L,opi,op,l) {  \
+  TValue *rb = vRB(i);  \
+  if (l_likely(ttisinteger(s2v(ra)) && ttisinteger(rb))) {  \
+    int cond = opi(ivalue(s2v(ra)), ivalue(rb));  \
+    docondjump();  \
+  }  \
+  else unquicken(op, l); }
+
+/* float order, generic opcode 'op' with entry 'l' */
+#define op_orderflt(L,opf,op,l) {  \
+  TValue *rb = vRB(i);  \
+  if (l_likely(ttisfloat(s2v(ra)) && ttisfloat(rb))) {  \
+    int cond = opf(fltvalue(s2v(ra)), fltvalue(rb));  \
+    docondjump();  \
+  }  \
+  else unquicken(op, l); }
+
+#else
+
+#define vmgeneric(l)	/* empty */
+
+#define op_arithq(L,iop,fop,qi,qf)	op_arith(L, iop, fop)
+#define op_arithfq(L,fop,qf)	op_arithf(L, fop)
+#define op_orderq(L,opi,opn,other,qi,qf)	op_order(L, opi, opn, other)
+
+#endif
+
+/* }================================================================== */
+
+
 /*
 ** {==================================================================
 ** Function 'luaV_execute': main interpreter loop
@@ -1126,12 +1296,19 @@ void luaV_finishOp (lua_State *L) {
                          updatetrap(ci), ofs); \
            luai_threadyield(L); }
 
+#if defined(LUA_USE_DISPATCHCOUNT)
+#define countdispatch(L)	(G(L)->ndispatch++)
+#else
+#define countdispatch(L)	((void)0)
+#endif
+
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
     trap = luaG_traceexec(L, pc);  /* handle hooks */ \
     updatebase(ci);  /* correct stack */ \
   } \
+  countdispatch(L); \
   i = *(pc++); \
   ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
 }
@@ -1141,6 +1318,153 @@ void luaV_finishOp (lua_State *L) {
 #define vmbreak		break
 
 
+#if defined(LUA_USE_SUPERINSTR)
+
+/* entry of a handler, reached from a superinstruction */
+#define vmentry(l)	l:
+
+/*
+** Second half of a superinstruction: run the next instruction through
+** handler entry 'l', without a dispatch. Pending hooks or a stack
+** reallocation ('trap') need the regular fetch, so the next instruction
+** then runs on its own.
+*/
+#define vmfuse(l)	{ \
+  if (l_unlikely(trap)) { vmbreak; } \
+  i = *(pc++); \
+  ra = RA(i); \
+  goto l; \
+}
+
+#else
+
+#define vmentry(l)	/* empty */
+
+#endif
+
+
+#if defined(LUA_USE_INLINECACHE)
+
+/* inline cache of the instruction being run */
+#define icacheof(p,pc)	(&(p)->icache[(p)->icindex[pcRel(pc, p)]])
+
+/*
+** Read through an inline cache: while the table keeps the layout it had
+** when the cache was filled, the cached node still holds the key, and
+** the read is a hit if the key still has a value. As layout stamps wrap
+** around, a cache filled from a table since freed may match the stamp
+** of another one, so the node must also lie in the hash part of 't' and
+** hold 'key'.
+*/
+#define icacheget(t,ic,key,slot) \
+  (ttistable(t) && hvalue(t)->layout == (ic)->layout && \
+   icacheinnode(hvalue(t), (ic)->slot) && \
+   keyisshrstr((ic)->slot) && keystrval((ic)->slot) == (key) && \
+   (slot = gval((ic)->slot), !isempty(slot)))
+
+/* node 'n' is in the hash part of table 'h' */
+#define icacheinnode(h,n)  \
+  ((n) >= (h)->node && (n) < (h)->node + sizenode(h))
+
+/*
+** Fill an inline cache with the node of a successful raw read, unless
+** the node is in the old hash part of a table being rehashed, where
+** 'icacheget' would not find it.
+*/
+#define icacheset(p,ic,t,slot) \
+  ((ic) != (p)->icache  /* not the shared entry? */ && \
+   icacheinnode(hvalue(t), nodefromval(slot)) \
+   ? ((ic)->slot = nodefromval(slot), (ic)->layout = hvalue(t)->layout) : 0)
+
+/*
+** Raw read of the short string 'key' in 't' through the inline cache of
+** the instruction, filling the cache when the key is found elsewhere.
+*/
+#define fastgetic(L,t,key,slot) \
+  (icacheget(t, ic, key, slot) || \
+   (luaV_fastget(L, t, key, slot, luaH_getshortstr) && \
+    (icacheset(cl->p, ic, t, slot), 1)))
+
+#define declicache	ICache *ic = icacheof(cl->p, pc);
+
+#else
+
+#define fastgetic(L,t,key,slot)	luaV_fastget(L, t, key, slot, luaH_getshortstr)
+
+#define declicache	/* empty */
+
+#endif
+
+
+#if defined(LUA_USE_TABLESITE)
+
+/*
+** Sizes for a new table of constructor 'ts', which asks for 'b' hash
+** and 'c' array slots. When the register of the constructor still holds
+** the table it created before, the sizes that table reached are kept
+** for the next ones: the array part is halved while its upper half is
+** empty, and the hash part counts only the keys it holds, so that the
+** sizes follow tables that shrink; both are limited to LUAI_MAXSITESIZE.
+** (A register never holds a dead object, as the atomic phase of the
+** collector clears the stack above the top.)
+*/
+static void sitesizes (TableSite *ts, const TValue *ra, int *b, int *c) {
+  if (ttistable(ra) && hvalue(ra) == ts->last) {
+    Table *t = ts->last;
+    unsigned int asize = luaH_realasize(t);
+    unsigned int hsize = 0;
+    int j = allsizenode(t);  /* both parts of a table being rehashed */
+    while (asize > 0 && isempty(&t->array[asize / 2]))
+      asize /= 2;
+    while (j--) {
+      if (!isempty(gval(anynode(t, j))))
+        hsize++;
+    }
+    ts->asize = (asize < LUAI_MAXSITESIZE) ? asize : LUAI_MAXSITESIZE;
+    ts->hsize = (hsize < LUAI_MAXSITESIZE) ? hsize : LUAI_MAXSITESIZE;
+  }
+  if (ts->asize > cast_uint(*c))
+    *c = cast_int(ts->asize);
+  if (ts->hsize > cast_uint(*b))
+    *b = cast_int(ts->hsize);
+}
+
+#endif
+
+
+/*
+** Read a global: upvalue 'B' (usually _ENV) indexed by the short string
+** constant 'C'.
+*/
+#define op_gettabup(L) {  \
+  const TValue *slot;  \
+  TValue *upval = cl->upvals[GETARG_B(i)]->v;  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a string */  \
+  declicache  \
+  if (fastgetic(L, upval, key, slot)) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(luaV_finishget(L, upval, rc, ra, slot)); }
+
+
+/*
+** Read a field: register 'B' indexed by the short string constant 'C'.
+*/
+#define op_getfield(L) {  \
+  const TValue *slot;  \
+  TValue *rb = vRB(i);  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a string */  \
+  declicache  \
+  if (fastgetic(L, rb, key, slot)) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(luaV_finishget(L, rb, rc, ra, slot)); }
+
+
 void luaV_execute (lua_State *L, CallInfo *ci) {
   LClosure *cl;
   TValue *k;
@@ -1237,15 +1561,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_GETTABUP) {
-        const TValue *slot;
-        TValue *upval = cl->upvals[GETARG_B(i)]->v;
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(luaV_finishget(L, upval, rc, ra, slot));
+        op_gettabup(L);
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
@@ -1276,16 +1592,9 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         vmbreak;
       }
-      vmcase(OP_GETFIELD) {
-        const TValue *slot;
-        TValue *rb = vRB(i);
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        if (luaV_fastget(L, rb, key, slot, luaH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(luaV_finishget(L, rb, rc, ra, slot));
+      vmcase(OP_GETFIELD)
+      vmentry(l_getfield) {
+        op_getfield(L);
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
@@ -1334,7 +1643,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a string */
-        if (luaV_fastget(L, s2v(ra), key, slot, luaH_getshortstr)) {
+        declicache
+        if (fastgetic(L, s2v(ra), key, slot)) {
           luaV_finishfastset(L, s2v(ra), slot, rc);
         }
         else
@@ -1345,17 +1655,29 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         int b = GETARG_B(i);  /* log2(hash size) + 1 */
         int c = GETARG_C(i);  /* array size */
         Table *t;
+#if defined(LUA_USE_TABLESITE)
+        TableSite *ts;
+#endif
         if (b > 0)
           b = 1 << (b - 1);  /* size is 2^(b - 1) */
         lua_assert((!TESTARG_k(i)) == (GETARG_Ax(*pc) == 0));
         if (TESTARG_k(i))  /* non-zero extra argument? */
           c += GETARG_Ax(*pc) * (MAXARG_C + 1);  /* add it to size */
+#if defined(LUA_USE_TABLESITE)
+        ts = luaF_tablesite(cl->p, pcRel(pc, cl->p));
+        if (ts != NULL)
+          sitesizes(ts, s2v(ra), &b, &c);
+#endif
         pc++;  /* skip extra argument */
         L->top = ra + 1;  /* correct top in case of emergency GC */
-        t = luaH_new(L);  /* memory allocation */
+        t = luaH_newrecord(L, b);  /* memory allocation */
         sethvalue2s(L, ra, t);
         if (b != 0 || c != 0)
           luaH_resize(L, t, c, b);  /* idem */
+#if defined(LUA_USE_TABLESITE)
+        if (ts != NULL)
+          ts->last = t;
+#endif
         checkGC(L, ra + 1);
         vmbreak;
       }
@@ -1434,16 +1756,16 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         vmbreak;
       }
-      vmcase(OP_ADD) {
-        op_arith(L, l_addi, luai_numadd);
+      vmcase(OP_ADD) vmgeneric(l_add) {
+        op_arithq(L, l_addi, luai_numadd, OP_ADDINT, OP_ADDFLT);
         vmbreak;
       }
-      vmcase(OP_SUB) {
-        op_arith(L, l_subi, luai_numsub);
+      vmcase(OP_SUB) vmgeneric(l_sub) {
+        op_arithq(L, l_subi, luai_numsub, OP_SUBINT, OP_SUBFLT);
         vmbreak;
       }
-      vmcase(OP_MUL) {
-        op_arith(L, l_muli, luai_nummul);
+      vmcase(OP_MUL) vmgeneric(l_mul) {
+        op_arithq(L, l_muli, luai_nummul, OP_MULINT, OP_MULFLT);
         vmbreak;
       }
       vmcase(OP_MOD) {
@@ -1454,8 +1776,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         op_arithf(L, luai_numpow);
         vmbreak;
       }
-      vmcase(OP_DIV) {  /* float division (always with floats) */
-        op_arithf(L, luai_numdiv);
+      vmcase(OP_DIV) vmgeneric(l_div) {  /* float division (always with floats) */
+        op_arithfq(L, luai_numdiv, OP_DIVFLT);
         vmbreak;
       }
       vmcase(OP_IDIV) {  /* floor division */
@@ -1576,12 +1898,12 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         docondjump();
         vmbreak;
       }
-      vmcase(OP_LT) {
-        op_order(L, l_lti, LTnum, lessthanothers);
+      vmcase(OP_LT) vmgeneric(l_lt) {
+        op_orderq(L, l_lti, LTnum, lessthanothers, OP_LTINT, OP_LTFLT);
         vmbreak;
       }
-      vmcase(OP_LE) {
-        op_order(L, l_lei, LEnum, lessequalothers);
+      vmcase(OP_LE) vmgeneric(l_le) {
+        op_orderq(L, l_lei, LEnum, lessequalothers, OP_LEINT, OP_LEFLT);
         vmbreak;
       }
       vmcase(OP_EQK) {
@@ -1634,7 +1956,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         vmbreak;
       }
-      vmcase(OP_CALL) {
+      vmcase(OP_CALL)
+      vmentry(l_call) {
         CallInfo *newci;
         int b = GETARG_B(i);
         int nresults = GETARG_C(i) - 1;
@@ -1642,7 +1965,9 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
           L->top = ra + b;  /* top signals number of arguments */
         /* else previous instruction set top */
         savepc(L);  /* in case of errors */
-        if ((newci = luaD_precall(L, ra, nresults)) == NULL)
+        if (fastcall(L, ra, nresults))
+          updatetrap(ci);  /* done by the fast variant */
+        else if ((newci = luaD_precall(L, ra, nresults)) == NULL)
           updatetrap(ci);  /* C call; nothing else to be done */
         else {  /* Lua call: run function in this same C frame */
           ci = newci;
@@ -1842,6 +2167,66 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lua_assert(0);
         vmbreak;
       }
+#if defined(LUA_USE_SUPERINSTR)
+      vmcase(OP_GETTABUPCALL) {
+        op_gettabup(L);
+        vmfuse(l_call);
+      }
+      vmcase(OP_GETTABUPFIELD) {
+        op_gettabup(L);
+        vmfuse(l_getfield);
+      }
+      vmcase(OP_GETFIELDFIELD) {
+        op_getfield(L);
+        vmfuse(l_getfield);
+      }
+#endif
+#if defined(LUA_USE_QUICKEN)
+      vmcase(OP_ADDINT) {
+        op_arithint(L, l_addi, OP_ADD, l_add);
+        vmbreak;
+      }
+      vmcase(OP_ADDFLT) {
+        op_arithflt(L, luai_numadd, OP_ADD, l_add);
+        vmbreak;
+      }
+      vmcase(OP_SUBINT) {
+        op_arithint(L, l_subi, OP_SUB, l_sub);
+        vmbreak;
+      }
+      vmcase(OP_SUBFLT) {
+        op_arithflt(L, luai_numsub, OP_SUB, l_sub);
+        vmbreak;
+      }
+      vmcase(OP_MULINT) {
+        op_arithint(L, l_muli, OP_MUL, l_mul);
+        vmbreak;
+      }
+      vmcase(OP_MULFLT) {
+        op_arithflt(L, luai_nummul, OP_MUL, l_mul);
+        vmbreak;
+      }
+      vmcase(OP_DIVFLT) {
+        op_arithflt(L, luai_numdiv, OP_DIV, l_div);
+        vmbreak;
+      }
+      vmcase(OP_LTINT) {
+        op_orderint(L, l_lti, OP_LT, l_lt);
+        vmbreak;
+      }
+      vmcase(OP_LTFLT) {
+        op_orderflt(L, luai_numlt, OP_LT, l_lt);
+        vmbreak;
+      }
+      vmcase(OP_LEINT) {
+        op_orderint(L, l_lei, OP_LE, l_le);
+        vmbreak;
+      }
+      vmcase(OP_LEFLT) {
+        op_orderflt(L, luai_numle, OP_LE, l_le);
+        vmbreak;
+      }
+#endif
     }
   }
 }
@@ -1,10 +1,7 @@
 #ifndef SPIFFS_Config_Lib_h
 #define SPIFFS_Config_Lib_h
 
-#include <Arduino.h>
-#include <EEPROM.h>
-#include "FS.h"
-#include "SPIFFS.h"
+#include "LE_Port/LE_Port.h"
 
 
 #define FORMAT_SPIFFS_IF_FAILED true
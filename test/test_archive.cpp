@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "LuaBundle/LuaBundle.h"
+
+// Index of the test archives, small enough for names to collide
+#define AT_INDEX_BITS 3
+#define AT_NBUCKETS (1 << AT_INDEX_BITS)
+
+/**
+ * @brief Index of a script archive built in memory
+ *
+ */
+struct AT_Index {
+  LB_ArchiveHeader hdr;
+  std::vector<uint8_t> data; // Index buckets followed by the name table
+};
+
+/**
+ * @brief Build an archive index the way the bundler lays it out
+ *
+ * Module i gets offset 1000 * (i + 1) and size i + 1.
+ *
+ * @param names Module names, inserted in order with linear probing
+ */
+static AT_Index AT_Build(const std::vector<std::string> &names) {
+  AT_Index idx;
+  std::string table;
+  std::vector<uint8_t> buckets(AT_NBUCKETS * LB_ENTRY_LEN);
+  LB_Entry entry;
+
+  memset(&idx.hdr, 0, sizeof(idx.hdr));
+  idx.hdr.version = LB_ARC_VERSION;
+  idx.hdr.index_bits = AT_INDEX_BITS;
+  idx.hdr.hdr_len = LB_ARC_HEADER_LEN;
+  idx.hdr.nmodules = names.size();
+
+  entry.hash = 0;
+  entry.name_ofs = LB_ENTRY_EMPTY;
+  entry.offset = 0;
+  entry.size = 0;
+  for (int b = 0; b < AT_NBUCKETS; b++)
+    LuaBundle::LB_WriteEntry(&entry, &buckets[b * LB_ENTRY_LEN]);
+
+  for (size_t i = 0; i < names.size(); i++) {
+    uint32_t hash = LuaBundle::LB_Hash(names[i].c_str());
+    uint32_t b = hash & (AT_NBUCKETS - 1);
+    LB_Entry cur;
+    for (LuaBundle::LB_ReadEntry(&buckets[b * LB_ENTRY_LEN], &cur); cur.name_ofs != LB_ENTRY_EMPTY;
+         LuaBundle::LB_ReadEntry(&buckets[b * LB_ENTRY_LEN], &cur))
+      b = (b + 1) & (AT_NBUCKETS - 1);
+    entry.hash = hash;
+    entry.name_ofs = table.size();
+    entry.offset = 1000 * (i + 1);
+    entry.size = i + 1;
+    LuaBundle::LB_WriteEntry(&entry, &buckets[b * LB_ENTRY_LEN]);
+    table.append(names[i].c_str(), names[i].size() + 1);
+  }
+
+  idx.hdr.names_size = table.size();
+  idx.data = buckets;
+  idx.data.insert(idx.data.end(), table.begin(), table.end());
+  return idx;
+}
+
+/**
+ * @brief Module names whose hash falls in the given home bucket
+ *
+ * @param bucket Home bucket
+ * @param count Number of names
+ * @param skip Names of that bucket to skip first
+ */
+static std::vector<std::string> AT_Colliding(uint32_t bucket, size_t count, int skip = 0) {
+  std::vector<std::string> names;
+  char name[16];
+  for (int i = 0; names.size() < count; i++) {
+    snprintf(name, sizeof(name), "mod%d", i);
+    if ((LuaBundle::LB_Hash(name) & (AT_NBUCKETS - 1)) == bucket && skip-- <= 0)
+      names.push_back(name);
+  }
+  return names;
+}
+
+// Every module is found, also those moved past their home bucket and wrapped around the index
+TEST(Archive, FindModuleWithCollisions) {
+  std::vector<std::string> names = AT_Colliding(AT_NBUCKETS - 1, 3); // Probes wrap to bucket 0
+  std::vector<std::string> others = AT_Colliding(0, 2);
+  names.insert(names.end(), others.begin(), others.end());
+  AT_Index idx = AT_Build(names);
+  LB_Entry entry;
+
+  for (size_t i = 0; i < names.size(); i++) {
+    ASSERT_TRUE(LuaBundle::LB_FindModule(idx.data.data(), &idx.hdr, names[i].c_str(), &entry)) << names[i];
+    EXPECT_EQ(entry.hash, LuaBundle::LB_Hash(names[i].c_str()));
+    EXPECT_EQ(entry.offset, 1000 * (i + 1));
+    EXPECT_EQ(entry.size, i + 1);
+  }
+}
+
+// A missing name is not found, whether the probe ends at an empty bucket or goes through a full index
+TEST(Archive, FindMissingModule) {
+  std::vector<std::string> names = AT_Colliding(2, 4);
+  AT_Index idx = AT_Build(names);
+  LB_Entry entry;
+
+  EXPECT_FALSE(LuaBundle::LB_FindModule(idx.data.data(), &idx.hdr, AT_Colliding(2, 1, 4)[0].c_str(), &entry));
+  EXPECT_FALSE(LuaBundle::LB_FindModule(idx.data.data(), &idx.hdr, "", &entry));
+  EXPECT_FALSE(LuaBundle::LB_FindModule(idx.data.data(), &idx.hdr, "mod", &entry));
+
+  AT_Index full = AT_Build(AT_Colliding(5, AT_NBUCKETS));
+  EXPECT_FALSE(LuaBundle::LB_FindModule(full.data.data(), &full.hdr, AT_Colliding(5, 1, AT_NBUCKETS)[0].c_str(), &entry));
+  EXPECT_TRUE(LuaBundle::LB_FindModule(full.data.data(), &full.hdr, AT_Colliding(5, 1, AT_NBUCKETS - 1)[0].c_str(), &entry));
+  EXPECT_EQ(entry.size, (uint32_t) AT_NBUCKETS);
+}
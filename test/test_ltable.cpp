@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "LuaWrapper/lua/src/lua.hpp"
+extern "C" {
+#include "LuaWrapper/lua/src/lstate.h"
+#include "LuaWrapper/lua/src/ltable.h"
+}
+
+// Keys inserted one by one, enough to grow the hash part past LUAI_INCREHASH
+// twice, so that with LUA_USE_INCREHASH many traversals start while the old
+// hash part is still being moved
+#define LT_NKEYS (4 * LUAI_INCREHASH + 100)
+
+/**
+ * @brief Traverse the table on the top of the stack with lua_next
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param seen Visits of each key "k<i>", indexed by i
+ * @param clear Assign nil to every odd key visited, as allowed during a traversal
+ * @return int Number of keys visited, stopping past the size of seen
+ */
+static int LT_Traverse(lua_State *L, std::vector<int> &seen, bool clear) {
+  int count = 0;
+  lua_pushnil(L);
+  while (count <= (int) seen.size() && lua_next(L, -2) != 0) { // Bounded, a broken next may cycle
+    int i = atoi(lua_tostring(L, -2) + 1);
+    if (i >= 0 && i < (int) seen.size())
+      seen[i]++;
+    count++;
+    lua_pop(L, 1);
+    if (clear && (i & 1)) {
+      lua_pushvalue(L, -1);
+      lua_pushnil(L);
+      lua_rawset(L, -4);
+    }
+  }
+  if (count > (int) seen.size())
+    lua_pop(L, 1); // Key of the interrupted traversal
+  return count;
+}
+
+/**
+ * @brief Whether the table on the top of the stack is moving its old hash part
+ *
+ */
+static bool LT_InRehash(lua_State *L) {
+#if defined(LUA_USE_INCREHASH)
+  return inrehash(hvalue(s2v(L->top - 1)));
+#else
+  (void) L;
+  return false;
+#endif
+}
+
+/**
+ * @brief Push a new table holding the fields k1 = 1 .. kn = n, inserted in order
+ *
+ * @param L Pointer to Lua interpreter state
+ * @param n Number of fields
+ */
+static void LT_Fill(lua_State *L, int n) {
+  char key[16];
+  lua_newtable(L);
+  for (int i = 1; i <= n; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    lua_pushinteger(L, i);
+    lua_setfield(L, -2, key);
+  }
+}
+
+// next visits every key exactly once at every size, including mid-migration
+TEST(LuaTable, NextVisitsEachKeyOnce) {
+  lua_State *L = luaL_newstate();
+  char key[16];
+  int migrating = 0;
+
+  lua_newtable(L);
+  for (int n = 1; n <= LT_NKEYS; n++) {
+    snprintf(key, sizeof(key), "k%d", n);
+    lua_pushinteger(L, n);
+    lua_setfield(L, -2, key);
+
+    if (LT_InRehash(L))
+      migrating++;
+    std::vector<int> seen(n + 1, 0);
+    ASSERT_EQ(LT_Traverse(L, seen, false), n) << "after " << n << " keys";
+    for (int i = 1; i <= n; i++)
+      ASSERT_EQ(seen[i], 1) << "key k" << i << " after " << n << " keys";
+  }
+
+#if defined(LUA_USE_INCREHASH)
+  EXPECT_GT(migrating, 0);
+#endif
+  lua_close(L);
+}
+
+// Clearing fields while traversing does not lose or repeat the others, also mid-migration
+TEST(LuaTable, NextWhileClearing) {
+  lua_State *L = luaL_newstate();
+
+  for (int n = 1; n <= LT_NKEYS; n += 7) {
+    LT_Fill(L, n);
+    std::vector<int> seen(n + 1, 0);
+    ASSERT_EQ(LT_Traverse(L, seen, true), n);
+    for (int i = 1; i <= n; i++)
+      ASSERT_EQ(seen[i], 1) << "key k" << i << " of " << n << " keys";
+    std::vector<int> kept(n + 1, 0);
+    ASSERT_EQ(LT_Traverse(L, kept, false), n / 2);
+    lua_pop(L, 1);
+  }
+
+  lua_close(L);
+}
+
+// pairs, error and traceback handling keep working on a table in the middle of a migration
+TEST(LuaTable, PairsMidMigration) {
+  lua_State *L = luaL_newstate();
+  luaL_openlibs(L);
+
+  const char *script =
+    "local nkeys = ...\n"
+    "local t = {}\n"
+    "for i = 1, nkeys do\n"
+    "  t['k' .. i] = i\n"
+    "  local c, seen = 0, {}\n"
+    "  for k in pairs(t) do assert(not seen[k], k); seen[k] = true; c = c + 1 end\n"
+    "  assert(c == i, i)\n"
+    "end\n"
+    "local n = 0\n"
+    "for k in pairs(package.loaded) do n = n + 1 end\n"
+    "assert(n > 0)\n"
+    "assert(not pcall(error, 'x'))\n"
+    "local ok, tb = xpcall(error, debug.traceback)\n"
+    "assert(not ok and type(tb) == 'string')\n";
+  ASSERT_EQ(luaL_loadstring(L, script), LUA_OK) << lua_tostring(L, -1);
+  lua_pushinteger(L, LT_NKEYS);
+  ASSERT_EQ(lua_pcall(L, 1, 0, 0), LUA_OK) << lua_tostring(L, -1);
+
+  lua_close(L);
+}
+
+#if defined(LUA_USE_TABLESITE)
+/**
+ * @brief probe(t): number of hash nodes of t, and whether t is moving its old hash part
+ *
+ */
+static int LT_Probe(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+  bool moving = LT_InRehash(L);
+  lua_pushinteger(L, allocsizenode(hvalue(s2v(L->top - 1))));
+  lua_pushboolean(L, moving);
+  return 2;
+}
+
+// A constructor site sizes its next table from all the keys of the last one, also mid-migration
+TEST(LuaTable, SiteSizesMidMigration) {
+  lua_State *L = luaL_newstate();
+  int nkeys = LUAI_INCREHASH + 1 + LUAI_INCREHASH / LUAI_REHASHSTEP / 2; // Halfway through the migration
+
+  lua_register(L, "probe", LT_Probe);
+  const char *script =
+    "local nkeys = ...\n"
+    "local sizes, moving = {}, {}\n"
+    "for r = 1, 2 do\n"
+    "  local t = {}\n"
+    "  sizes[r] = probe(t)\n"
+    "  for i = 1, nkeys do t['k' .. i] = i end\n"
+    "  local _, m = probe(t)\n"
+    "  moving[r] = m\n"
+    "end\n"
+    "return sizes[2], moving[1]\n";
+  ASSERT_EQ(luaL_loadstring(L, script), LUA_OK) << lua_tostring(L, -1);
+  lua_pushinteger(L, nkeys);
+  ASSERT_EQ(lua_pcall(L, 1, 2, 0), LUA_OK) << lua_tostring(L, -1);
+  EXPECT_GE(lua_tointeger(L, -2), nkeys);
+#if defined(LUA_USE_INCREHASH)
+  EXPECT_TRUE(lua_toboolean(L, -1));
+#endif
+
+  lua_close(L);
+}
+#endif
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "LuaBundle/LuaBundle.h"
+#include "LuaWrapper/lua/src/lua.hpp"
+extern "C" {
+#include "LuaWrapper/lua/src/lstate.h"
+#include "LuaWrapper/lua/src/lobject.h"
+#include "LuaWrapper/lua/src/ldebug.h"
+}
+
+// Script with nested functions and a loop jumping back to an earlier line
+static const char *BT_SCRIPT =
+  "local function fact(n)\n"
+  "  if n <= 1 then\n"
+  "    return 1\n"
+  "  end\n"
+  "  return n * fact(n - 1)\n"
+  "end\n"
+  "\n"
+  "local t = {}\n"
+  "for i = 1, 10 do\n"
+  "  t[i] = function(x)\n"
+  "    local y = x * i\n"
+  "    return y + fact(i)\n"
+  "  end\n"
+  "end\n"
+  "return t[3](2)\n";
+
+/**
+ * @brief Input for the codec: Lua source repeated with small changes, then bytes without matches
+ *
+ * @param len Size of the input
+ */
+static std::vector<uint8_t> BT_Input(size_t len) {
+  std::vector<uint8_t> src;
+  size_t script_len = strlen(BT_SCRIPT);
+  for (int r = 0; src.size() < len / 2; r++) {
+    src.insert(src.end(), BT_SCRIPT, BT_SCRIPT + script_len);
+    src.push_back((uint8_t) r);
+  }
+  src.resize(len / 2);
+  srand(1);
+  while (src.size() < len)
+    src.push_back((uint8_t) rand());
+  return src;
+}
+
+/**
+ * @brief Decode a compressed buffer, handing the input to the decoder in chunks
+ *
+ * @param comp Compressed buffer
+ * @param wbits Window bits used by the compressor
+ * @param raw_size Size of the original input
+ * @param split Largest input chunk given to each LB_Decode call
+ * @return std::vector<uint8_t> Decoded bytes
+ */
+static std::vector<uint8_t> BT_Decode(const std::vector<uint8_t> &comp, uint8_t wbits, size_t raw_size, size_t split) {
+  std::vector<uint8_t> win((size_t) 1 << wbits);
+  std::vector<uint8_t> out;
+  LB_Decoder dec;
+  const uint8_t *in = comp.data();
+  size_t in_len = 0;
+  size_t left = comp.size();
+
+  LuaBundle::LB_DecoderInit(&dec, win.data(), wbits, raw_size);
+  while (out.size() < raw_size) {
+    if (in_len == 0) {
+      if (left == 0)
+        break; // Truncated input
+      in_len = left < split ? left : split;
+      left -= in_len;
+    }
+    const uint8_t *dec_out;
+    size_t before = in_len;
+    size_t n = LuaBundle::LB_Decode(&dec, &in, &in_len, &dec_out);
+    out.insert(out.end(), dec_out, dec_out + n);
+    if (n == 0 && in_len == before)
+      break; // Stalled decoder
+  }
+  return out;
+}
+
+// Compressed buffers decode back to the input at every window size, however the input is split
+TEST(Bundle, CompressRoundTrip) {
+  const size_t sizes[] = {0, 1, 100, 5000};
+  for (size_t len : sizes) {
+    std::vector<uint8_t> src = BT_Input(len);
+    for (uint8_t wbits = LB_MIN_WBITS; wbits <= LB_MAX_WBITS; wbits++) {
+      std::vector<uint8_t> comp(LuaBundle::LB_CompressBound(len));
+      size_t comp_len = LuaBundle::LB_Compress(src.data(), len, wbits, comp.data());
+      ASSERT_TRUE(comp_len > 0 || len == 0);
+      ASSERT_LE(comp_len, comp.size());
+      comp.resize(comp_len);
+
+      const size_t splits[] = {1, 7, comp_len > 0 ? comp_len : 1};
+      for (size_t split : splits) {
+        std::vector<uint8_t> out = BT_Decode(comp, wbits, len, split);
+        ASSERT_EQ(out.size(), len) << "wbits " << (int) wbits << ", split " << split;
+        ASSERT_TRUE(out == src) << "wbits " << (int) wbits << ", split " << split;
+      }
+    }
+  }
+}
+
+/**
+ * @brief lua_Writer appending the line map to a byte vector
+ *
+ */
+static int BT_Writer(lua_State *L, const void *p, size_t sz, void *ud) {
+  (void) L;
+  std::vector<uint8_t> *buf = (std::vector<uint8_t> *) ud;
+  buf->insert(buf->end(), (const uint8_t *) p, (const uint8_t *) p + sz);
+  return 0;
+}
+
+/**
+ * @brief Record the line of every instruction of a prototype and of its nested ones, in pre-order
+ *
+ */
+static void BT_Lines(const Proto *f, std::vector<std::vector<int>> &lines) {
+  std::vector<int> pl;
+  for (int pc = 0; pc < f->sizecode; pc++)
+    pl.push_back(luaG_getfuncline(f, pc));
+  lines.push_back(pl);
+  for (int i = 0; i < f->sizep; i++)
+    BT_Lines(f->p[i], lines);
+}
+
+// The line map written by lua_dropdebug gives the lines the debug information had
+TEST(Bundle, MapLineMatchesDebugInfo) {
+  lua_State *L = luaL_newstate();
+  std::vector<std::vector<int>> lines;
+  std::vector<uint8_t> map;
+
+  ASSERT_EQ(luaL_loadstring(L, BT_SCRIPT), LUA_OK) << lua_tostring(L, -1);
+  BT_Lines(getproto(s2v(L->top - 1)), lines);
+  ASSERT_EQ(lua_dropdebug(L, BT_Writer, &map), 0);
+  ASSERT_EQ(getproto(s2v(L->top - 1))->lineinfo, (ls_byte *) NULL);
+
+  ASSERT_GE(lines.size(), 3u);
+  for (size_t id = 0; id < lines.size(); id++) {
+    for (size_t pc = 0; pc < lines[id].size(); pc++) {
+      int line = lines[id][pc] > 0 ? lines[id][pc] : -1; // Line 0 is not recorded
+      EXPECT_EQ(LuaBundle::LB_MapLine(map.data(), map.size(), (int) id, (int) pc), line)
+        << "proto " << id << ", pc " << pc;
+    }
+  }
+  EXPECT_EQ(LuaBundle::LB_MapLine(map.data(), map.size(), (int) lines.size(), 0), -1);
+  EXPECT_EQ(LuaBundle::LB_MapLine(map.data(), map.size() / 2, (int) lines.size() - 1, 0), -1);
+
+  // The chunk still runs with its debug information dropped
+  ASSERT_EQ(lua_pcall(L, 0, 1, 0), LUA_OK) << lua_tostring(L, -1);
+  EXPECT_EQ(lua_tointeger(L, -1), 2 * 3 + 6);
+
+  lua_close(L);
+}
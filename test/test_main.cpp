@@ -1,7 +1,7 @@
-#include <Arduino.h>
-#include "LuaEngine_Lib.h"
+#include "LE_Port/LE_Port.h"
+#include "LuaEngine.h"
 #include <gtest/gtest.h>
-#include "SPIFFSConfig_Lib.h"
+#include "SPIFFSConfig/SPIFFSConfig.h"
 
 void LuaEng_test(void){
 
@@ -32,7 +32,7 @@ void setup() {
     // Initialize the GoogleTest framework
 
     ::testing::InitGoogleTest();
-    //RUN_ALL_TESTS();
+    RUN_ALL_TESTS();
 
     LuaEng_test();
     //URL_parser();
@@ -41,4 +41,13 @@ void setup() {
 // Loop function, required but not used for unit tests
 void loop() {
     // Leave this empty for unit tests
-}
\ No newline at end of file
+}
+
+#ifndef ARDUINO
+// Native entry point, running the sketch as the Arduino core does
+int main(int argc, char **argv) {
+    setup();
+    while (1)
+        loop();
+}
+#endif
@@ -0,0 +1,371 @@
+/*
+** luapack: compile Lua scripts into LuaEngine script bundles or archives.
+**
+** The script is compiled with the firmware Lua configuration, dumped
+** (optionally without debug information) and LZ compressed so that the
+** device can decode it on the fly while loading from SPIFFS. Stripped
+** bundles carry a compact line map after the payload, read by the device
+** only when it reports an error.
+**
+** With -a, several scripts are packed as modules of a single archive
+** file, with a hashed index of the module names in front of the bundles.
+**
+** -D name=value declares a host constant, as LuaWrapper::LW_DefineConst
+** does on the device, so that it is folded into the precompiled scripts.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.hpp"
+#include "LuaBundle/LuaBundle.h"
+
+#define PROGNAME "luapack"
+#define DEF_ARCHIVE "scripts.lba" // Default archive file name
+
+static const char *progname = PROGNAME;
+
+/**
+ * @brief Growable buffer receiving the dumped chunk
+ *
+ */
+struct DumpBuff {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+};
+
+/**
+ * @brief Bundle options
+ *
+ */
+struct PackOptions {
+  int strip;
+  int linemap;
+  int compress;
+  int wbits;
+};
+
+static void fatal(const char *msg) {
+  fprintf(stderr, "%s: %s\n", progname, msg);
+  exit(EXIT_FAILURE);
+}
+
+static void usage(void) {
+  fprintf(stderr,
+  "usage: %s [options] input.lua\n"
+  "       %s -a [options] input.lua...\n"
+  "Available options are:\n"
+  "  -a        pack the inputs as modules of a script archive\n"
+  "  -o name   output to file 'name' (default is the input name with .lbn,\n"
+  "            or " DEF_ARCHIVE " for an archive)\n"
+  "  -s        strip debug information, keeping a line map\n"
+  "  -S        strip debug information without a line map\n"
+  "  -n        store the chunk without compression\n"
+  "  -w bits   compression window bits, %d..%d (default %d)\n"
+  "  -D name=value  declare a host constant: an integer, a float, true,\n"
+  "            false or else a string\n",
+  progname, progname, LB_MIN_WBITS, LB_MAX_WBITS, LB_DEF_WBITS);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Declare a host constant of the scripts compiled afterwards
+ *
+ * @param L Lua state used to compile the scripts
+ * @param def Constant definition, name=value
+ */
+static void define_const(lua_State *L, const char *def) {
+  const char *eq = strchr(def, '=');
+  if (eq == NULL || eq == def)
+    usage();
+  const char *value = eq + 1;
+  char *end;
+
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_HOSTCONST_TABLE);
+  lua_pushlstring(L, def, eq - def); // Name
+  if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0)
+    lua_pushboolean(L, value[0] == 't');
+  else if (*value != '\0' && (strtoll(value, &end, 0), *end == '\0'))
+    lua_pushinteger(L, (lua_Integer) strtoll(value, NULL, 0));
+  else if (*value != '\0' && (strtod(value, &end), *end == '\0'))
+    lua_pushnumber(L, (lua_Number) strtod(value, NULL));
+  else
+    lua_pushstring(L, value);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+static int writer(lua_State *L, const void *p, size_t size, void *ud) {
+  DumpBuff *b = (DumpBuff *) ud;
+  (void) L;
+  if (b->len + size > b->cap) {
+    size_t cap = (b->cap == 0) ? 1024 : b->cap;
+    while (cap < b->len + size)
+      cap *= 2;
+    uint8_t *data = (uint8_t *) realloc(b->data, cap);
+    if (data == NULL)
+      return 1;
+    b->data = data;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, p, size);
+  b->len += size;
+  return 0;
+}
+
+static void append(DumpBuff *b, const void *p, size_t size) {
+  if (size > 0 && writer(NULL, p, size, b) != 0)
+    fatal("not enough memory");
+}
+
+/**
+ * @brief Compile a script and append its bundle to a buffer
+ *
+ * @param L Lua state used to compile the script
+ * @param input Script file name
+ * @param opt Bundle options
+ * @param out Buffer receiving the bundle
+ */
+static void make_bundle(lua_State *L, const char *input, const PackOptions *opt, DumpBuff *out) {
+  if (luaL_loadfile(L, input) != LUA_OK)
+    fatal(lua_tostring(L, -1));
+
+  DumpBuff chunk = { NULL, 0, 0 };
+  if (lua_dump(L, writer, &chunk, opt->strip) != 0)
+    fatal("cannot dump chunk: not enough memory");
+
+  DumpBuff map = { NULL, 0, 0 };
+  if (opt->linemap && lua_dropdebug(L, writer, &map) != 0)
+    fatal("cannot write line map: not enough memory");
+  lua_pop(L, 1);
+
+  LB_Header hdr;
+  hdr.version = LB_VERSION;
+  hdr.flags = opt->strip ? LB_FLAG_STRIPPED : 0;
+  hdr.wbits = 0;
+  hdr.hdr_len = LB_HEADER_LEN;
+  hdr.raw_size = (uint32_t) chunk.len;
+  hdr.map_size = (uint32_t) map.len;
+  if (opt->linemap)
+    hdr.flags |= LB_FLAG_LINEMAP;
+
+  uint8_t *payload = chunk.data;
+  size_t payload_len = chunk.len;
+  if (opt->compress) {
+    payload = (uint8_t *) malloc(LuaBundle::LB_CompressBound(chunk.len));
+    if (payload == NULL)
+      fatal("not enough memory");
+    payload_len = LuaBundle::LB_Compress(chunk.data, chunk.len, (uint8_t) opt->wbits, payload);
+    if (payload_len == 0 && chunk.len > 0)
+      fatal("not enough memory");
+    if (payload_len < chunk.len) {
+      hdr.flags |= LB_FLAG_COMPRESSED;
+      hdr.wbits = (uint8_t) opt->wbits;
+    }
+    else { // Incompressible chunk, store it as is
+      free(payload);
+      payload = chunk.data;
+      payload_len = chunk.len;
+    }
+  }
+  hdr.payload_size = (uint32_t) payload_len;
+
+  uint8_t header[LB_HEADER_LEN];
+  LuaBundle::LB_WriteHeader(&hdr, header);
+  append(out, header, sizeof(header));
+  append(out, payload, payload_len);
+  append(out, map.data, map.len);
+
+  fprintf(stderr, "%s: %u bytes chunk, %u bytes bundle, %u bytes line map\n", input,
+          (unsigned) chunk.len, (unsigned) (payload_len + LB_HEADER_LEN), (unsigned) map.len);
+
+  if (payload != chunk.data)
+    free(payload);
+  free(chunk.data);
+  free(map.data);
+}
+
+/**
+ * @brief Module name of a script: its file name without directory and extension
+ *
+ * @param input Script file name
+ * @return char* Module name, to be freed by the caller
+ */
+static char *module_name(const char *input) {
+  const char *base = strrchr(input, '/');
+  base = (base != NULL) ? base + 1 : input;
+  const char *dot = strrchr(base, '.');
+  size_t len = (dot != NULL && dot != base) ? (size_t) (dot - base) : strlen(base);
+  char *name = (char *) malloc(len + 1);
+  if (name == NULL)
+    fatal("not enough memory");
+  memcpy(name, base, len);
+  name[len] = '\0';
+  return name;
+}
+
+/**
+ * @brief Pack scripts as modules of an archive
+ *
+ * @param L Lua state used to compile the scripts
+ * @param inputs Script file names
+ * @param n Number of scripts
+ * @param opt Bundle options
+ * @param out Buffer receiving the archive
+ */
+static void make_archive(lua_State *L, char **inputs, int n, const PackOptions *opt, DumpBuff *out) {
+  // Index with at most half of the buckets used, so that probe chains stay short
+  uint8_t bits = 0;
+  while (((uint32_t) 1 << bits) < 2 * (uint32_t) n)
+    bits++;
+  if (bits > LB_ARC_MAX_BITS)
+    fatal("too many modules");
+  uint32_t nbuckets = (uint32_t) 1 << bits;
+
+  LB_Entry *index = (LB_Entry *) malloc(nbuckets * sizeof(LB_Entry));
+  if (index == NULL)
+    fatal("not enough memory");
+  for (uint32_t i = 0; i < nbuckets; i++)
+    index[i].name_ofs = LB_ENTRY_EMPTY;
+
+  DumpBuff names = { NULL, 0, 0 };
+  DumpBuff modules = { NULL, 0, 0 };
+  for (int m = 0; m < n; m++) {
+    char *name = module_name(inputs[m]);
+    LB_Entry e;
+    e.hash = LuaBundle::LB_Hash(name);
+    e.name_ofs = (uint32_t) names.len;
+    e.offset = (uint32_t) modules.len; // Relative to the first module until the index size is known
+    make_bundle(L, inputs[m], opt, &modules);
+    e.size = (uint32_t) (modules.len - e.offset);
+
+    uint32_t b = e.hash & (nbuckets - 1);
+    while (index[b].name_ofs != LB_ENTRY_EMPTY) {
+      if (index[b].hash == e.hash && strcmp((const char *) names.data + index[b].name_ofs, name) == 0) {
+        fprintf(stderr, "%s: duplicate module '%s'\n", progname, name);
+        exit(EXIT_FAILURE);
+      }
+      b = (b + 1) & (nbuckets - 1);
+    }
+    append(&names, name, strlen(name) + 1);
+    index[b] = e;
+    free(name);
+  }
+
+  LB_ArchiveHeader hdr;
+  hdr.version = LB_ARC_VERSION;
+  hdr.index_bits = bits;
+  hdr.hdr_len = LB_ARC_HEADER_LEN;
+  hdr.nmodules = (uint32_t) n;
+  hdr.names_size = (uint32_t) names.len;
+
+  uint8_t header[LB_ARC_HEADER_LEN];
+  LuaBundle::LB_WriteArchiveHeader(&hdr, header);
+  append(out, header, sizeof(header));
+
+  uint32_t base = LB_ARC_HEADER_LEN + nbuckets * LB_ENTRY_LEN + (uint32_t) names.len;
+  for (uint32_t i = 0; i < nbuckets; i++) {
+    uint8_t entry[LB_ENTRY_LEN];
+    if (index[i].name_ofs != LB_ENTRY_EMPTY)
+      index[i].offset += base;
+    else
+      index[i].hash = index[i].offset = index[i].size = 0;
+    LuaBundle::LB_WriteEntry(&index[i], entry);
+    append(out, entry, sizeof(entry));
+  }
+  append(out, names.data, names.len);
+  append(out, modules.data, modules.len);
+
+  free(index);
+  free(names.data);
+  free(modules.data);
+}
+
+int main(int argc, char *argv[]) {
+  const char *output = NULL;
+  char **inputs = (char **) malloc(argc * sizeof(char *));
+  int ninputs = 0;
+  char **defs = (char **) malloc(argc * sizeof(char *));
+  int ndefs = 0;
+  int archive = 0;
+  PackOptions opt = { 0, 0, 1, LB_DEF_WBITS };
+
+  if (argv[0] != NULL && *argv[0] != 0)
+    progname = argv[0];
+  if (inputs == NULL || defs == NULL)
+    fatal("not enough memory");
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else if (strcmp(argv[i], "-a") == 0)
+      archive = 1;
+    else if (strcmp(argv[i], "-s") == 0)
+      opt.strip = opt.linemap = 1;
+    else if (strcmp(argv[i], "-S") == 0) {
+      opt.strip = 1;
+      opt.linemap = 0;
+    }
+    else if (strcmp(argv[i], "-n") == 0)
+      opt.compress = 0;
+    else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      opt.wbits = atoi(argv[++i]);
+      if (opt.wbits < LB_MIN_WBITS || opt.wbits > LB_MAX_WBITS)
+        usage();
+    }
+    else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc)
+      defs[ndefs++] = argv[++i];
+    else if (argv[i][0] == '-')
+      usage();
+    else
+      inputs[ninputs++] = argv[i];
+  }
+  if (ninputs == 0 || (ninputs > 1 && !archive))
+    usage();
+
+  lua_State *L = luaL_newstate();
+  if (L == NULL)
+    fatal("cannot create state: not enough memory");
+  for (int i = 0; i < ndefs; i++)
+    define_const(L, defs[i]);
+
+  DumpBuff out = { NULL, 0, 0 };
+  if (archive)
+    make_archive(L, inputs, ninputs, &opt, &out);
+  else
+    make_bundle(L, inputs[0], &opt, &out);
+
+  char *outname = NULL;
+  if (output == NULL && archive)
+    output = DEF_ARCHIVE;
+  else if (output == NULL) { // Replace the extension with .lbn
+    const char *input = inputs[0];
+    const char *dot = strrchr(input, '.');
+    size_t base = (dot != NULL && strchr(dot, '/') == NULL) ? (size_t) (dot - input) : strlen(input);
+    outname = (char *) malloc(base + 5);
+    if (outname == NULL)
+      fatal("not enough memory");
+    memcpy(outname, input, base);
+    strcpy(outname + base, ".lbn");
+    output = outname;
+  }
+
+  FILE *f = fopen(output, "wb");
+  if (f == NULL)
+    fatal("cannot open output file");
+  if (fwrite(out.data, 1, out.len, f) != out.len || fclose(f) != 0)
+    fatal("cannot write output file");
+
+  if (archive)
+    fprintf(stderr, "%s: %d modules, %u bytes archive\n", output, ninputs, (unsigned) out.len);
+
+  free(out.data);
+  free(outname);
+  free(inputs);
+  free(defs);
+  lua_close(L);
+
+  return EXIT_SUCCESS;
+}